@@ -0,0 +1,266 @@
+#include "flight_recorder.h"
+
+#include <fcntl.h>
+#include <signal.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <cstring>
+#include <ctime>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace flight_recorder {
+namespace {
+
+constexpr size_t kRingSize = 256;   // events kept per thread
+constexpr size_t kMaxRings = 1024;  // rings that can be dumped; threads past this record but are not listed
+constexpr size_t kDetailLen = 64;
+
+struct Event {
+  int64_t tUs = 0;
+  int64_t a = 0;
+  int64_t b = 0;
+  int64_t durUs = 0;
+  Kind kind = Kind::Note;
+  char detail[kDetailLen] = {};
+};
+
+struct Ring {
+  int64_t tid = 0;
+  std::atomic<uint64_t> next{0};  // total events written; slot = next % kRingSize
+  Event events[kRingSize];
+};
+
+// Rings are never freed: a thread that died before the failure is often the interesting one. An
+// exiting thread hands its ring to the free list; the next new thread takes it over, so short-lived
+// threads reuse a bounded set of rings instead of allocating one each. The dump still lists a
+// reused ring's older events (under the new tid) until they are overwritten.
+std::atomic<Ring*> g_rings[kMaxRings];
+std::atomic<size_t> g_ringCount{0};
+// Leaked like the rings: detached threads (abandoned samplers) may exit during static destruction.
+std::mutex& g_freeMu = *new std::mutex();
+std::vector<Ring*>& g_freeRings = *new std::vector<Ring*>();
+
+struct RingOwner {
+  Ring* ring = nullptr;
+  ~RingOwner() {
+    if (!ring) return;
+    std::lock_guard<std::mutex> lock(g_freeMu);
+    g_freeRings.push_back(ring);
+  }
+};
+thread_local RingOwner t_ring;
+
+std::atomic<int> g_ioWaits{0};
+std::atomic<int64_t> g_ioArmedUs{0};  // when g_ioWaits last went from 0 to 1
+
+std::atomic<int64_t> g_lastEventUs{0};
+std::atomic_flag g_dumping = ATOMIC_FLAG_INIT;
+char g_dumpPath[4096] = {};
+int64_t g_startUs = 0;
+
+const char* kindName(Kind k) {
+  switch (k) {
+    case Kind::Seek: return "seek";
+    case Kind::Read: return "read";
+    case Kind::Http: return "http";
+    case Kind::Refine: return "refine";
+    case Kind::Error: return "error";
+    case Kind::Note: return "note";
+  }
+  return "?";
+}
+
+Ring* threadRing() {
+  if (!t_ring.ring) {
+    Ring* ring = nullptr;
+    {
+      std::lock_guard<std::mutex> lock(g_freeMu);
+      if (!g_freeRings.empty()) {
+        ring = g_freeRings.back();
+        g_freeRings.pop_back();
+      }
+    }
+    if (!ring) {
+      ring = new Ring();
+      const size_t slot = g_ringCount.fetch_add(1, std::memory_order_relaxed);
+      if (slot < kMaxRings) g_rings[slot].store(ring, std::memory_order_release);
+    }
+    ring->tid = static_cast<int64_t>(::syscall(SYS_gettid));
+    t_ring.ring = ring;
+  }
+  return t_ring.ring;
+}
+
+// Line formatting without stdio or allocation, so dump() stays async-signal-safe.
+struct LineBuf {
+  char buf[256];
+  size_t len = 0;
+
+  void str(const char* s) {
+    while (*s && len < sizeof(buf) - 1) buf[len++] = *s++;
+  }
+  void num(int64_t v) {
+    char tmp[24];
+    size_t n = 0;
+    const bool neg = v < 0;
+    uint64_t u = neg ? static_cast<uint64_t>(-(v + 1)) + 1 : static_cast<uint64_t>(v);
+    do {
+      tmp[n++] = static_cast<char>('0' + (u % 10));
+      u /= 10;
+    } while (u > 0 && n < sizeof(tmp));
+    if (neg && len < sizeof(buf) - 1) buf[len++] = '-';
+    while (n > 0 && len < sizeof(buf) - 1) buf[len++] = tmp[--n];
+  }
+  bool flush(int fd) {
+    buf[len++] = '\n';
+    size_t off = 0;
+    while (off < len) {
+      const ssize_t w = ::write(fd, buf + off, len - off);
+      if (w < 0 && errno == EINTR) continue;
+      if (w <= 0) return false;
+      off += static_cast<size_t>(w);
+    }
+    len = 0;
+    return true;
+  }
+};
+
+void onSigterm(int sig) {
+  const int savedErrno = errno;
+  dump("SIGTERM");
+  errno = savedErrno;
+  // Terminate the way the sender expects.
+  ::signal(sig, SIG_DFL);
+  ::raise(sig);
+}
+
+void watchStalls(double stallSec) {
+  const int64_t stallUs = static_cast<int64_t>(stallSec * 1e6);
+  int64_t dumpedAtEvent = -1;
+  for (;;) {
+    std::this_thread::sleep_for(std::chrono::seconds(1));
+    if (g_ioWaits.load(std::memory_order_relaxed) <= 0) continue;
+    // Quiet time counts from the later of the last event and the moment I/O was armed.
+    const int64_t last = std::max(g_lastEventUs.load(std::memory_order_relaxed),
+                                  g_ioArmedUs.load(std::memory_order_relaxed));
+    // One dump per stall: wait for a new event before dumping again.
+    if (last != dumpedAtEvent && nowUs() - last >= stallUs) {
+      dump("stall");
+      dumpedAtEvent = last;
+    }
+  }
+}
+
+}  // namespace
+
+int64_t nowUs() {
+  timespec ts{};
+  ::clock_gettime(CLOCK_MONOTONIC, &ts);
+  return static_cast<int64_t>(ts.tv_sec) * 1000000 + ts.tv_nsec / 1000;
+}
+
+void record(Kind kind, int64_t a, int64_t b, int64_t durUs, const char* detail) {
+  Ring* ring = threadRing();
+  const uint64_t seq = ring->next.load(std::memory_order_relaxed);
+  Event& e = ring->events[seq % kRingSize];
+  e.tUs = nowUs();
+  e.a = a;
+  e.b = b;
+  e.durUs = durUs;
+  e.kind = kind;
+  if (detail) {
+    std::strncpy(e.detail, detail, kDetailLen - 1);
+    e.detail[kDetailLen - 1] = '\0';
+  } else {
+    e.detail[0] = '\0';
+  }
+  ring->next.store(seq + 1, std::memory_order_release);
+  g_lastEventUs.store(e.tUs, std::memory_order_relaxed);
+}
+
+void ioBegin() {
+  if (g_ioWaits.fetch_add(1, std::memory_order_relaxed) == 0) g_ioArmedUs.store(nowUs(), std::memory_order_relaxed);
+}
+
+void ioEnd() { g_ioWaits.fetch_sub(1, std::memory_order_relaxed); }
+
+void install(const std::string& path, double stallSec) {
+  std::strncpy(g_dumpPath, path.c_str(), sizeof(g_dumpPath) - 1);
+  g_startUs = nowUs();
+  g_lastEventUs.store(g_startUs, std::memory_order_relaxed);
+
+  struct sigaction sa {};
+  sa.sa_handler = onSigterm;
+  sigemptyset(&sa.sa_mask);
+  ::sigaction(SIGTERM, &sa, nullptr);
+
+  if (stallSec > 0.0) std::thread(watchStalls, stallSec).detach();
+}
+
+const char* dumpPath() { return g_dumpPath; }
+
+bool dump(const char* reason) {
+  if (g_dumpPath[0] == '\0') return false;
+  // A second trigger while a dump is in progress (stall + SIGTERM) keeps the first one.
+  if (g_dumping.test_and_set()) return false;
+  const int fd = ::open(g_dumpPath, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+  bool ok = fd >= 0;
+  if (ok) {
+    const int64_t now = nowUs();
+    LineBuf line;
+    line.str("# ads_detector flight recorder: reason=");
+    line.str(reason);
+    line.str(" pid=");
+    line.num(static_cast<int64_t>(::getpid()));
+    line.str(" uptimeMs=");
+    line.num((now - g_startUs) / 1000);
+    line.str(" sinceLastEventMs=");
+    line.num((now - g_lastEventUs.load(std::memory_order_relaxed)) / 1000);
+    ok = line.flush(fd);
+    line.str("# tMs tid kind a b durUs detail (tMs since install; per thread, oldest first)");
+    ok = ok && line.flush(fd);
+
+    const size_t rings = std::min(g_ringCount.load(std::memory_order_acquire), kMaxRings);
+    for (size_t r = 0; r < rings && ok; r++) {
+      const Ring* ring = g_rings[r].load(std::memory_order_acquire);
+      if (!ring) continue;
+      const uint64_t end = ring->next.load(std::memory_order_acquire);
+      const uint64_t begin = end > kRingSize ? end - kRingSize : 0;
+      for (uint64_t i = begin; i < end && ok; i++) {
+        // Events are read without locking; one being overwritten right now may come out torn.
+        const Event& e = ring->events[i % kRingSize];
+        line.num((e.tUs - g_startUs) / 1000);
+        line.str(" ");
+        line.num(ring->tid);
+        line.str(" ");
+        line.str(kindName(e.kind));
+        line.str(" ");
+        line.num(e.a);
+        line.str(" ");
+        line.num(e.b);
+        line.str(" ");
+        line.num(e.durUs);
+        if (e.detail[0] != '\0') {
+          line.str(" ");
+          char detail[kDetailLen];
+          std::memcpy(detail, e.detail, kDetailLen);
+          detail[kDetailLen - 1] = '\0';
+          line.str(detail);
+        }
+        ok = line.flush(fd);
+      }
+    }
+    ::close(fd);
+  }
+  g_dumping.clear();
+  return ok;
+}
+
+}  // namespace flight_recorder
@@ -0,0 +1,46 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+
+// Always-on record of each thread's most recent events (seeks, reads, HTTP calls, errors),
+// kept in a fixed per-thread ring and written out only when something goes wrong: SIGTERM
+// (e.g. the service's timeout kill), an error that ends the run, or a stall.
+namespace flight_recorder {
+
+enum class Kind : uint8_t { Seek, Read, Http, Refine, Error, Note };
+
+// Monotonic clock in microseconds, for event durations.
+int64_t nowUs();
+
+// Appends an event to the calling thread's ring (oldest entries are overwritten). Lock-free and
+// allocation-free after the thread's first call. `detail` is copied, truncated to 63 bytes.
+void record(Kind kind, int64_t a, int64_t b, int64_t durUs, const char* detail = nullptr);
+
+// Sets the dump file and installs a SIGTERM handler that dumps and then terminates as before.
+// With `stallSec` > 0, a watchdog thread also dumps once whenever an I/O wait (see IoWait) stays
+// open that long with no event recorded. Call once, before the worker threads start.
+void install(const std::string& dumpPath, double stallSec);
+
+// Marks the calling scope as waiting on media or network I/O (fetch, open, seek, read). Only these
+// arm the stall watchdog: CPU-only phases and deliberate long polls (blocking playlist reloads,
+// preload hints) are left out so they never dump.
+void ioBegin();
+void ioEnd();
+
+class IoWait {
+ public:
+  IoWait() { ioBegin(); }
+  ~IoWait() { ioEnd(); }
+  IoWait(const IoWait&) = delete;
+  IoWait& operator=(const IoWait&) = delete;
+};
+
+// Writes every ring (per thread, oldest first) to the dump file, replacing it. Async-signal-safe.
+// Returns false if the file could not be written or install() was never called.
+bool dump(const char* reason);
+
+// Dump file path set by install() ("" before).
+const char* dumpPath();
+
+}  // namespace flight_recorder
@@ -1,7 +1,11 @@
 #include "http.h"
 
+#include "flight_recorder.h"
+#include "trace.h"
+
 #include <curl/curl.h>
 
+#include <algorithm>
 #include <stdexcept>
 #include <string>
 
@@ -14,11 +18,7 @@ size_t writeToString(void* contents, size_t size, size_t nmemb, void* userp) {
   return total;
 }
 
-}  // namespace
-
-namespace http {
-
-std::string get(const std::string& url, long timeoutSeconds) {
+std::string fetch(const std::string& url, const std::string& range, long timeoutSeconds) {
   CURL* curl = curl_easy_init();
   if (!curl) throw std::runtime_error("curl_easy_init failed");
 
@@ -29,11 +29,20 @@ std::string get(const std::string& url, long timeoutSeconds) {
   curl_easy_setopt(curl, CURLOPT_USERAGENT, "insight-ads-detector/1.0");
   curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, writeToString);
   curl_easy_setopt(curl, CURLOPT_WRITEDATA, &response);
+  if (!range.empty()) curl_easy_setopt(curl, CURLOPT_RANGE, range.c_str());
 
+  ADS_TRACE1(http_start, url.c_str());
+  const int64_t startUs = flight_recorder::nowUs();
   const CURLcode res = curl_easy_perform(curl);
   long httpCode = 0;
   curl_easy_getinfo(curl, CURLINFO_RESPONSE_CODE, &httpCode);
   curl_easy_cleanup(curl);
+  // Errors keep curl's message; successful calls keep the URL.
+  flight_recorder::record(flight_recorder::Kind::Http, res == CURLE_OK ? httpCode : -1,
+                          static_cast<int64_t>(response.size()), flight_recorder::nowUs() - startUs,
+                          res == CURLE_OK ? url.c_str() : curl_easy_strerror(res));
+  ADS_TRACE3(http_end, url.c_str(), static_cast<int64_t>(res == CURLE_OK ? httpCode : -1),
+             static_cast<int64_t>(response.size()));
 
   if (res != CURLE_OK) {
     throw std::runtime_error(std::string("curl_easy_perform failed: ") +
@@ -45,6 +54,20 @@ std::string get(const std::string& url, long timeoutSeconds) {
   return response;
 }
 
+}  // namespace
+
+namespace http {
+
+std::string get(const std::string& url, long timeoutSeconds) {
+  return fetch(url, "", timeoutSeconds);
+}
+
+std::string getRange(const std::string& url, int64_t offset, int64_t length, long timeoutSeconds) {
+  std::string range = std::to_string(std::max<int64_t>(0, offset)) + "-";
+  if (length > 0) range += std::to_string(std::max<int64_t>(0, offset) + length - 1);
+  return fetch(url, range, timeoutSeconds);
+}
+
 bool headOk(const std::string& url, long timeoutSeconds) {
   CURL* curl = curl_easy_init();
   if (!curl) return false;
@@ -56,12 +79,17 @@ bool headOk(const std::string& url, long timeoutSeconds) {
   curl_easy_setopt(curl, CURLOPT_CONNECTTIMEOUT, timeoutSeconds);
   curl_easy_setopt(curl, CURLOPT_USERAGENT, "insight-ads-detector/1.0");
 
+  ADS_TRACE1(http_start, url.c_str());
+  const int64_t startUs = flight_recorder::nowUs();
   const CURLcode res = curl_easy_perform(curl);
   long httpCode = 0;
   if (res == CURLE_OK) {
     curl_easy_getinfo(curl, CURLINFO_RESPONSE_CODE, &httpCode);
   }
   curl_easy_cleanup(curl);
+  flight_recorder::record(flight_recorder::Kind::Http, res == CURLE_OK ? httpCode : -1, 0,
+                          flight_recorder::nowUs() - startUs, res == CURLE_OK ? url.c_str() : curl_easy_strerror(res));
+  ADS_TRACE3(http_end, url.c_str(), static_cast<int64_t>(res == CURLE_OK ? httpCode : -1), static_cast<int64_t>(0));
 
   return res == CURLE_OK && httpCode >= 200 && httpCode < 400;
 }
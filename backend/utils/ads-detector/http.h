@@ -1,5 +1,6 @@
 #pragma once
 
+#include <cstdint>
 #include <string>
 
 namespace http {
@@ -7,6 +8,10 @@ namespace http {
 // Throws std::runtime_error on failure.
 std::string get(const std::string& url, long timeoutSeconds = 20);
 
+// Fetches bytes [offset, offset + length) of the resource; length < 0 reads to the end.
+// Throws std::runtime_error on failure.
+std::string getRange(const std::string& url, int64_t offset, int64_t length, long timeoutSeconds = 20);
+
 // Returns true if the URL responds with 2xx, false otherwise.
 // Does not throw — connection errors return false.
 bool headOk(const std::string& url, long timeoutSeconds = 3);
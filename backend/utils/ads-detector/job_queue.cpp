@@ -0,0 +1,273 @@
+#include "job_queue.h"
+
+#include "json_util.h"
+#include "time_util.h"
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <chrono>
+#include <filesystem>
+#include <fstream>
+#include <random>
+#include <sstream>
+#include <stdexcept>
+
+namespace fs = std::filesystem;
+
+namespace job_queue {
+namespace {
+
+// How long a just-claimed job may sit in leased/ before its first lease is written.
+constexpr int64_t kClaimGraceMs = 30000;
+
+int64_t nowMs() {
+  return std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::system_clock::now().time_since_epoch())
+      .count();
+}
+
+fs::path jobPath(const std::string& root, const char* state, const std::string& id) {
+  return fs::path(root) / state / (id + ".job");
+}
+
+fs::path leasePath(const std::string& root, const std::string& id) {
+  return fs::path(root) / "leased" / (id + ".lease");
+}
+
+// Owner ids go into file names ("<host>:<pid>"); keep them to one path component.
+std::string ownerTag(const std::string& owner) {
+  std::string tag = owner;
+  for (char& c : tag) {
+    if (c == '/' || c == '\\') c = '_';
+  }
+  return tag;
+}
+
+// "<host>.<pid>.<random>": unique across the hosts sharing the queue, where pids repeat.
+std::string uniqueSuffix() {
+  char host[256] = {0};
+  ::gethostname(host, sizeof(host) - 1);
+  std::ostringstream s;
+  s << ownerTag(host[0] ? host : "host") << '.' << ::getpid() << '.' << std::hex << std::random_device{}();
+  return s.str();
+}
+
+// Write-then-rename so readers on other hosts never see a partial file.
+void writeAtomic(const fs::path& path, const std::string& content) {
+  const fs::path tmp = path.string() + ".tmp." + uniqueSuffix();
+  {
+    std::ofstream out(tmp, std::ios::binary | std::ios::trunc);
+    if (!out.is_open()) throw std::runtime_error("job queue: could not write " + tmp.string());
+    out << content;
+  }
+  std::error_code ec;
+  fs::rename(tmp, path, ec);
+  if (ec) {
+    fs::remove(tmp, ec);
+    throw std::runtime_error("job queue: could not publish " + path.string());
+  }
+}
+
+struct Lease {
+  std::string owner;
+  int64_t expiresEpochMs = 0;
+};
+
+std::optional<Lease> readLease(const std::string& root, const std::string& id) {
+  std::ifstream in(leasePath(root, id));
+  Lease lease;
+  if (!(in >> lease.owner >> lease.expiresEpochMs)) return std::nullopt;
+  return lease;
+}
+
+void writeLease(const std::string& root, const std::string& id, const std::string& owner, int leaseSec) {
+  writeAtomic(leasePath(root, id), owner + " " + std::to_string(nowMs() + int64_t{leaseSec} * 1000) + "\n");
+}
+
+bool ownsLease(const std::string& root, const std::string& id, const std::string& owner) {
+  const auto lease = readLease(root, id);
+  std::error_code ec;
+  return lease && lease->owner == owner && fs::exists(jobPath(root, "leased", id), ec);
+}
+
+// One O_APPEND write per line keeps concurrent workers' lines whole.
+void journal(const std::string& root, const std::string& id, const std::string& owner, bool ok,
+             int64_t elapsedMs, const std::string& detail) {
+  std::ostringstream line;
+  line << "{\"job\":";
+  json_util::writeString(line, id);
+  line << ",\"worker\":";
+  json_util::writeString(line, owner);
+  line << ",\"ok\":" << (ok ? "true" : "false") << ",\"elapsedMs\":" << elapsedMs << ",\"finishedAt\":";
+  json_util::writeString(line, time_util::epochMsToIso8601Utc(nowMs()));
+  line << (ok ? ",\"result\":" : ",\"error\":");
+  json_util::writeString(line, detail);
+  line << "}\n";
+  const std::string s = line.str();
+  const int fd = ::open((fs::path(root) / "journal.jsonl").c_str(), O_WRONLY | O_CREAT | O_APPEND, 0644);
+  if (fd < 0) return;
+  const ssize_t written = ::write(fd, s.data(), s.size());
+  (void)written;
+  ::close(fd);
+}
+
+std::vector<std::string> idsIn(const std::string& root, const char* state) {
+  std::vector<std::string> ids;
+  std::error_code ec;
+  for (const auto& de : fs::directory_iterator(fs::path(root) / state, ec)) {
+    if (de.path().extension() == ".job") ids.push_back(de.path().stem().string());
+  }
+  std::sort(ids.begin(), ids.end());
+  return ids;
+}
+
+}  // namespace
+
+void init(const std::string& root) {
+  for (const char* state : {"pending", "leased", "done", "failed"}) {
+    std::error_code ec;
+    fs::create_directories(fs::path(root) / state, ec);
+    if (ec) throw std::runtime_error("job queue: could not create " + (fs::path(root) / state).string());
+  }
+}
+
+void enqueue(const std::string& root, const std::string& id, const std::vector<std::string>& args) {
+  std::string content;
+  for (const auto& a : args) content += a + "\n";
+  writeAtomic(jobPath(root, "pending", id), content);
+}
+
+std::optional<Job> claim(const std::string& root, const std::string& owner, int leaseSec) {
+  for (const auto& id : idsIn(root, "pending")) {
+    std::error_code ec;
+    fs::rename(jobPath(root, "pending", id), jobPath(root, "leased", id), ec);
+    if (ec) continue;  // Another worker won this one.
+    writeLease(root, id, owner, leaseSec);
+    Job job;
+    job.id = id;
+    std::ifstream in(jobPath(root, "leased", id));
+    for (std::string line; std::getline(in, line);) {
+      if (!line.empty() && line.back() == '\r') line.pop_back();
+      if (!line.empty()) job.args.push_back(line);
+    }
+    return job;
+  }
+  return std::nullopt;
+}
+
+bool renew(const std::string& root, const std::string& id, const std::string& owner, int leaseSec) {
+  if (!ownsLease(root, id, owner)) return false;
+  writeLease(root, id, owner, leaseSec);
+  return true;
+}
+
+size_t requeueExpired(const std::string& root) {
+  size_t requeued = 0;
+  const int64_t now = nowMs();
+  for (const auto& id : idsIn(root, "leased")) {
+    const auto lease = readLease(root, id);
+    if (lease && lease->expiresEpochMs > now) continue;
+    if (!lease) {
+      // Claimed a moment ago and the lease is not written yet: the claiming rename set ctime.
+      struct stat st {};
+      if (::stat(jobPath(root, "leased", id).c_str(), &st) == 0 &&
+          int64_t{st.st_ctime} * 1000 + kClaimGraceMs > now) {
+        continue;
+      }
+    }
+    // Take the job out of leased/<id>.job first, as complete() does: once it is held nobody can
+    // claim, renew or complete it, so dropping the lease cannot race a fresh claim's lease.
+    std::error_code ec;
+    const fs::path held = fs::path(root) / "leased" / (id + "." + uniqueSuffix() + ".requeuing");
+    fs::rename(jobPath(root, "leased", id), held, ec);
+    if (ec) continue;  // Completed or re-queued by someone else meanwhile.
+    const auto current = readLease(root, id);
+    if (current && current->expiresEpochMs > nowMs()) {
+      fs::rename(held, jobPath(root, "leased", id), ec);  // Renewed after the check above.
+      continue;
+    }
+    fs::remove(leasePath(root, id), ec);
+    fs::rename(held, jobPath(root, "pending", id), ec);
+    requeued++;
+  }
+  return requeued;
+}
+
+std::string resultTmpPath(const std::string& root, const std::string& id, const std::string& owner) {
+  return (fs::path(root) / "done" / (id + "." + ownerTag(owner) + ".json.tmp")).string();
+}
+
+bool complete(const std::string& root, const std::string& id, const std::string& owner, int64_t elapsedMs) {
+  std::error_code ec;
+  const fs::path tmp = resultTmpPath(root, id, owner);
+  if (!ownsLease(root, id, owner)) {
+    fs::remove(tmp, ec);
+    return false;
+  }
+  // Moving the job file out of leased/<id>.job is the commit point: claim(), renew() and
+  // requeueExpired() only look there, so after this rename nobody can re-lease the job. The lease
+  // may still have changed hands between the check above and the rename; if so, hand the job back.
+  const fs::path held = fs::path(root) / "leased" / (id + "." + ownerTag(owner) + ".publishing");
+  fs::rename(jobPath(root, "leased", id), held, ec);
+  if (ec) {
+    fs::remove(tmp, ec);
+    return false;
+  }
+  const auto lease = readLease(root, id);
+  if (lease && lease->owner != owner) {
+    fs::rename(held, jobPath(root, "leased", id), ec);
+    fs::remove(tmp, ec);
+    return false;
+  }
+  const fs::path result = fs::path(root) / "done" / (id + ".json");
+  fs::rename(tmp, result, ec);
+  if (ec) {
+    try {
+      writeAtomic(fs::path(root) / "failed" / (id + ".err"), "detector wrote no output\n");
+    } catch (const std::exception&) {
+    }
+    fs::rename(held, jobPath(root, "failed", id), ec);
+    fs::remove(leasePath(root, id), ec);
+    journal(root, id, owner, false, elapsedMs, "detector wrote no output");
+    return true;
+  }
+  fs::remove(held, ec);
+  fs::remove(leasePath(root, id), ec);
+  journal(root, id, owner, true, elapsedMs, result.lexically_relative(root).string());
+  return true;
+}
+
+bool fail(const std::string& root, const std::string& id, const std::string& owner, int64_t elapsedMs,
+          const std::string& reason, bool retry) {
+  if (!ownsLease(root, id, owner)) return false;
+  std::error_code ec;
+  fs::remove(resultTmpPath(root, id, owner), ec);
+  if (!retry) {
+    try {
+      writeAtomic(fs::path(root) / "failed" / (id + ".err"), reason + "\n");
+    } catch (const std::exception&) {
+    }
+  }
+  // Same hand-off as complete(): hold the job, drop the lease, then release it, so a claim of the
+  // re-queued job never has its fresh lease removed by us.
+  const fs::path held = fs::path(root) / "leased" / (id + "." + ownerTag(owner) + ".failing");
+  fs::rename(jobPath(root, "leased", id), held, ec);
+  if (ec) return false;
+  const auto lease = readLease(root, id);
+  if (lease && lease->owner != owner) {
+    fs::rename(held, jobPath(root, "leased", id), ec);
+    return false;
+  }
+  fs::remove(leasePath(root, id), ec);
+  fs::rename(held, jobPath(root, retry ? "pending" : "failed", id), ec);
+  journal(root, id, owner, false, elapsedMs, reason);
+  return true;
+}
+
+size_t pendingCount(const std::string& root) { return idsIn(root, "pending").size(); }
+
+size_t leasedCount(const std::string& root) { return idsIn(root, "leased").size(); }
+
+}  // namespace job_queue
@@ -0,0 +1,54 @@
+#pragma once
+
+#include <cstdint>
+#include <optional>
+#include <string>
+#include <vector>
+
+// Lease-file job queue on a shared directory: several ads_detector workers (possibly on
+// different hosts) pull hour-block jobs without a broker. Every state change is a rename
+// inside the queue root, so each transition has exactly one winner.
+//
+//   pending/<id>.job    waiting; one detector CLI argument per line
+//   leased/<id>.job     claimed; leased/<id>.lease holds "<owner> <expiresEpochMs>"
+//   done/<id>.json      detector output
+//   failed/<id>.job     gave up; failed/<id>.err holds the reason
+//   journal.jsonl       one JSON line per finished job
+namespace job_queue {
+
+struct Job {
+  std::string id;
+  std::vector<std::string> args;
+};
+
+// Creates the queue subdirectories. Throws on I/O failure.
+void init(const std::string& root);
+
+// Writes pending/<id>.job (tmp + rename).
+void enqueue(const std::string& root, const std::string& id, const std::vector<std::string>& args);
+
+// Claims the oldest pending job (by id) for `owner`, or nullopt when none is left.
+std::optional<Job> claim(const std::string& root, const std::string& owner, int leaseSec);
+
+// Extends the lease. Returns false when it was lost (expired and re-queued, or taken by another owner).
+bool renew(const std::string& root, const std::string& id, const std::string& owner, int leaseSec);
+
+// Moves leased jobs whose lease expired back to pending/. Returns how many were re-queued.
+size_t requeueExpired(const std::string& root);
+
+// Temporary path `owner`'s detector writes its output to; complete() publishes it as done/<id>.json.
+// Per owner, so a worker whose lease was lost can never clobber or delete the new owner's output.
+std::string resultTmpPath(const std::string& root, const std::string& id, const std::string& owner);
+
+// Publishes the result, releases the lease and journals the outcome. Returns false (and leaves
+// the queue untouched) when the lease no longer belongs to `owner`.
+bool complete(const std::string& root, const std::string& id, const std::string& owner, int64_t elapsedMs);
+
+// Moves the job to failed/ with `reason`, or back to pending/ when `retry` is set, and journals it.
+bool fail(const std::string& root, const std::string& id, const std::string& owner, int64_t elapsedMs,
+          const std::string& reason, bool retry);
+
+size_t pendingCount(const std::string& root);
+size_t leasedCount(const std::string& root);
+
+}  // namespace job_queue
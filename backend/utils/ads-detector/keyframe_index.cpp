@@ -0,0 +1,342 @@
+#include "keyframe_index.h"
+
+#include "flight_recorder.h"
+#include "http.h"
+#include "result_cache.h"
+
+extern "C" {
+#include <libavcodec/avcodec.h>
+#include <libavformat/avformat.h>
+}
+
+#include <opencv2/videoio.hpp>
+
+#include <unistd.h>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iomanip>
+#include <sstream>
+#include <utility>
+
+namespace fs = std::filesystem;
+
+namespace keyframe_index {
+namespace {
+
+constexpr const char* kFormatTag = "kfi2";
+
+// Same per-request timeout as the other segment fetches.
+constexpr long kFetchTimeoutSec = 20;
+
+bool isHttpUrl(const std::string& url) { return url.rfind("http://", 0) == 0 || url.rfind("https://", 0) == 0; }
+
+// Bytes [offset, offset + length) of a URL or local file; length < 0 reads to the end.
+std::string fetchRange(const std::string& url, int64_t offset, int64_t length) {
+  flight_recorder::IoWait io;
+  if (isHttpUrl(url)) {
+    return (offset <= 0 && length < 0) ? http::get(url, kFetchTimeoutSec)
+                                       : http::getRange(url, std::max<int64_t>(0, offset), length, kFetchTimeoutSec);
+  }
+  std::ifstream in(url, std::ios::binary);
+  if (!in.is_open()) throw std::runtime_error("keyframe index: could not read " + url);
+  in.seekg(0, std::ios::end);
+  const int64_t size = static_cast<int64_t>(in.tellg());
+  const int64_t from = std::min(size, std::max<int64_t>(0, offset));
+  const int64_t n = length < 0 ? size - from : std::min(length, size - from);
+  std::string out(static_cast<size_t>(n), '\0');
+  in.seekg(from);
+  in.read(out.data(), n);
+  return out;
+}
+
+// The segment's bytes inside its resource: [base, base + length).
+int64_t segmentBase(const m3u8::Segment& seg) { return seg.byteRangeLength >= 0 ? seg.byteRangeOffset : 0; }
+
+std::string fetchSegmentBytes(const std::string& url, const m3u8::Segment& seg, int64_t pos, int64_t end) {
+  int64_t length = end >= 0 ? end - pos : -1;
+  if (length < 0 && seg.byteRangeLength >= 0) length = seg.byteRangeLength - pos;
+  return fetchRange(url, segmentBase(seg) + pos, length);
+}
+
+// Read-only AVIOContext over an in-memory buffer.
+struct MemoryInput {
+  const std::string* data = nullptr;
+  int64_t pos = 0;
+
+  static int read(void* opaque, uint8_t* buf, int size) {
+    auto* in = static_cast<MemoryInput*>(opaque);
+    const int64_t left = static_cast<int64_t>(in->data->size()) - in->pos;
+    if (left <= 0) return AVERROR_EOF;
+    const int n = static_cast<int>(std::min<int64_t>(left, size));
+    std::memcpy(buf, in->data->data() + in->pos, static_cast<size_t>(n));
+    in->pos += n;
+    return n;
+  }
+
+  static int64_t seek(void* opaque, int64_t offset, int whence) {
+    auto* in = static_cast<MemoryInput*>(opaque);
+    const int64_t size = static_cast<int64_t>(in->data->size());
+    if (whence & AVSEEK_SIZE) return size;
+    whence &= ~AVSEEK_FORCE;
+    int64_t to = offset;
+    if (whence == SEEK_CUR) to += in->pos;
+    else if (whence == SEEK_END) to += size;
+    else if (whence != SEEK_SET) return -1;
+    if (to < 0 || to > size) return -1;
+    in->pos = to;
+    return to;
+  }
+};
+
+// One demux pass over the segment's bytes; packets are inspected, never decoded. Returns false
+// when the segment could not be demuxed to the end, so the caller does not persist an empty index.
+bool scanSegment(const std::string& bytes, Index::SegmentIndex& out) {
+  out = Index::SegmentIndex();
+  MemoryInput input{&bytes, 0};
+  constexpr int kIoBufferSize = 64 * 1024;
+  auto* ioBuffer = static_cast<unsigned char*>(av_malloc(kIoBufferSize));
+  AVIOContext* avio = ioBuffer ? avio_alloc_context(ioBuffer, kIoBufferSize, 0, &input, &MemoryInput::read, nullptr,
+                                                    &MemoryInput::seek)
+                               : nullptr;
+  AVFormatContext* in = avio ? avformat_alloc_context() : nullptr;
+  if (!in) {
+    if (avio) av_freep(&avio->buffer);
+    else av_freep(&ioBuffer);
+    avio_context_free(&avio);
+    return false;
+  }
+  in->pb = avio;
+  in->flags |= AVFMT_FLAG_CUSTOM_IO;
+  const bool opened = avformat_open_input(&in, nullptr, nullptr, nullptr) >= 0;
+
+  bool ok = false;
+  if (opened) {
+    AVPacket* pkt = av_packet_alloc();
+    int videoIdx = -1;
+    bool haveOrigin = false;
+    double originSec = 0.0;
+    int readRc = 0;
+    int64_t firstPos = -1;
+    long open = -1;  // keyframe whose endPos is the next video packet
+    while (pkt && (readRc = av_read_frame(in, pkt)) >= 0) {
+      // Everything before the earliest packet is table data (MPEG-TS PAT/PMT).
+      if (pkt->pos >= 0 && (firstPos < 0 || pkt->pos < firstPos)) firstPos = pkt->pos;
+      const AVStream* st = in->streams[pkt->stream_index];
+      if (st->codecpar->codec_type == AVMEDIA_TYPE_VIDEO && videoIdx < 0) videoIdx = pkt->stream_index;
+      const int64_t ts = (pkt->pts != AV_NOPTS_VALUE) ? pkt->pts : pkt->dts;
+      if (pkt->stream_index == videoIdx) {
+        if (open >= 0) {
+          out.keyframes[static_cast<size_t>(open)].endPos = pkt->pos;
+          open = -1;
+        }
+        if (ts != AV_NOPTS_VALUE) {
+          // Same origin as the remux stage: the segment's first video timestamp.
+          const double tb = av_q2d(st->time_base);
+          if (!haveOrigin) {
+            originSec = static_cast<double>(pkt->dts != AV_NOPTS_VALUE ? pkt->dts : ts) * tb;
+            haveOrigin = true;
+          }
+          if (pkt->flags & AV_PKT_FLAG_KEY) {
+            out.keyframes.push_back(Keyframe{std::max(0.0, static_cast<double>(ts) * tb - originSec), pkt->pos, -1});
+            open = static_cast<long>(out.keyframes.size()) - 1;
+          }
+        }
+      }
+      av_packet_unref(pkt);
+    }
+    ok = pkt && readRc == AVERROR_EOF && videoIdx >= 0;
+    out.headerLen = std::max<int64_t>(0, firstPos);
+    av_packet_free(&pkt);
+    avformat_close_input(&in);
+  } else {
+    avformat_free_context(in);
+  }
+  av_freep(&avio->buffer);
+  avio_context_free(&avio);
+  std::sort(out.keyframes.begin(), out.keyframes.end(),
+            [](const Keyframe& a, const Keyframe& b) { return a.offsetSec < b.offsetSec; });
+  return ok;
+}
+
+bool readSidecar(const fs::path& path, Index::SegmentIndex& out) {
+  std::ifstream in(path);
+  std::string tag;
+  size_t count = 0;
+  if (!(in >> tag >> count >> out.headerLen) || tag != kFormatTag) return false;
+  out.keyframes.clear();
+  out.keyframes.reserve(count);
+  Keyframe kf;
+  while (out.keyframes.size() < count && (in >> kf.offsetSec >> kf.bytePos >> kf.endPos)) out.keyframes.push_back(kf);
+  return out.keyframes.size() == count;
+}
+
+void writeSidecar(const fs::path& path, const Index::SegmentIndex& index) {
+  std::ostringstream content;
+  content << kFormatTag << " " << index.keyframes.size() << " " << index.headerLen << "\n" << std::setprecision(9);
+  for (const auto& kf : index.keyframes) content << kf.offsetSec << " " << kf.bytePos << " " << kf.endPos << "\n";
+  const fs::path tmp = path.string() + ".tmp" + std::to_string(::getpid());
+  {
+    std::ofstream out(tmp, std::ios::trunc);
+    if (!out.is_open()) return;
+    out << content.str();
+  }
+  std::error_code ec;
+  fs::rename(tmp, path, ec);
+  if (ec) fs::remove(tmp, ec);
+}
+
+// Decodes the first video frame of a self-contained byte string (table header + keyframe packet).
+bool decodeFirstFrame(const std::string& bytes, cv::Mat& bgr) {
+  static std::atomic<uint64_t> counter{0};
+  const fs::path tmp = fs::temp_directory_path() /
+                       ("ads_detector_kf_" + std::to_string(::getpid()) + "_" + std::to_string(counter++) + ".ts");
+  bool ok = false;
+  {
+    std::ofstream f(tmp, std::ios::binary | std::ios::trunc);
+    if (f.is_open()) {
+      f.write(bytes.data(), static_cast<std::streamsize>(bytes.size()));
+      ok = f.good();
+    }
+  }
+  if (ok) {
+    cv::VideoCapture cap(tmp.string());
+    ok = cap.isOpened() && cap.read(bgr) && !bgr.empty();
+  }
+  std::error_code ec;
+  fs::remove(tmp, ec);
+  return ok;
+}
+
+}  // namespace
+
+Index::Index(std::string dir, std::string playlistUrl, const std::vector<m3u8::Segment>& segments, double maxShiftSec)
+    : dir_(std::move(dir)), playlistUrl_(std::move(playlistUrl)), segments_(segments), maxShiftSec_(maxShiftSec) {
+  std::error_code ec;
+  fs::create_directories(dir_, ec);
+}
+
+const Index::SegmentIndex& Index::forSegment(size_t segIndex, std::string* fetched) {
+  {
+    std::lock_guard<std::mutex> lock(mu_);
+    const auto it = bySegment_.find(segIndex);
+    if (it != bySegment_.end()) return it->second;
+  }
+  // Built outside the lock: concurrent builders of one segment just write the same sidecar twice.
+  const auto& seg = segments_[segIndex];
+  const std::string url = m3u8::resolveUri(playlistUrl_, seg.uri);
+  const fs::path path = fs::path(dir_) / (result_cache::key(url + "|" + std::to_string(seg.byteRangeOffset) + "|" +
+                                                            std::to_string(seg.byteRangeLength)) + ".kfi");
+  SegmentIndex index;
+  const bool fromDisk = readSidecar(path, index);
+  // fMP4 needs the init section; never indexed. A failed fetch or scan is only remembered for this
+  // run (reads then fall back to seeking); the next run retries it instead of trusting an empty
+  // sidecar forever.
+  if (!fromDisk && seg.mapUri.empty()) {
+    try {
+      std::string bytes = fetchSegmentBytes(url, seg, 0, -1);
+      if (scanSegment(bytes, index)) writeSidecar(path, index);
+      if (fetched) *fetched = std::move(bytes);
+    } catch (const std::exception&) {
+      index = SegmentIndex();
+    }
+  }
+
+  std::lock_guard<std::mutex> lock(mu_);
+  const auto inserted = bySegment_.emplace(segIndex, std::move(index));
+  if (inserted.second) (fromDisk ? loaded_ : built_)++;
+  return inserted.first->second;
+}
+
+long Index::segmentAt(double tSec) const {
+  if (segments_.empty()) return -1;
+  const auto it = std::upper_bound(segments_.begin(), segments_.end(), tSec,
+                                   [](double t, const m3u8::Segment& s) { return t < s.startOffsetSec; });
+  if (it == segments_.begin()) return -1;
+  return static_cast<long>(std::distance(segments_.begin(), it)) - 1;
+}
+
+double Index::snap(double tSec) {
+  const long segIndex = segmentAt(tSec);
+  if (segIndex < 0) return tSec;
+  const auto& seg = segments_[static_cast<size_t>(segIndex)];
+  const auto& index = forSegment(static_cast<size_t>(segIndex));
+  double best = -1.0;
+  for (const auto& kf : index.keyframes) {
+    const double tl = seg.startOffsetSec + kf.offsetSec;
+    if (tl > tSec) break;
+    best = tl;
+  }
+  return (best >= 0.0 && tSec - best <= maxShiftSec_) ? best : tSec;
+}
+
+std::vector<double> Index::snapAll(const std::vector<double>& times) {
+  std::vector<double> out;
+  out.reserve(times.size());
+  for (const double t : times) out.push_back(snap(t));
+  return out;
+}
+
+bool Index::read(double tSec, cv::Mat& bgr) {
+  const long segIndex = segmentAt(tSec);
+  if (segIndex < 0) return false;
+  const auto& seg = segments_[static_cast<size_t>(segIndex)];
+  std::string whole;
+  const auto& index = forSegment(static_cast<size_t>(segIndex), &whole);
+  const Keyframe* kf = nullptr;
+  for (const auto& k : index.keyframes) {
+    if (std::abs(seg.startOffsetSec + k.offsetSec - tSec) < 1e-3) kf = &k;
+  }
+  if (!kf || kf->bytePos < 0) return false;
+
+  bool ok = false;
+  try {
+    // The keyframe directly after the header is one contiguous range from the segment start.
+    const int64_t from = kf->bytePos <= index.headerLen ? 0 : kf->bytePos;
+    const bool withHeader = from > 0 && index.headerLen > 0;
+    std::string bytes;
+    if (!whole.empty()) {
+      // This call just fetched the whole segment to index it: cut the keyframe out of that.
+      const size_t end = std::min(whole.size(), kf->endPos >= 0 ? static_cast<size_t>(kf->endPos) : whole.size());
+      if (withHeader) bytes = whole.substr(0, static_cast<size_t>(index.headerLen));
+      bytes += whole.substr(static_cast<size_t>(from), end - std::min(end, static_cast<size_t>(from)));
+    } else {
+      const std::string url = m3u8::resolveUri(playlistUrl_, seg.uri);
+      std::string header;
+      if (withHeader) {
+        {
+          std::lock_guard<std::mutex> lock(mu_);
+          const auto it = headers_.find(static_cast<size_t>(segIndex));
+          if (it != headers_.end()) header = it->second;
+        }
+        if (header.empty()) {
+          header = fetchSegmentBytes(url, seg, 0, index.headerLen);
+          std::lock_guard<std::mutex> lock(mu_);
+          headers_.emplace(static_cast<size_t>(segIndex), header);
+        }
+      }
+      bytes = header + fetchSegmentBytes(url, seg, from, kf->endPos);
+    }
+    ok = decodeFirstFrame(bytes, bgr);
+  } catch (const std::exception&) {
+    ok = false;
+  }
+  (ok ? directReads_ : failedReads_)++;
+  return ok;
+}
+
+size_t Index::built() const {
+  std::lock_guard<std::mutex> lock(mu_);
+  return built_;
+}
+
+size_t Index::loaded() const {
+  std::lock_guard<std::mutex> lock(mu_);
+  return loaded_;
+}
+
+}  // namespace keyframe_index
@@ -0,0 +1,75 @@
+#pragma once
+
+#include "m3u8.h"
+
+#include <opencv2/core.hpp>
+
+#include <atomic>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace keyframe_index {
+
+struct Keyframe {
+  double offsetSec = 0.0;  // From the segment's first timestamp
+  int64_t bytePos = -1;    // Byte offset of the keyframe packet inside the segment (-1 = unknown)
+  int64_t endPos = -1;     // Byte offset of the next video packet (-1 = the segment's end)
+};
+
+// Video keyframes of every segment, persisted as one small sidecar file per segment in `dir`
+// and built on first access with a demux-only pass (no decode). An indexed keyframe is decoded
+// straight from its own bytes: the segment's table header plus [bytePos, endPos) are fetched and
+// handed to a fresh decoder, so a read costs one frame instead of a seek that decodes its way
+// through the preceding GOP. Thread-safe.
+class Index {
+ public:
+  // Times move to a keyframe only when one lies within `maxShiftSec` before them, so targets that
+  // are further apart than 2 * maxShiftSec never collapse onto the same keyframe.
+  Index(std::string dir, std::string playlistUrl, const std::vector<m3u8::Segment>& segments, double maxShiftSec);
+
+  // Playlist-timeline position of the last keyframe at or before `tSec` if it is within
+  // maxShiftSec; `tSec` itself otherwise, or when the segment has no usable index (fMP4,
+  // unreadable, no video).
+  double snap(double tSec);
+
+  // snap() applied to each time.
+  std::vector<double> snapAll(const std::vector<double>& times);
+
+  // Decodes the keyframe at `tSec` (a time returned by snap()) from its bytes into `bgr`. Returns
+  // false when `tSec` is not an indexed keyframe or the read fails; the caller then seeks normally.
+  bool read(double tSec, cv::Mat& bgr);
+
+  size_t built() const;   // Sidecars written by this run
+  size_t loaded() const;  // Sidecars reused from earlier runs
+  size_t directReads() const { return directReads_.load(); }  // Frames decoded by read()
+  size_t failedReads() const { return failedReads_.load(); }  // read() calls that fell back
+
+  struct SegmentIndex {
+    int64_t headerLen = 0;  // Bytes before the first packet (MPEG-TS PAT/PMT), prepended to every read
+    std::vector<Keyframe> keyframes;
+  };
+
+ private:
+  // Index of `segIndex`, loaded or built. When this call built it, `fetched` receives the whole
+  // segment it was built from.
+  const SegmentIndex& forSegment(size_t segIndex, std::string* fetched = nullptr);
+  // Segment containing `tSec`, or -1.
+  long segmentAt(double tSec) const;
+
+  std::string dir_;
+  std::string playlistUrl_;
+  const std::vector<m3u8::Segment>& segments_;
+  const double maxShiftSec_;
+  mutable std::mutex mu_;
+  std::unordered_map<size_t, SegmentIndex> bySegment_;
+  std::unordered_map<size_t, std::string> headers_;  // table header bytes per segment, once fetched
+  size_t built_ = 0;
+  size_t loaded_ = 0;
+  std::atomic<size_t> directReads_{0};
+  std::atomic<size_t> failedReads_{0};
+};
+
+}  // namespace keyframe_index
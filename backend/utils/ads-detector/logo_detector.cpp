@@ -1,5 +1,8 @@
 #include "logo_detector.h"
 
+#include "flight_recorder.h"
+#include "trace.h"
+
 #include <opencv2/imgproc.hpp>
 #include <opencv2/imgcodecs.hpp>
 
@@ -12,6 +15,10 @@
 #include <random>
 #include <thread>
 #include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <memory>
 #include <unordered_set>
 #include <mutex>
 #include <stdexcept>
@@ -50,11 +57,15 @@ cv::Rect cornerRect(const cv::Mat& img, int cornerIndex, double roiWidthPct) {
 }
 
 cv::Mat hist512Hsv(const cv::Mat& bgrRoi) {
-  // Downscale ROI to reduce CPU without changing the analyzed region.
+  // Every ROI is resampled to a canonical 64x64, so a histogram model fitted on one rendition
+  // scores any other; downscaling large ROIs also keeps the CPU cost fixed.
+  constexpr int kCanonicalSide = 64;
   cv::Mat roi = bgrRoi;
-  if (roi.cols > 64 || roi.rows > 64) {
+  if (roi.cols != kCanonicalSide || roi.rows != kCanonicalSide) {
     cv::Mat resized;
-    cv::resize(roi, resized, cv::Size(64, 64), 0, 0, cv::INTER_AREA);
+    const bool shrink = roi.cols > kCanonicalSide || roi.rows > kCanonicalSide;
+    cv::resize(roi, resized, cv::Size(kCanonicalSide, kCanonicalSide), 0, 0,
+               shrink ? cv::INTER_AREA : cv::INTER_LINEAR);
     roi = std::move(resized);
   }
   cv::Mat hsv;
@@ -117,6 +128,36 @@ double quantile(std::vector<double> v, double q) {
   return v[idx];
 }
 
+cv::Mat meanHistOf(const cv::Mat& data, const std::vector<int>& idxs) {
+  cv::Mat acc = cv::Mat::zeros(1, 512, CV_32F);
+  for (int r : idxs) acc += data.row(r);
+  acc /= static_cast<float>(std::max<size_t>(1, idxs.size()));
+  return acc;
+}
+
+// Logo seeds of the logo cluster and their mean histogram: the densest part of the cluster by
+// distance-to-mean, which drops "no-logo" frames that kmeans absorbed and makes the seeds more
+// reliable for downstream classifiers (KNN/DBSCAN/thresholding).
+void trimLogoCluster(const cv::Mat& data, const std::vector<int>& logoIdx, std::vector<int>& seeds, cv::Mat& meanHist) {
+  meanHist = meanHistOf(data, logoIdx);
+  std::vector<double> dLogoAll;
+  dLogoAll.reserve(logoIdx.size());
+  for (int r : logoIdx) {
+    dLogoAll.push_back(cv::compareHist(data.row(r), meanHist, cv::HISTCMP_BHATTACHARYYA));
+  }
+  seeds.clear();
+  seeds.reserve(logoIdx.size());
+  const double cut = quantile(dLogoAll, 0.85);
+  for (size_t i = 0; i < logoIdx.size(); i++) {
+    if (dLogoAll[i] <= cut) seeds.push_back(logoIdx[i]);
+  }
+  if (seeds.size() < std::min<size_t>(5, logoIdx.size())) {
+    seeds = logoIdx;  // fallback: avoid collapsing if sample set is too small
+  } else {
+    meanHist = meanHistOf(data, seeds);
+  }
+}
+
 }  // namespace
 
 namespace logo_detector {
@@ -130,23 +171,26 @@ double distanceToLogo(const cv::Mat& bgrFrame,
   return cv::compareHist(h, meanHist, cv::HISTCMP_BHATTACHARYYA);
 }
 
-TrainingOutput train(const std::string& source,
-                     double totalDurationSec,
-                     double roiWidthPct,
-                     int k,
-                     int cornerIndex,
-                     double sampleEverySec,
-                     int threads,
-                     bool captureDebugRois,
-                     const std::function<void(int current, int totalOrNeg1)>& onSample) {
+TrainingOutput collectSamples(const std::string& source,
+                              double totalDurationSec,
+                              double roiWidthPct,
+                              int cornerIndex,
+                              double sampleEverySec,
+                              int threads,
+                              const SampleArtifacts& artifacts,
+                              const std::function<void(int current, int totalOrNeg1)>& onSample,
+                              const std::function<double(double tSec)>& seekTimeOf,
+                              double stallSec,
+                              const std::function<bool(double tSec, cv::Mat& frame)>& readAt) {
   if (totalDurationSec <= 0.0) throw std::runtime_error("totalDurationSec must be > 0");
-  if (k < 2) throw std::runtime_error("k must be >= 2");
   if (cornerIndex < 0 || cornerIndex > 3) throw std::runtime_error("cornerIndex must be 0..3");
   if (roiWidthPct <= 0.0) throw std::runtime_error("roiWidthPct must be > 0");
   if (sampleEverySec <= 0.0) throw std::runtime_error("sampleEverySec must be > 0");
+  if (!artifacts.hist && !artifacts.grayRoi) throw std::runtime_error("collectSamples: no per-sample artifact requested");
 
   TrainingOutput out;
   out.sampleEverySec = sampleEverySec;
+  out.model.cornerIndex = cornerIndex;
 
   // Build target sampling timestamps: 0, every, 2*every, ...
   std::vector<double> times;
@@ -163,6 +207,9 @@ TrainingOutput train(const std::string& source,
     double tSec = 0.0;
     cv::Mat hist;  // 1x512
     std::vector<unsigned char> roiPng;
+    cv::Mat gray;
+    cv::Mat thumb;
+    LumaStats luma;
   };
 
   std::vector<Sample> samples;
@@ -174,6 +221,25 @@ TrainingOutput train(const std::string& source,
   std::mutex samplesMu;
   std::mutex encodeMu;
 
+  // Sampling threads and the work they still own. Held by shared_ptr: a thread abandoned inside a
+  // stalled open/seek/read may outlive this call, and after that only touches its own slot.
+  struct WorkerSlot {
+    std::atomic<int64_t> opStartUs{0};  // 0 idle, > 0 in open/seek/read since, -1 abandoned
+    std::atomic<bool> finished{false};
+    std::deque<int> pending;  // own bucket; guarded by SamplerState::mu
+    int current = -1;         // index being read; guarded by SamplerState::mu
+  };
+  struct SamplerState {
+    std::mutex mu;
+    std::deque<std::unique_ptr<WorkerSlot>> slots;  // stable addresses
+    std::deque<int> orphans;                        // work taken from abandoned threads
+    std::vector<int> stallsPerIndex;
+    int finishedCount = 0;
+    std::condition_variable doneCv;
+  };
+  auto state = std::make_shared<SamplerState>();
+  state->stallsPerIndex.assign(times.size(), 0);
+
   std::vector<std::vector<int>> buckets(threadCount);
   buckets.reserve(threadCount);
   for (int i = 0; i < static_cast<int>(times.size()); i++) {
@@ -182,44 +248,184 @@ TrainingOutput train(const std::string& source,
     buckets[bucket].push_back(i);
   }
 
-  auto worker = [&](const std::vector<int>& idxs) {
+  // Own bucket first, then work reassigned from stalled threads. -1 when both are empty.
+  auto nextIndex = [&state](WorkerSlot* slot) {
+    std::lock_guard<std::mutex> lock(state->mu);
+    int idx = -1;
+    if (!slot->pending.empty()) {
+      idx = slot->pending.front();
+      slot->pending.pop_front();
+    } else if (!state->orphans.empty()) {
+      idx = state->orphans.front();
+      state->orphans.pop_front();
+    }
+    slot->current = idx;
+    return idx;
+  };
+
+  auto worker = [&, state](WorkerSlot* slot) {
+    // Once abandoned (opStartUs == -1) the thread returns without touching anything but `slot`.
+    // Each op is an I/O wait for the flight recorder's stall watchdog.
+    auto beginOp = [slot] {
+      flight_recorder::ioBegin();
+      slot->opStartUs.store(std::max<int64_t>(1, flight_recorder::nowUs()));
+    };
+    auto endOp = [slot] {
+      flight_recorder::ioEnd();
+      return slot->opStartUs.exchange(0) >= 0;
+    };
     try {
-      if (idxs.empty()) return;
-      cv::VideoCapture localCap(source);
-      if (!localCap.isOpened()) throw std::runtime_error("OpenCV could not open m3u8 in worker thread");
-      localCap.set(cv::CAP_PROP_BUFFERSIZE, 1);
-
-      for (int idx : idxs) {
-        const double t = times[static_cast<size_t>(idx)];
-        localCap.set(cv::CAP_PROP_POS_MSEC, t * 1000.0);
+      std::unique_ptr<cv::VideoCapture> localCap;
+      for (int idx = nextIndex(slot); idx >= 0; idx = nextIndex(slot)) {
+        const double t = seekTimeOf ? seekTimeOf(times[static_cast<size_t>(idx)]) : times[static_cast<size_t>(idx)];
+        const int64_t tMs = static_cast<int64_t>(std::llround(t * 1000.0));
+        beginOp();
+        ADS_TRACE2(sample_start, idx, tMs);
         cv::Mat frame;
-        if (!localCap.read(frame) || frame.empty()) continue;
-        cv::Mat h = cornerHist(frame, cornerIndex, roiWidthPct);  // 1x512
+        int64_t seekUs = flight_recorder::nowUs();
+        int64_t readUs = seekUs;
+        bool decoded = readAt && readAt(t, frame) && !frame.empty();
+        if (!decoded) {
+          if (!localCap) {
+            localCap = std::make_unique<cv::VideoCapture>(source);
+            if (!localCap->isOpened()) {
+              if (!endOp()) break;
+              throw std::runtime_error("OpenCV could not open m3u8 in worker thread");
+            }
+            localCap->set(cv::CAP_PROP_BUFFERSIZE, 1);
+          }
+          seekUs = flight_recorder::nowUs();
+          localCap->set(cv::CAP_PROP_POS_MSEC, t * 1000.0);
+          readUs = flight_recorder::nowUs();
+          ADS_TRACE2(seek, idx, tMs);
+          decoded = localCap->read(frame) && !frame.empty();
+        }
+        if (!endOp()) break;
+        flight_recorder::record(flight_recorder::Kind::Seek, idx, tMs, readUs - seekUs);
+        flight_recorder::record(flight_recorder::Kind::Read, idx, decoded ? 1 : 0, flight_recorder::nowUs() - readUs);
+        ADS_TRACE2(decode, idx, decoded ? 1 : 0);
+        if (!decoded) {
+          ADS_TRACE2(sample_end, idx, 0);
+          continue;
+        }
+        cv::Mat h;
+        if (artifacts.hist) h = cornerHist(frame, cornerIndex, roiWidthPct);  // 1x512
         std::vector<unsigned char> png;
-        if (captureDebugRois) {
+        cv::Mat gray;
+        if (artifacts.roiPng || artifacts.grayRoi) {
           const cv::Mat roi = cornerRoi(frame, cornerIndex, roiWidthPct);
-          std::lock_guard<std::mutex> lock(encodeMu);
-          cv::imencode(".png", roi, png);
+          if (artifacts.grayRoi) {
+            cv::cvtColor(roi, gray, cv::COLOR_BGR2GRAY);
+            cv::GaussianBlur(gray, gray, cv::Size(3, 3), 0);
+          }
+          if (artifacts.roiPng) {
+            std::lock_guard<std::mutex> lock(encodeMu);
+            cv::imencode(".png", roi, png);
+          }
         }
+        cv::Mat thumb;
+        if (artifacts.thumbWidth > 0) {
+          const int thumbHeight = std::max(2, static_cast<int>(std::lround(
+                                                  static_cast<double>(artifacts.thumbWidth) * frame.rows / frame.cols)) & ~1);
+          cv::resize(frame, thumb, cv::Size(artifacts.thumbWidth, thumbHeight), 0, 0, cv::INTER_AREA);
+        }
+        LumaStats luma;
+        if (artifacts.lumaStats) luma = roiLumaStats(frame, cornerIndex, roiWidthPct);
+        ADS_TRACE1(features, idx);
         {
           std::lock_guard<std::mutex> lock(samplesMu);
-          samples.push_back(Sample{idx, t, h, std::move(png)});
+          samples.push_back(Sample{idx, t, h, std::move(png), gray, thumb, luma});
         }
+        ADS_TRACE2(sample_end, idx, 1);
         const int done = ++completed;
         if (onSample) onSample(done, static_cast<int>(times.size()));
       }
     } catch (const std::exception& e) {
-      std::lock_guard<std::mutex> lock(errorMu);
-      if (firstError.empty()) firstError = e.what();
+      const int64_t opStartUs = slot->opStartUs.exchange(0);
+      if (opStartUs != 0) flight_recorder::ioEnd();  // Thrown inside an op.
+      if (opStartUs >= 0) {
+        flight_recorder::record(flight_recorder::Kind::Error, 0, 0, 0, e.what());
+        std::lock_guard<std::mutex> lock(errorMu);
+        if (firstError.empty()) firstError = e.what();
+      }
     }
+    {
+      std::lock_guard<std::mutex> lock(state->mu);
+      slot->finished.store(true);
+      state->finishedCount++;
+    }
+    state->doneCv.notify_all();
   };
 
   std::vector<std::thread> pool;
-  pool.reserve(threadCount);
+  auto spawn = [&](std::deque<int> pending) {
+    auto slot = std::make_unique<WorkerSlot>();
+    slot->pending = std::move(pending);
+    WorkerSlot* raw = slot.get();
+    {
+      std::lock_guard<std::mutex> lock(state->mu);
+      state->slots.push_back(std::move(slot));
+    }
+    pool.emplace_back(worker, raw);
+  };
   for (int t = 0; t < threadCount; t++) {
-    pool.emplace_back(worker, std::cref(buckets[t]));
+    if (!buckets[t].empty()) spawn(std::deque<int>(buckets[t].begin(), buckets[t].end()));
+  }
+
+  // Watchdog: a capture stuck in one open/seek/read longer than stallSec is abandoned (its thread
+  // is detached and left blocked). Its current timestamp and the rest of its bucket go to the
+  // orphan queue, which idle threads drain, and a thread with a fresh decoder takes its place.
+  // A timestamp that stalls twice is dropped.
+  const int64_t stallUs = static_cast<int64_t>(stallSec * 1e6);
+  std::vector<bool> abandoned;
+  int seenFinished = 0;
+  for (;;) {
+    {
+      std::unique_lock<std::mutex> lock(state->mu);
+      state->doneCv.wait_for(lock, std::chrono::milliseconds(200),
+                             [&] { return state->finishedCount != seenFinished; });
+      seenFinished = state->finishedCount;
+    }
+    size_t live = 0;
+    const size_t slotCount = pool.size();
+    abandoned.resize(slotCount, false);
+    for (size_t w = 0; w < slotCount; w++) {
+      if (abandoned[w]) continue;
+      WorkerSlot* slot = state->slots[w].get();
+      if (slot->finished.load()) continue;
+      live++;
+      int64_t since = slot->opStartUs.load();
+      if (stallUs <= 0 || since <= 0 || flight_recorder::nowUs() - since < stallUs) continue;
+      if (!slot->opStartUs.compare_exchange_strong(since, -1)) continue;
+
+      abandoned[w] = true;
+      live--;
+      std::deque<int> moved;
+      {
+        std::lock_guard<std::mutex> lock(state->mu);
+        if (slot->current >= 0) {
+          const int stalls = ++state->stallsPerIndex[static_cast<size_t>(slot->current)];
+          if (stalls < 2) moved.push_back(slot->current);
+          else out.droppedSamples++;
+        }
+        moved.insert(moved.end(), slot->pending.begin(), slot->pending.end());
+        slot->pending.clear();
+        state->orphans.insert(state->orphans.end(), moved.begin(), moved.end());
+      }
+      out.stalledReads++;
+      out.reassignedSamples += static_cast<int>(moved.size());
+      flight_recorder::record(flight_recorder::Kind::Note, slot->current, static_cast<int64_t>(moved.size()),
+                              flight_recorder::nowUs() - since, "sampler stalled; work reassigned");
+      spawn({});
+      live++;
+    }
+    if (live == 0) break;
+  }
+  abandoned.resize(pool.size(), false);
+  for (size_t w = 0; w < pool.size(); w++) {
+    if (abandoned[w]) pool[w].detach();
+    else pool[w].join();
   }
-  for (auto& th : pool) th.join();
 
   if (!firstError.empty()) throw std::runtime_error(firstError);
 
@@ -228,79 +434,114 @@ TrainingOutput train(const std::string& source,
   std::sort(samples.begin(), samples.end(), [](const Sample& a, const Sample& b) { return a.index < b.index; });
   out.sampleTimesSec.clear();
   out.sampleTimesSec.reserve(samples.size());
-  cv::Mat data(static_cast<int>(samples.size()), 512, CV_32F, cv::Scalar(0));
-  for (int i = 0; i < static_cast<int>(samples.size()); i++) {
-    out.sampleTimesSec.push_back(samples[static_cast<size_t>(i)].tSec);
-    std::memcpy(data.ptr<float>(i), samples[static_cast<size_t>(i)].hist.ptr<float>(0), sizeof(float) * 512);
+  for (const auto& s : samples) out.sampleTimesSec.push_back(s.tSec);
+  if (artifacts.hist) {
+    cv::Mat data(static_cast<int>(samples.size()), 512, CV_32F, cv::Scalar(0));
+    for (int i = 0; i < static_cast<int>(samples.size()); i++) {
+      std::memcpy(data.ptr<float>(i), samples[static_cast<size_t>(i)].hist.ptr<float>(0), sizeof(float) * 512);
+    }
+    out.sampleHists = data;
   }
-  out.sampleHists = data.clone();
   out.sampleRoiPng.clear();
-  if (captureDebugRois) {
+  if (artifacts.roiPng) {
     out.sampleRoiPng.reserve(samples.size());
-    for (const auto& s : samples) out.sampleRoiPng.push_back(s.roiPng);
+    for (auto& s : samples) out.sampleRoiPng.push_back(std::move(s.roiPng));
+  }
+  if (artifacts.grayRoi) {
+    out.sampleGrayRois.reserve(samples.size());
+    for (const auto& s : samples) out.sampleGrayRois.push_back(s.gray);
   }
+  if (artifacts.thumbWidth > 0) {
+    out.sampleThumbs.reserve(samples.size());
+    for (const auto& s : samples) out.sampleThumbs.push_back(s.thumb);
+  }
+  if (artifacts.lumaStats) {
+    out.sampleLumaStats.reserve(samples.size());
+    for (const auto& s : samples) out.sampleLumaStats.push_back(s.luma);
+  }
+  return out;
+}
 
-  cv::PCA pca(data, cv::Mat(), cv::PCA::DATA_AS_ROW, 2);
+void fitModel(TrainingOutput& out, int k, const std::vector<int>& trainIndices) {
+  if (k < 2) throw std::runtime_error("k must be >= 2");
+  if (out.sampleHists.rows < 5) throw std::runtime_error("could not read enough frames for training");
+  const cv::Mat& data = out.sampleHists;
+  const bool subset = !trainIndices.empty() && static_cast<int>(trainIndices.size()) < data.rows;
+  if (subset && trainIndices.size() < 5) throw std::runtime_error("training subset needs >= 5 samples");
+
+  cv::Mat trainData = data;
+  if (subset) {
+    trainData.create(static_cast<int>(trainIndices.size()), data.cols, CV_32F);
+    for (int r = 0; r < trainData.rows; r++) data.row(trainIndices[static_cast<size_t>(r)]).copyTo(trainData.row(r));
+  }
+
+  cv::PCA pca(trainData, cv::Mat(), cv::PCA::DATA_AS_ROW, 2);
   cv::Mat projected;
   pca.project(data, projected);  // N x 2
   out.pca2d = projected.clone();
   out.pcaModel = pca;
 
-  cv::Mat labels;
-  cv::kmeans(projected,
+  cv::Mat trainProjected = projected;
+  if (subset) {
+    trainProjected.create(trainData.rows, 2, CV_32F);
+    for (int r = 0; r < trainData.rows; r++) {
+      projected.row(trainIndices[static_cast<size_t>(r)]).copyTo(trainProjected.row(r));
+    }
+  }
+
+  cv::Mat trainLabels;
+  cv::Mat centers;
+  cv::kmeans(trainProjected,
              k,
-             labels,
+             trainLabels,
              cv::TermCriteria(cv::TermCriteria::EPS + cv::TermCriteria::COUNT, 40, 1e-4),
              5,
-             cv::KMEANS_PP_CENTERS);
+             cv::KMEANS_PP_CENTERS,
+             centers);
+
+  // Labels for every sample; outside the training subset, the nearest center.
+  std::vector<int> labels(static_cast<size_t>(data.rows), 0);
+  std::vector<char> isTrain(static_cast<size_t>(data.rows), subset ? 0 : 1);
+  if (subset) {
+    for (int r = 0; r < data.rows; r++) {
+      const float* p = projected.ptr<float>(r);
+      double best = std::numeric_limits<double>::max();
+      for (int c = 0; c < centers.rows; c++) {
+        const float* q = centers.ptr<float>(c);
+        const double d = (p[0] - q[0]) * (p[0] - q[0]) + (p[1] - q[1]) * (p[1] - q[1]);
+        if (d < best) { best = d; labels[static_cast<size_t>(r)] = c; }
+      }
+    }
+    for (int r = 0; r < trainLabels.rows; r++) {
+      const size_t idx = static_cast<size_t>(trainIndices[static_cast<size_t>(r)]);
+      labels[idx] = trainLabels.at<int>(r, 0);
+      isTrain[idx] = 1;
+    }
+  } else {
+    for (int r = 0; r < data.rows; r++) labels[static_cast<size_t>(r)] = trainLabels.at<int>(r, 0);
+  }
 
   std::vector<int> counts(k, 0);
-  for (int r = 0; r < labels.rows; r++) counts[labels.at<int>(r, 0)]++;
+  for (int r = 0; r < trainLabels.rows; r++) counts[trainLabels.at<int>(r, 0)]++;
   const int logoCluster =
       static_cast<int>(std::distance(counts.begin(), std::max_element(counts.begin(), counts.end())));
   out.logoClusterLabel = logoCluster;
-  out.kmeansLabels.clear();
-  out.kmeansLabels.reserve(labels.rows);
-  for (int r = 0; r < labels.rows; r++) out.kmeansLabels.push_back(labels.at<int>(r, 0));
+  out.kmeansLabels = labels;
 
   std::vector<int> logoIdx;
   std::vector<int> nonLogoIdx;
-  for (int r = 0; r < labels.rows; r++) {
-    if (labels.at<int>(r, 0) == logoCluster)
+  for (int r = 0; r < data.rows; r++) {
+    if (!isTrain[static_cast<size_t>(r)]) continue;
+    if (labels[static_cast<size_t>(r)] == logoCluster)
       logoIdx.push_back(r);
     else
       nonLogoIdx.push_back(r);
   }
 
-  // Compute a stable meanHist for the logo cluster.
-  // Then filter out intra-cluster outliers (often "no-logo" frames that kmeans absorbed).
-  auto computeMeanHist = [&](const std::vector<int>& idxs) -> cv::Mat {
-    cv::Mat acc = cv::Mat::zeros(1, 512, CV_32F);
-    for (int r : idxs) acc += data.row(r);
-    acc /= static_cast<float>(std::max<size_t>(1, idxs.size()));
-    return acc;
-  };
-
-  cv::Mat meanHist = computeMeanHist(logoIdx);
-  std::vector<double> dLogoAll;
-  dLogoAll.reserve(logoIdx.size());
-  for (int r : logoIdx) {
-    dLogoAll.push_back(cv::compareHist(data.row(r), meanHist, cv::HISTCMP_BHATTACHARYYA));
-  }
-
-  // Keep the densest part of the logo cluster by distance-to-mean.
-  // This makes "logo seeds" more reliable for downstream classifiers (KNN/DBSCAN/thresholding).
+  // Stable meanHist for the logo cluster, without its intra-cluster outliers.
   std::vector<int> logoSeeds;
-  logoSeeds.reserve(logoIdx.size());
-  const double cut = quantile(dLogoAll, 0.85);
-  for (size_t i = 0; i < logoIdx.size(); i++) {
-    if (dLogoAll[i] <= cut) logoSeeds.push_back(logoIdx[i]);
-  }
-  if (logoSeeds.size() < std::min<size_t>(5, logoIdx.size())) {
-    logoSeeds = logoIdx;  // fallback: avoid collapsing if sample set is too small
-  } else {
-    meanHist = computeMeanHist(logoSeeds);
-  }
+  cv::Mat meanHist;
+  trimLogoCluster(data, logoIdx, logoSeeds, meanHist);
 
   // Final distance sets.
   std::vector<double> dLogo;
@@ -326,10 +567,107 @@ TrainingOutput train(const std::string& source,
   }
   threshold = std::clamp(threshold, 0.05, 0.95);
 
-  out.model.cornerIndex = cornerIndex;
   out.model.meanHist = meanHist;
   out.model.threshold = threshold;
   out.model.logoSampleIndices = logoSeeds;
+}
+
+std::vector<int> progressiveOrder(int n) {
+  std::vector<int> order;
+  if (n <= 0) return order;
+  order.reserve(static_cast<size_t>(n));
+  int bits = 0;
+  while ((1 << bits) < n) bits++;
+  for (int i = 0; i < (1 << bits); i++) {
+    int rev = 0;
+    for (int b = 0; b < bits; b++) {
+      if (i & (1 << b)) rev |= 1 << (bits - 1 - b);
+    }
+    if (rev < n) order.push_back(rev);
+  }
+  return order;
+}
+
+std::vector<int> convergeTrainingSet(const TrainingOutput& training, int k, double tolerance) {
+  const int n = training.sampleHists.rows;
+  std::vector<int> all(static_cast<size_t>(std::max(0, n)));
+  for (int i = 0; i < n; i++) all[static_cast<size_t>(i)] = i;
+  if (tolerance <= 0.0) return all;
+
+  const std::vector<int> order = progressiveOrder(n);
+  int used = std::min(n, std::max(24, 4 * k));
+  if (used >= n) return all;
+
+  // The PCA basis is fitted once, on the first (evenly spread) prefix, and every sample projected
+  // with it; each larger prefix then only re-runs KMeans, warm-started from the previous centers.
+  cv::Mat firstPrefix(used, training.sampleHists.cols, CV_32F);
+  for (int r = 0; r < used; r++) training.sampleHists.row(order[static_cast<size_t>(r)]).copyTo(firstPrefix.row(r));
+  const cv::PCA pca(firstPrefix, cv::Mat(), cv::PCA::DATA_AS_ROW, 2);
+  cv::Mat projected;
+  pca.project(training.sampleHists, projected);  // N x 2
+
+  const cv::TermCriteria criteria(cv::TermCriteria::EPS + cv::TermCriteria::COUNT, 40, 1e-4);
+  cv::Mat centers;
+  cv::Mat prevMean;
+  while (used < n) {
+    cv::Mat points(used, 2, CV_32F);
+    for (int r = 0; r < used; r++) projected.row(order[static_cast<size_t>(r)]).copyTo(points.row(r));
+    cv::Mat labels;
+    if (centers.empty()) {
+      cv::kmeans(points, k, labels, criteria, 5, cv::KMEANS_PP_CENTERS, centers);
+    } else {
+      labels.create(used, 1, CV_32S);
+      for (int r = 0; r < used; r++) {
+        const float* p = points.ptr<float>(r);
+        double best = std::numeric_limits<double>::max();
+        for (int c = 0; c < centers.rows; c++) {
+          const float* q = centers.ptr<float>(c);
+          const double d = (p[0] - q[0]) * (p[0] - q[0]) + (p[1] - q[1]) * (p[1] - q[1]);
+          if (d < best) { best = d; labels.at<int>(r, 0) = c; }
+        }
+      }
+      cv::kmeans(points, k, labels, criteria, 1, cv::KMEANS_USE_INITIAL_LABELS, centers);
+    }
+
+    // Same logo-cluster rule as fitModel(): the largest cluster, trimmed to its densest part.
+    std::vector<int> counts(static_cast<size_t>(k), 0);
+    for (int r = 0; r < used; r++) counts[static_cast<size_t>(labels.at<int>(r, 0))]++;
+    const int logoCluster =
+        static_cast<int>(std::distance(counts.begin(), std::max_element(counts.begin(), counts.end())));
+    std::vector<int> logoIdx;
+    for (int r = 0; r < used; r++) {
+      if (labels.at<int>(r, 0) == logoCluster) logoIdx.push_back(order[static_cast<size_t>(r)]);
+    }
+    std::vector<int> seeds;
+    cv::Mat meanHist;
+    trimLogoCluster(training.sampleHists, logoIdx, seeds, meanHist);
+
+    if (!prevMean.empty() && cv::compareHist(meanHist, prevMean, cv::HISTCMP_BHATTACHARYYA) < tolerance) {
+      std::vector<int> picked(order.begin(), order.begin() + used);
+      std::sort(picked.begin(), picked.end());
+      return picked;
+    }
+    prevMean = meanHist;
+    used = std::min(n, used + std::max(8, used / 2));
+  }
+  return all;
+}
+
+TrainingOutput train(const std::string& source,
+                     double totalDurationSec,
+                     double roiWidthPct,
+                     int k,
+                     int cornerIndex,
+                     double sampleEverySec,
+                     int threads,
+                     bool captureDebugRois,
+                     const std::function<void(int current, int totalOrNeg1)>& onSample) {
+  if (k < 2) throw std::runtime_error("k must be >= 2");
+  SampleArtifacts artifacts;
+  artifacts.roiPng = captureDebugRois;
+  TrainingOutput out =
+      collectSamples(source, totalDurationSec, roiWidthPct, cornerIndex, sampleEverySec, threads, artifacts, onSample);
+  fitModel(out, k);
   return out;
 }
 
@@ -339,5 +677,20 @@ cv::Mat extractHistogram(const cv::Mat& bgrFrame,
   return cornerHist(bgrFrame, cornerIndex, roiWidthPct);
 }
 
+LumaStats lumaStats(const cv::Mat& gray) {
+  cv::Scalar mean;
+  cv::Scalar stddev;
+  cv::meanStdDev(gray, mean, stddev);
+  return LumaStats{mean[0], stddev[0]};
+}
+
+LumaStats roiLumaStats(const cv::Mat& bgrFrame,
+                       int cornerIndex,
+                       double roiWidthPct) {
+  cv::Mat gray;
+  cv::cvtColor(bgrFrame(cornerRect(bgrFrame, cornerIndex, roiWidthPct)), gray, cv::COLOR_BGR2GRAY);
+  return lumaStats(gray);
+}
+
 }  // namespace logo_detector
 
@@ -16,18 +16,72 @@ struct LogoModel {
   std::vector<int> logoSampleIndices;
 };
 
+// Luma mean and standard deviation of a region (stage one of the classifier cascade).
+struct LumaStats {
+  double mean = 0.0;
+  double stddev = 0.0;
+};
+
+// Per-sample artifacts collectSamples() gathers; each classifier asks only for what it reads.
+struct SampleArtifacts {
+  bool hist = true;      // HSV histogram (Bhattacharyya, outlier modes, fitModel)
+  bool grayRoi = false;  // Blurred gray ROI (Tokayo)
+  bool roiPng = false;   // PNG-encoded ROI (debug export)
+  int thumbWidth = 0;    // Whole frame downscaled to this width (timeline sprites); 0 = none
+  bool lumaStats = false;  // Luma mean/stddev of the ROI (classifier cascade)
+};
+
 struct TrainingOutput {
   LogoModel model;
   double sampleEverySec = 5.0;
   std::vector<double> sampleTimesSec;  // Sampled timestamps (seconds)
   cv::Mat sampleHists;                 // N x 512 (CV_32F), ROI histogram per sample
   std::vector<std::vector<unsigned char>> sampleRoiPng;  // N (optional, debug)
+  std::vector<cv::Mat> sampleGrayRois;  // N (optional) CV_8UC1, 3x3 Gaussian-blurred
+  std::vector<cv::Mat> sampleThumbs;    // N (optional) CV_8UC3, SampleArtifacts::thumbWidth wide
+  std::vector<LumaStats> sampleLumaStats;  // N (optional), unblurred ROI luma
+  int stalledReads = 0;                // Captures abandoned by the sampling watchdog
+  int reassignedSamples = 0;           // Timestamps moved from abandoned captures to other threads
+  int droppedSamples = 0;              // Timestamps skipped after stalling twice
   cv::Mat pca2d;                       // N x 2 (CV_32F)
   cv::PCA pcaModel;                    // PCA model for projecting new histograms
   std::vector<int> kmeansLabels;       // N
   int logoClusterLabel = 0;
 };
 
+// Samples the corner ROI every sampleEverySec, computing only the requested artifacts.
+// `seekTimeOf` may move each target to the time actually read (e.g. the preceding keyframe);
+// sampleTimesSec records the moved times. Only the sample fields of TrainingOutput are filled.
+// With `stallSec` > 0, a capture blocked in one open/seek/read for longer is abandoned and its
+// remaining timestamps are handed to idle threads and a fresh decoder. `readAt`, if set, is tried
+// first for each (moved) time and decodes it without the capture; false falls back to a seek.
+TrainingOutput collectSamples(const std::string& source,
+                              double totalDurationSec,
+                              double roiWidthPct,
+                              int cornerIndex,
+                              double sampleEverySec,
+                              int threads,
+                              const SampleArtifacts& artifacts,
+                              const std::function<void(int current, int totalOrNeg1)>& onSample = {},
+                              const std::function<double(double tSec)>& seekTimeOf = {},
+                              double stallSec = 0.0,
+                              const std::function<bool(double tSec, cv::Mat& frame)>& readAt = {});
+
+// Fits PCA + KMeans on the collected samples and derives logo seeds, meanHist and threshold.
+// With `trainIndices` only those samples are fitted; the others are projected and labelled
+// by nearest cluster but never become seeds or shape the threshold.
+void fitModel(TrainingOutput& training, int k, const std::vector<int>& trainIndices = {});
+
+// Bit-reversal order of 0..n-1: every prefix is spread evenly across the sampled window.
+std::vector<int> progressiveOrder(int n);
+
+// Grows a training set in progressiveOrder(), re-deriving the logo mean histogram each step, and
+// stops once it moves less than `tolerance` (Bhattacharyya distance) between steps. PCA is fitted
+// once on the first prefix; later steps warm-start KMeans from the previous step's centers.
+// Returns the sorted sample indices to train on (all samples if it never converged).
+std::vector<int> convergeTrainingSet(const TrainingOutput& training, int k, double tolerance);
+
+// collectSamples() + fitModel().
 TrainingOutput train(const std::string& source,
                      double totalDurationSec,
                      double roiWidthPct,
@@ -47,5 +101,13 @@ cv::Mat extractHistogram(const cv::Mat& bgrFrame,
                          int cornerIndex,
                          double roiWidthPct);
 
+// Mean/stddev of a single-channel image.
+LumaStats lumaStats(const cv::Mat& gray);
+
+// Mean/stddev of the corner ROI's luma (no blur): one color conversion of the ROI, no resize.
+LumaStats roiLumaStats(const cv::Mat& bgrFrame,
+                       int cornerIndex,
+                       double roiWidthPct);
+
 }  // namespace logo_detector
 
@@ -1,7 +1,13 @@
 #include "m3u8.h"
 
+#include "time_util.h"
+
+#include <algorithm>
+#include <cmath>
+#include <iomanip>
 #include <sstream>
 #include <string>
+#include <unordered_map>
 #include <vector>
 
 namespace {
@@ -20,17 +26,57 @@ static inline bool startsWith(const std::string& s, const char* prefix) {
   return s.rfind(p, 0) == 0;
 }
 
+// Reads NAME=value or NAME="value" from an attribute list (e.g. EXT-X-MAP:URI="init.mp4").
+static std::string attrValue(const std::string& line, const std::string& name) {
+  size_t pos = 0;
+  while ((pos = line.find(name + "=", pos)) != std::string::npos) {
+    const char prev = pos > 0 ? line[pos - 1] : ':';
+    if (prev != ':' && prev != ',') {
+      pos += name.size();
+      continue;
+    }
+    size_t i = pos + name.size() + 1;
+    if (i < line.size() && line[i] == '"') {
+      const size_t end = line.find('"', i + 1);
+      return line.substr(i + 1, end == std::string::npos ? std::string::npos : end - i - 1);
+    }
+    const size_t end = line.find(',', i);
+    return trim(line.substr(i, end == std::string::npos ? std::string::npos : end - i));
+  }
+  return "";
+}
+
+static std::string formatDuration(double sec) {
+  std::ostringstream out;
+  out << std::fixed << std::setprecision(3) << sec;
+  return out.str();
+}
+
 }  // namespace
 
 namespace m3u8 {
 
 std::vector<Segment> parse(const std::string& playlistContent) {
-  std::vector<Segment> segments;
+  return parsePlaylist(playlistContent).segments;
+}
+
+Playlist parsePlaylist(const std::string& playlistContent) {
+  Playlist playlist;
+  auto& segments = playlist.segments;
   std::istringstream in(playlistContent);
 
   std::string currentPdt;
   double currentDur = 0.0;
   bool haveDur = false;
+  std::string currentMap;
+  bool pendingDiscontinuity = false;
+  int64_t pendingRangeLen = -1;
+  int64_t pendingRangeOff = -1;
+  std::string lastRangeUri;
+  int64_t lastRangeEnd = 0;
+  int nextPartIndex = 0;
+  std::string lastPartUri;
+  int64_t lastPartEnd = 0;
 
   std::string line;
   while (std::getline(in, line)) {
@@ -59,14 +105,135 @@ std::vector<Segment> parse(const std::string& playlistContent) {
       continue;
     }
 
+    if (startsWith(line, "#EXT-X-BYTERANGE:")) {
+      const auto payload = trim(line.substr(std::string("#EXT-X-BYTERANGE:").size()));
+      const auto atPos = payload.find('@');
+      try {
+        pendingRangeLen = std::stoll(payload.substr(0, atPos));
+        pendingRangeOff = (atPos == std::string::npos) ? -1 : std::stoll(payload.substr(atPos + 1));
+      } catch (...) {
+        pendingRangeLen = -1;
+        pendingRangeOff = -1;
+      }
+      continue;
+    }
+
+    if (startsWith(line, "#EXT-X-MAP:")) {
+      currentMap = attrValue(line, "URI");
+      continue;
+    }
+
+    if (line == "#EXT-X-DISCONTINUITY") {
+      pendingDiscontinuity = true;
+      continue;
+    }
+
+    if (startsWith(line, "#EXT-X-MEDIA-SEQUENCE:")) {
+      try {
+        playlist.mediaSequence = std::stoll(trim(line.substr(std::string("#EXT-X-MEDIA-SEQUENCE:").size())));
+      } catch (...) {
+      }
+      continue;
+    }
+
+    if (startsWith(line, "#EXT-X-TARGETDURATION:")) {
+      try {
+        playlist.targetDurationSec = std::stod(trim(line.substr(std::string("#EXT-X-TARGETDURATION:").size())));
+      } catch (...) {
+      }
+      continue;
+    }
+
+    if (startsWith(line, "#EXT-X-PART-INF:")) {
+      try {
+        playlist.partTargetSec = std::stod(attrValue(line, "PART-TARGET"));
+      } catch (...) {
+      }
+      continue;
+    }
+
+    if (startsWith(line, "#EXT-X-SERVER-CONTROL:")) {
+      playlist.canBlockReload = (attrValue(line, "CAN-BLOCK-RELOAD") == "YES");
+      continue;
+    }
+
+    if (line == "#EXT-X-ENDLIST") {
+      playlist.endList = true;
+      continue;
+    }
+
+    if (startsWith(line, "#EXT-X-PART:")) {
+      Part part;
+      part.uri = attrValue(line, "URI");
+      if (part.uri.empty()) continue;
+      try {
+        part.durationSec = std::stod(attrValue(line, "DURATION"));
+      } catch (...) {
+        continue;
+      }
+      // Parts listed before a segment's URI line belong to that segment.
+      part.mediaSequence = playlist.mediaSequence + static_cast<int64_t>(segments.size());
+      part.partIndex = nextPartIndex++;
+      part.independent = (attrValue(line, "INDEPENDENT") == "YES");
+      part.gap = (attrValue(line, "GAP") == "YES");
+      const std::string range = attrValue(line, "BYTERANGE");
+      if (!range.empty()) {
+        const auto atPos = range.find('@');
+        try {
+          part.byteRangeLength = std::stoll(range.substr(0, atPos));
+          part.byteRangeOffset = (atPos == std::string::npos)
+                                     ? (lastPartUri == part.uri ? lastPartEnd : 0)
+                                     : std::stoll(range.substr(atPos + 1));
+          lastPartUri = part.uri;
+          lastPartEnd = part.byteRangeOffset + part.byteRangeLength;
+        } catch (...) {
+          part.byteRangeLength = -1;
+          part.byteRangeOffset = -1;
+        }
+      }
+      playlist.parts.push_back(std::move(part));
+      continue;
+    }
+
+    if (startsWith(line, "#EXT-X-PRELOAD-HINT:")) {
+      PreloadHint hint;
+      hint.type = attrValue(line, "TYPE");
+      hint.uri = attrValue(line, "URI");
+      try {
+        const std::string start = attrValue(line, "BYTERANGE-START");
+        const std::string length = attrValue(line, "BYTERANGE-LENGTH");
+        if (!start.empty()) hint.byteRangeStart = std::stoll(start);
+        if (!length.empty()) hint.byteRangeLength = std::stoll(length);
+      } catch (...) {
+        hint.byteRangeStart = -1;
+        hint.byteRangeLength = -1;
+      }
+      if (!hint.uri.empty()) playlist.preloadHint = hint;
+      continue;
+    }
+
     if (!line.empty() && line[0] != '#') {
       if (!haveDur) continue;
       Segment seg;
       seg.uri = line;
       seg.durationSec = currentDur;
       seg.programDateTime = currentPdt;
+      seg.mapUri = currentMap;
+      seg.discontinuity = pendingDiscontinuity;
+      if (pendingRangeLen >= 0) {
+        // Without an explicit offset the range continues where the previous one of the same URI ended.
+        const int64_t off = (pendingRangeOff >= 0) ? pendingRangeOff : (lastRangeUri == line ? lastRangeEnd : 0);
+        seg.byteRangeLength = pendingRangeLen;
+        seg.byteRangeOffset = off;
+        lastRangeUri = line;
+        lastRangeEnd = off + pendingRangeLen;
+      }
       segments.push_back(seg);
+      nextPartIndex = 0;
       haveDur = false;
+      pendingDiscontinuity = false;
+      pendingRangeLen = -1;
+      pendingRangeOff = -1;
       continue;
     }
   }
@@ -77,7 +244,7 @@ std::vector<Segment> parse(const std::string& playlistContent) {
     offset += s.durationSec;
     s.endOffsetSec = offset;
   }
-  return segments;
+  return playlist;
 }
 
 double totalDuration(const std::vector<Segment>& segments) {
@@ -85,5 +252,108 @@ double totalDuration(const std::vector<Segment>& segments) {
   return segments.back().endOffsetSec;
 }
 
+std::string resolveUri(const std::string& playlistUrl, const std::string& uri) {
+  if (uri.find("://") != std::string::npos) return uri;
+  const bool isHttp = startsWith(playlistUrl, "http://") || startsWith(playlistUrl, "https://");
+  // Strip the playlist's own query string before looking for the directory part.
+  const std::string base = playlistUrl.substr(0, playlistUrl.find('?'));
+  if (!uri.empty() && uri[0] == '/') {
+    if (!isHttp) return uri;
+    const size_t hostEnd = base.find('/', base.find("://") + 3);
+    return (hostEnd == std::string::npos ? base : base.substr(0, hostEnd)) + uri;
+  }
+  const size_t slash = base.rfind('/');
+  if (slash == std::string::npos) return uri;
+  return base.substr(0, slash + 1) + uri;
+}
+
+std::string blockingReloadUrl(const std::string& playlistUrl, int64_t mediaSequence, int partIndex) {
+  std::string url = playlistUrl;
+  url += (url.find('?') == std::string::npos) ? '?' : '&';
+  url += "_HLS_msn=" + std::to_string(mediaSequence);
+  if (partIndex >= 0) url += "&_HLS_part=" + std::to_string(partIndex);
+  return url;
+}
+
+VodPlaylist buildVod(const std::vector<Segment>& segments,
+                     const std::vector<TimeRange>& removed,
+                     const std::string& playlistUrl) {
+  VodPlaylist out;
+
+  std::vector<char> keep(segments.size(), 1);
+  double targetDuration = 1.0;
+  bool anyByteRange = false;
+  for (size_t i = 0; i < segments.size(); i++) {
+    const auto& seg = segments[i];
+    double overlap = 0.0;
+    for (const auto& r : removed) {
+      const double a = std::max(seg.startOffsetSec, r.startSec);
+      const double b = std::min(seg.endOffsetSec, r.endSec);
+      if (b > a) overlap += b - a;
+    }
+    if (overlap * 2.0 > seg.durationSec) {
+      keep[i] = 0;
+      out.removedSegments++;
+      continue;
+    }
+    out.keptSegments++;
+    out.keptDurationSec += seg.durationSec;
+    targetDuration = std::max(targetDuration, seg.durationSec);
+    if (seg.byteRangeLength >= 0) anyByteRange = true;
+  }
+
+  std::ostringstream m3u;
+  m3u << "#EXTM3U\n";
+  m3u << "#EXT-X-VERSION:" << (anyByteRange ? 4 : 3) << "\n";
+  m3u << "#EXT-X-PLAYLIST-TYPE:VOD\n";
+  m3u << "#EXT-X-TARGETDURATION:" << static_cast<int>(std::ceil(targetDuration)) << "\n";
+  m3u << "#EXT-X-MEDIA-SEQUENCE:0\n";
+
+  // PDT tags are sticky in the parser: segments without their own tag inherit the last one.
+  // Re-anchor on the first segment that carried each value so cuts get an accurate PDT.
+  std::unordered_map<std::string, double> pdtAnchorSec;
+  for (const auto& seg : segments) {
+    if (!seg.programDateTime.empty()) pdtAnchorSec.emplace(seg.programDateTime, seg.startOffsetSec);
+  }
+
+  bool first = true;
+  bool gap = false;
+  std::string lastMap;
+  for (size_t i = 0; i < segments.size(); i++) {
+    const auto& seg = segments[i];
+    if (!keep[i]) {
+      gap = true;
+      continue;
+    }
+    const bool cut = !first && (gap || seg.discontinuity);
+    if (cut) m3u << "#EXT-X-DISCONTINUITY\n";
+    if (!seg.mapUri.empty() && (first || cut || seg.mapUri != lastMap)) {
+      m3u << "#EXT-X-MAP:URI=\"" << resolveUri(playlistUrl, seg.mapUri) << "\"\n";
+      lastMap = seg.mapUri;
+    }
+    if ((first || cut) && !seg.programDateTime.empty()) {
+      int64_t epochMs = 0;
+      if (time_util::parseIso8601LikeToEpochMs(seg.programDateTime, &epochMs)) {
+        const double sinceAnchor = seg.startOffsetSec - pdtAnchorSec[seg.programDateTime];
+        epochMs += static_cast<int64_t>(std::llround(sinceAnchor * 1000.0));
+        m3u << "#EXT-X-PROGRAM-DATE-TIME:" << time_util::epochMsToIso8601Utc(epochMs) << "\n";
+      } else {
+        m3u << "#EXT-X-PROGRAM-DATE-TIME:" << seg.programDateTime << "\n";
+      }
+    }
+    m3u << "#EXTINF:" << formatDuration(seg.durationSec) << ",\n";
+    if (seg.byteRangeLength >= 0) {
+      m3u << "#EXT-X-BYTERANGE:" << seg.byteRangeLength << "@" << seg.byteRangeOffset << "\n";
+    }
+    m3u << resolveUri(playlistUrl, seg.uri) << "\n";
+    first = false;
+    gap = false;
+  }
+  m3u << "#EXT-X-ENDLIST\n";
+
+  out.content = m3u.str();
+  return out;
+}
+
 }  // namespace m3u8
 
@@ -1,5 +1,6 @@
 #pragma once
 
+#include <cstdint>
 #include <string>
 #include <vector>
 
@@ -11,10 +12,74 @@ struct Segment {
   std::string programDateTime;  // Raw string after EXT-X-PROGRAM-DATE-TIME:
   double startOffsetSec = 0.0;
   double endOffsetSec = 0.0;
+  int64_t byteRangeLength = -1;  // EXT-X-BYTERANGE length (-1 = whole resource)
+  int64_t byteRangeOffset = -1;  // EXT-X-BYTERANGE offset (resolved, -1 = whole resource)
+  std::string mapUri;            // EXT-X-MAP URI in effect for this segment (fMP4)
+  bool discontinuity = false;    // EXT-X-DISCONTINUITY precedes this segment
+};
+
+// LL-HLS partial segment (EXT-X-PART).
+struct Part {
+  std::string uri;
+  double durationSec = 0.0;
+  int64_t mediaSequence = 0;     // Parent segment's media sequence number
+  int partIndex = 0;             // Index within the parent segment
+  bool independent = false;      // INDEPENDENT=YES: starts with a keyframe
+  bool gap = false;              // GAP=YES: not available
+  int64_t byteRangeLength = -1;  // BYTERANGE length (-1 = whole resource)
+  int64_t byteRangeOffset = -1;  // BYTERANGE offset (resolved, -1 = whole resource)
+};
+
+// EXT-X-PRELOAD-HINT: the next part/map the server will publish.
+struct PreloadHint {
+  std::string type;              // PART | MAP (empty = no hint)
+  std::string uri;
+  int64_t byteRangeStart = -1;   // -1 = whole resource
+  int64_t byteRangeLength = -1;  // -1 = until the end of the resource
+};
+
+struct Playlist {
+  std::vector<Segment> segments;
+  std::vector<Part> parts;       // All advertised parts, in playlist order
+  PreloadHint preloadHint;
+  int64_t mediaSequence = 0;     // EXT-X-MEDIA-SEQUENCE (media sequence of segments[0])
+  double targetDurationSec = 0.0;
+  double partTargetSec = 0.0;    // EXT-X-PART-INF:PART-TARGET (0 = not low-latency)
+  bool canBlockReload = false;   // EXT-X-SERVER-CONTROL:CAN-BLOCK-RELOAD=YES
+  bool endList = false;
+
+  // Media sequence of the segment that follows the last complete one.
+  int64_t nextMediaSequence() const { return mediaSequence + static_cast<int64_t>(segments.size()); }
+};
+
+struct TimeRange {
+  double startSec = 0.0;
+  double endSec = 0.0;
+};
+
+struct VodPlaylist {
+  std::string content;
+  size_t keptSegments = 0;
+  size_t removedSegments = 0;
+  double keptDurationSec = 0.0;
 };
 
 std::vector<Segment> parse(const std::string& playlistContent);
+Playlist parsePlaylist(const std::string& playlistContent);
 double totalDuration(const std::vector<Segment>& segments);
 
-}  // namespace m3u8
+// Resolves a (possibly relative) segment URI against the playlist URL or local path.
+std::string resolveUri(const std::string& playlistUrl, const std::string& uri);
+
+// Blocking playlist reload URL (_HLS_msn/_HLS_part); partIndex < 0 omits _HLS_part.
+std::string blockingReloadUrl(const std::string& playlistUrl, int64_t mediaSequence, int partIndex);
 
+// Builds a VOD playlist with the segments covered by `removed` dropped.
+// A segment is dropped when more than half of it overlaps a removed range; each cut
+// gets an EXT-X-DISCONTINUITY. Source byte ranges are preserved so byte-addressed
+// playlists keep their sub-segment granularity at the boundaries.
+VodPlaylist buildVod(const std::vector<Segment>& segments,
+                     const std::vector<TimeRange>& removed,
+                     const std::string& playlistUrl);
+
+}  // namespace m3u8
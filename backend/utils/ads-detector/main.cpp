@@ -1,8 +1,18 @@
+#include "flight_recorder.h"
 #include "http.h"
+#include "job_queue.h"
 #include "json_util.h"
+#include "keyframe_index.h"
 #include "logo_detector.h"
 #include "m3u8.h"
+#include "model_registry.h"
+#include "progress_reporter.h"
+#include "remux.h"
+#include "result_cache.h"
+#include "seed_index.h"
+#include "sprite_sheet.h"
 #include "time_util.h"
+#include "trace.h"
 
 #include <opencv2/imgcodecs.hpp>
 #include <opencv2/imgproc/imgproc.hpp>
@@ -10,13 +20,19 @@
 
 #include <algorithm>
 #include <chrono>
+#include <cerrno>
 #include <cmath>
+#include <condition_variable>
+#include <csignal>
 #include <cstdlib>
+#include <deque>
 #include <filesystem>
 #include <fstream>
+#include <functional>
 #include <iomanip>
 #include <iostream>
 #include <limits>
+#include <map>
 #include <memory>
 #include <numeric>
 #include <optional>
@@ -31,6 +47,11 @@
 #include <string>
 #include <vector>
 
+#include <fcntl.h>
+#include <signal.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
 namespace fs = std::filesystem;
 
 struct Args {
@@ -46,21 +67,51 @@ struct Args {
   int enterConsecutive = 1;      // require N consecutive no-logo samples to enter AD
   int exitConsecutive = 1;       // require N consecutive logo samples to exit AD
   bool outlier = false;          // if true, use DBSCAN on PCA points instead of Bhattacharyya distance
-  std::string outlierMode = "dbscan"; // dbscan | lof | knn
+  std::string outlierMode = "dbscan"; // dbscan | lof | knn | mcd
   double dbscanEps = 0.0;        // 0 = auto
   int dbscanMinPts = 5;
   int lofK = 10;
   double lofThreshold = 1.60;
   int knnK = 10;
   double knnQuantile = 0.95;
+  int knnMedoids = 0;            // KNN: condense logo seeds to this many weighted medoids (0 = keep all)
+  bool knnAnn = false;           // KNN: approximate seed search (IVF-flat); also scores refine/live probes
+  int annNlist = 0;              // IVF lists (0 = sqrt(seeds))
+  int annNprobe = 8;             // lists scanned per query (recall vs speed)
+  double mcdSupport = 0.75;      // MCD h-subset fraction
+  double mcdThreshold = 2.72;    // Mahalanobis distance cutoff (sqrt of chi2(2) at 0.975)
   bool tokayo = false;
   double tokayoTh = 0.5;       // NCC threshold (0 = auto-detect from gap in scores)
+  int tokayoSparse = 0;        // Tokayo: score a learned sparse pixel mask of this many logo pixels (0 = template NCC)
   bool debug = false;
   bool quiet = false;
   int cornerIndex = -1;  // 0 TL, 1 TR, 2 BL, 3 BR (required)
   int threads = 0;       // 0 = auto (use available cores)
+  std::string emitVodPath;  // if set, write an ad-free VOD m3u8 here
+  std::string remuxOutPath; // if set, stream-copy the non-ad content into this MP4
+  bool smartCut = false;    // remux: re-encode only the boundary GOPs for frame-accurate cuts
+  double liveFollowSec = 0.0;  // after batch detection, follow the live playlist this long (0 = off)
+  std::string modelRegistryDir;  // if set, reuse/store trained models per channel + corner
+  std::string channel;           // registry key (default: derived from the playlist URL)
+  int registryProbeK = 60;       // samples scored against stored models
+  double trainConverge = 0.0;    // stop adding training samples once the model moves less than this (0 = off)
+  int progressFd = -1;           // if >= 0, JSON-lines progress snapshots are written to this fd
+  int progressIntervalMs = 500;  // snapshot rate for --progress-fd and the stderr sample counter
+  std::string resultCacheDir;    // if set, whole results are memoized here by content hash
+  std::string kfIndexDir;        // if set, per-segment keyframe sidecars; samples and probes seek to keyframes
+  bool blankFrames = false;      // refine: snap boundaries to black/slate frames between the flipping probes
+  bool cascade = false;          // luma-stats prefilter decides clear samples/probes before the full scorer
+  std::string spritesDir;        // if set, timeline thumbnail sprites from the frames decoded for detection
+  int spriteWidth = 160;         // sprite tile width in pixels
+  bool spritesRefine = false;    // also tile refine probes, not only coarse samples
+  std::string flightDumpPath;    // flight recorder dump file (default: <tmp>/ads_detector.<pid>.flight)
+  double stallDumpSec = 0.0;     // dump the flight recorder when no event was recorded this long (0 = off)
+  double sampleStallSec = 30.0;  // abandon a sampling capture blocked this long in one read (0 = off)
 };
 
+// Part of every result cache key; bump whenever the same inputs would now produce different JSON.
+static constexpr int kResultCacheVersion = 7;
+
 static bool startsWith(const std::string& s, const std::string& prefix) {
   return s.rfind(prefix, 0) == 0;
 }
@@ -78,7 +129,10 @@ static std::string nowStamp() {
 
 static void progress(const Args& args, const std::string& msg) {
   if (args.quiet) return;
-  std::cerr << "[" << nowStamp() << "] ads_detector: " << msg << std::endl;
+  // The progress reporter thread logs here too; keep lines whole.
+  static std::mutex mu;
+  std::lock_guard<std::mutex> lock(mu);
+  std::cerr << "[" << nowStamp() << "] ads_detector: " << msg << "\n";
 }
 
 static std::string formatHms(double seconds) {
@@ -140,11 +194,16 @@ static int computeThreadCount(int threads) {
   return std::max(1, wanted);
 }
 
-struct RefineProbe {
-  size_t adIdx = 0;
-  bool isStartWindow = true;
-  size_t pos = 0;
-  double tSec = 0.0;
+// Tokayo's sparse alternative to the template (--tokayo-sparse): the most stable logo pixels
+// plus a ring of background pixels just outside the logo, as packed (y << 16 | x) offsets into
+// the corner ROI. A frame is scored by gathering luma at those offsets and correlating it with
+// the median image there, with no crop, color conversion, blur or histogram.
+struct SparseLogoMask {
+  cv::Size roiSize;              // ROI the offsets were learned on
+  std::vector<uint32_t> offsets;
+  std::vector<float> weights;    // median luma at each offset, zero-mean and unit-norm
+  size_t logoPixels = 0;         // offsets[0, logoPixels) are logo, the rest ring
+  bool empty() const { return offsets.empty(); }
 };
 
 struct TokayoModel {
@@ -153,8 +212,300 @@ struct TokayoModel {
   double nccThreshold;     // NCC threshold for logo/no-logo classification
   int cornerIndex;
   double roiWidthPct;
+  SparseLogoMask sparse;   // if set, replaces the template NCC (same nccThreshold semantics)
+};
+
+// Robust ellipse of --outlier-mode mcd in the PCA plane of the sample histograms. A frame is
+// logo if its projection lies within `threshold` Mahalanobis distance of the MCD center, so
+// scoring costs one 512x2 projection and a 2x2 quadratic form whatever the sample count.
+struct McdModel {
+  cv::PCA pca;
+  cv::Point2d center;
+  cv::Mat covInv;    // 2x2 CV_64F
+  double threshold;  // Mahalanobis distance
+  int cornerIndex;
+  double roiWidthPct;
+};
+
+// Logo seeds condensed to weighted medoids (--knn-medoids): each medoid is a seed sample standing
+// for the `weights` seeds of its histogram-space cluster.
+struct CondensedSeeds {
+  std::vector<int> medoids;                // sample indices
+  cv::Mat hists;                           // medoid histograms, one row each
+  std::vector<int> weights;                // seeds per medoid (sum = original seed count)
+  std::vector<double> radius;              // mean Bhattacharyya distance of the members to their medoid
+  std::unordered_map<int, int> clusterOf;  // seed sample -> medoid position
+  std::unordered_map<int, int> positionOf; // medoid sample -> medoid position
+};
+
+// Weighted counterpart of the k-NN mean distance to the seeds: medoids are taken nearest first,
+// each counting for as many neighbours as it has members, until k are covered. A query that is
+// itself a seed does not count itself, and a medoid sees the rest of its own cluster at its
+// radius rather than at 0. With `index` (built over the medoids) only the medoids it returns
+// are considered; otherwise all of them.
+static double condensedKnnAvgDist(const cv::Mat& queryHist, int selfId, const CondensedSeeds& seeds, int k,
+                                  const seed_index::IvfFlat* index) {
+  std::vector<std::pair<double, int>> near;  // (distance, medoid position)
+  if (index) {
+    for (const auto& n : index->search(queryHist.ptr<float>(0), k + 1)) {
+      near.emplace_back(n.dist, seeds.positionOf.at(n.id));
+    }
+  } else {
+    near.reserve(seeds.medoids.size());
+    for (int m = 0; m < seeds.hists.rows; m++) {
+      near.emplace_back(cv::compareHist(queryHist, seeds.hists.row(m), cv::HISTCMP_BHATTACHARYYA), m);
+    }
+  }
+  const auto own = seeds.clusterOf.find(selfId);
+  const int ownPos = (own != seeds.clusterOf.end()) ? own->second : -1;
+  if (ownPos >= 0 && seeds.medoids[static_cast<size_t>(ownPos)] == selfId) {
+    for (auto& n : near) {
+      if (n.second == ownPos) n.first = seeds.radius[static_cast<size_t>(ownPos)];
+    }
+  }
+  std::sort(near.begin(), near.end());
+
+  double sum = 0.0;
+  int covered = 0;
+  for (const auto& n : near) {
+    int weight = seeds.weights[static_cast<size_t>(n.second)];
+    if (n.second == ownPos) weight--;
+    const int take = std::min(weight, k - covered);
+    if (take <= 0) continue;
+    sum += n.first * take;
+    covered += take;
+    if (covered == k) break;
+  }
+  return covered > 0 ? sum / static_cast<double>(covered) : 0.0;
+}
+
+// --knn-ann / --knn-medoids: a seed bank cheap enough to query per frame, so refine probes and
+// live follow can use the coarse KNN score (mean distance to the k nearest seeds vs the
+// seed-calibrated threshold).
+struct KnnModel {
+  std::shared_ptr<const seed_index::IvfFlat> index;  // optional when condensed
+  std::shared_ptr<const CondensedSeeds> condensed;   // --knn-medoids; the index then holds the medoids
+  int k;
+  double threshold;
+  int cornerIndex;
+  double roiWidthPct;
 };
 
+// Registry models of a time-of-day schedule, one per weekday/hour slot, so refine and live probes
+// are scored by the model of their own slot like the coarse samples were. Slots without an entry,
+// and probes whose time is unknown, use the run's default model.
+struct SlotSchedule {
+  std::unordered_map<int, logo_detector::LogoModel> hist;
+  std::unordered_map<int, TokayoModel> tokayo;
+  std::function<std::optional<int64_t>(double)> epochOf;  // batch timeline offset -> epoch ms
+
+  const logo_detector::LogoModel& histFor(std::optional<int64_t> epochMs,
+                                          const logo_detector::LogoModel& fallback) const {
+    if (!epochMs) return fallback;
+    const auto it = hist.find(model_registry::slotOf(*epochMs));
+    return it != hist.end() ? it->second : fallback;
+  }
+  const TokayoModel* tokayoFor(std::optional<int64_t> epochMs, const TokayoModel* fallback) const {
+    if (!epochMs || !fallback) return fallback;
+    const auto it = tokayo.find(model_registry::slotOf(*epochMs));
+    return it != tokayo.end() ? &it->second : fallback;
+  }
+};
+
+// Per-stage outcomes of the classifier cascade (--cascade).
+struct CascadeCounters {
+  std::atomic<int64_t> logo{0};    // decided "logo" by stage one
+  std::atomic<int64_t> noLogo{0};  // decided "no logo" by stage one
+  std::atomic<int64_t> full{0};    // ambiguous: passed on to the full scorer
+};
+
+// Stage one of --cascade: luma mean/stddev of the logo region (Tokayo's sub-rect, else the whole
+// corner ROI) compared with the typical stats of each class. A frame is decided only when it is
+// closer to one class's center than any calibration sample of the other class was; the rest go
+// on to the full scorer.
+struct CascadeGate {
+  logo_detector::LumaStats logoCenter;
+  logo_detector::LumaStats noLogoCenter;
+  logo_detector::LumaStats scale;  // per-feature divisor (robust spread)
+  double logoRadius = 0.0;
+  double noLogoRadius = 0.0;
+  cv::Rect subRect;                // Tokayo: logo sub-rect in ROI coordinates (blurred luma); empty = whole ROI
+  int cornerIndex = 0;
+  double roiWidthPct = 0.15;
+  CascadeCounters* counters = nullptr;
+
+  double distance(const logo_detector::LumaStats& s, const logo_detector::LumaStats& center) const {
+    const double dm = (s.mean - center.mean) / scale.mean;
+    const double ds = (s.stddev - center.stddev) / scale.stddev;
+    return std::sqrt(dm * dm + ds * ds);
+  }
+
+  // 1 = logo, 0 = no logo, -1 = ambiguous. Counts the outcome.
+  int decide(const logo_detector::LumaStats& s) const {
+    const bool nearLogo = distance(s, logoCenter) <= logoRadius;
+    const bool nearNoLogo = distance(s, noLogoCenter) <= noLogoRadius;
+    const int decided = (nearLogo != nearNoLogo) ? (nearLogo ? 1 : 0) : -1;
+    if (counters) (decided == 1 ? counters->logo : decided == 0 ? counters->noLogo : counters->full)++;
+    return decided;
+  }
+};
+
+// Pixel-wise median of the gray ROIs listed in `idxs`.
+static cv::Mat pixelMedian(const std::vector<cv::Mat>& grayRois, const std::vector<int>& idxs) {
+  const int roiH = grayRois[0].rows;
+  const int roiW = grayRois[0].cols;
+  const size_t n = idxs.size();
+  cv::Mat medianImg(roiH, roiW, CV_8UC1);
+  std::vector<uint8_t> vals(n);
+  for (int y = 0; y < roiH; y++) {
+    for (int x = 0; x < roiW; x++) {
+      for (size_t i = 0; i < n; i++) vals[i] = grayRois[static_cast<size_t>(idxs[i])].at<uint8_t>(y, x);
+      std::nth_element(vals.begin(), vals.begin() + n / 2, vals.end());
+      medianImg.at<uint8_t>(y, x) = vals[n / 2];
+    }
+  }
+  return medianImg;
+}
+
+// Tokayo counterpart of logo_detector::convergeTrainingSet(): the median image is refitted on a
+// growing progressive prefix until it changes less than `tolerance` (mean |delta| / 255).
+static std::vector<int> convergeTokayoTrainingSet(const std::vector<cv::Mat>& grayRois, double tolerance) {
+  const int n = static_cast<int>(grayRois.size());
+  std::vector<int> all(static_cast<size_t>(n));
+  std::iota(all.begin(), all.end(), 0);
+  if (tolerance <= 0.0) return all;
+
+  const std::vector<int> order = logo_detector::progressiveOrder(n);
+  cv::Mat prevMedian;
+  int used = std::min(n, 24);
+  while (used < n) {
+    const std::vector<int> prefix(order.begin(), order.begin() + used);
+    const cv::Mat medianImg = pixelMedian(grayRois, prefix);
+    if (!prevMedian.empty() &&
+        cv::norm(medianImg, prevMedian, cv::NORM_L1) / (255.0 * medianImg.total()) < tolerance) {
+      std::vector<int> picked = prefix;
+      std::sort(picked.begin(), picked.end());
+      return picked;
+    }
+    prevMedian = medianImg;
+    used = std::min(n, used + std::max(8, used / 2));
+  }
+  return all;
+}
+
+// Picks up to `maxPixels` lowest-stddev pixels of the eroded logo mask, and as many ring pixels
+// (2-4 px outside the mask) whose median differs most from the logo's. Erosion and the gap keep
+// both sets away from the logo edge, where the training ROIs' 3x3 blur moves values most.
+// Returns an empty mask if the selection has no contrast to correlate against.
+static SparseLogoMask learnSparseLogoMask(const cv::Mat& medianImg, const cv::Mat& stddevImg,
+                                          const cv::Mat& logoMask, int maxPixels) {
+  SparseLogoMask mask;
+  cv::Mat core;
+  cv::Mat inner;
+  cv::Mat outer;
+  cv::erode(logoMask, core, cv::getStructuringElement(cv::MORPH_RECT, cv::Size(3, 3)));
+  cv::dilate(logoMask, inner, cv::getStructuringElement(cv::MORPH_ELLIPSE, cv::Size(5, 5)));
+  cv::dilate(logoMask, outer, cv::getStructuringElement(cv::MORPH_ELLIPSE, cv::Size(9, 9)));
+
+  std::vector<std::pair<float, uint32_t>> logo;
+  double logoSum = 0.0;
+  for (int y = 0; y < core.rows; y++) {
+    for (int x = 0; x < core.cols; x++) {
+      if (!core.at<uint8_t>(y, x)) continue;
+      logo.emplace_back(stddevImg.at<float>(y, x), (static_cast<uint32_t>(y) << 16) | static_cast<uint32_t>(x));
+    }
+  }
+  const size_t logoCount = std::min(logo.size(), static_cast<size_t>(maxPixels));
+  std::partial_sort(logo.begin(), logo.begin() + static_cast<long>(logoCount), logo.end());
+  logo.resize(logoCount);
+  for (const auto& p : logo) logoSum += medianImg.at<uint8_t>(static_cast<int>(p.second >> 16), static_cast<int>(p.second & 0xffff));
+  const double logoMean = logoCount ? logoSum / static_cast<double>(logoCount) : 0.0;
+
+  std::vector<std::pair<float, uint32_t>> ring;
+  for (int y = 0; y < outer.rows; y++) {
+    for (int x = 0; x < outer.cols; x++) {
+      if (!outer.at<uint8_t>(y, x) || inner.at<uint8_t>(y, x)) continue;
+      const float contrast = static_cast<float>(std::abs(medianImg.at<uint8_t>(y, x) - logoMean));
+      ring.emplace_back(-contrast, (static_cast<uint32_t>(y) << 16) | static_cast<uint32_t>(x));
+    }
+  }
+  const size_t ringCount = std::min(ring.size(), static_cast<size_t>(maxPixels));
+  std::partial_sort(ring.begin(), ring.begin() + static_cast<long>(ringCount), ring.end());
+  ring.resize(ringCount);
+
+  mask.roiSize = medianImg.size();
+  mask.logoPixels = logoCount;
+  for (const auto* set : {&logo, &ring}) {
+    for (const auto& p : *set) {
+      mask.offsets.push_back(p.second);
+      mask.weights.push_back(medianImg.at<uint8_t>(static_cast<int>(p.second >> 16), static_cast<int>(p.second & 0xffff)));
+    }
+  }
+  const double n = static_cast<double>(mask.weights.size());
+  double mean = 0.0;
+  for (float w : mask.weights) mean += w;
+  mean /= std::max(1.0, n);
+  double norm = 0.0;
+  for (float& w : mask.weights) {
+    w = static_cast<float>(w - mean);
+    norm += static_cast<double>(w) * w;
+  }
+  if (logoCount == 0 || ringCount == 0 || norm < 1e-6) return SparseLogoMask{};
+  const float inv = static_cast<float>(1.0 / std::sqrt(norm));
+  for (float& w : mask.weights) w *= inv;
+  return mask;
+}
+
+// Pearson correlation between the luma gathered at the mask offsets and its weights, in [-1,1].
+// `lumaAt(y, x)` reads one ROI pixel. The weights are zero-mean and unit-norm, so one pass of
+// sums and a dot product is all it takes.
+template <typename LumaAt>
+static double sparseMaskScore(const SparseLogoMask& mask, const LumaAt& lumaAt) {
+  double sum = 0.0;
+  double sum2 = 0.0;
+  double dot = 0.0;
+  const size_t n = mask.offsets.size();
+  for (size_t i = 0; i < n; i++) {
+    const uint32_t o = mask.offsets[i];
+    const double v = lumaAt(static_cast<int>(o >> 16), static_cast<int>(o & 0xffff));
+    sum += v;
+    sum2 += v * v;
+    dot += v * mask.weights[i];
+  }
+  const double centered = sum2 - sum * sum / static_cast<double>(n);
+  if (centered <= 1e-9) return 0.0;
+  return dot / std::sqrt(centered);
+}
+
+// Luma of BGR ROI pixel (y, x) as the training samples saw it: BT.601 gray through the same 3x3
+// Gaussian (1-2-1 per axis, reflect-101 border), so the threshold learned on the blurred sample
+// ROIs holds for probes too. Nine reads per mask offset; the ROI is still never converted whole.
+static int blurredLumaAt(const cv::Mat& bgrRoi, int y, int x) {
+  static constexpr int kTap[3] = {1, 2, 1};
+  auto reflect = [](int i, int n) { return i < 0 ? std::min(1, n - 1) : (i >= n ? std::max(0, n - 2) : i); };
+  int acc = 0;
+  for (int dy = -1; dy <= 1; dy++) {
+    const uint8_t* row = bgrRoi.ptr<uint8_t>(reflect(y + dy, bgrRoi.rows));
+    for (int dx = -1; dx <= 1; dx++) {
+      const uint8_t* p = row + 3 * reflect(x + dx, bgrRoi.cols);
+      acc += kTap[dy + 1] * kTap[dx + 1] * ((29 * p[0] + 150 * p[1] + 77 * p[2] + 128) >> 8);
+    }
+  }
+  return (acc + 8) >> 4;
+}
+
+// What each classifier reads per sample: Tokayo only gray ROIs, the rest only histograms;
+// PNGs are encoded for --debug export alone.
+static logo_detector::SampleArtifacts sampleArtifactsFor(const Args& args) {
+  logo_detector::SampleArtifacts artifacts;
+  artifacts.hist = !args.tokayo;
+  artifacts.grayRoi = args.tokayo;
+  artifacts.roiPng = args.debug;
+  artifacts.thumbWidth = args.spritesDir.empty() ? 0 : args.spriteWidth;
+  artifacts.lumaStats = args.cascade && !args.tokayo;  // Tokayo measures its gray ROIs' logo sub-rect
+  return artifacts;
+}
+
 static double mahalanobisDistance2D(const cv::Point2f& pt, const cv::Point2d& center,
                                    const cv::Mat& covInv) {
   const double dx = pt.x - center.x;
@@ -165,152 +516,391 @@ static double mahalanobisDistance2D(const cv::Point2f& pt, const cv::Point2d& ce
   return std::sqrt(std::max(0.0, d2));
 }
 
-static bool evaluateHasLogoParallelProbes(const std::string& source,
-                                          const Args& args,
-                                          const logo_detector::LogoModel& model,
-                                          double totalDurationSec,
-                                          const std::vector<RefineProbe>& probes,
-                                          std::vector<char>& outHasLogo,
-                                          const TokayoModel* tokayo = nullptr) {
-  outHasLogo.assign(probes.size(), 0);
-  if (probes.empty()) return true;
-
-  const int wantedThreads = computeThreadCount(args.threads);
-  // Avoid opening more VideoCaptures than work items (HLS open/seek is expensive).
-  const int threadCount = std::max(1, std::min(wantedThreads, static_cast<int>(probes.size())));
-  std::vector<std::vector<int>> buckets(static_cast<size_t>(threadCount));
-  for (int i = 0; i < static_cast<int>(probes.size()); i++) {
-    const double t = probes[static_cast<size_t>(i)].tSec;
-    const int bucket =
-        std::min(threadCount - 1,
-                 std::max(0, static_cast<int>(((totalDurationSec > 0.0) ? (t / totalDurationSec) : 0.0) * threadCount)));
-    buckets[static_cast<size_t>(bucket)].push_back(i);
-  }
-  // Critical for performance: keep per-thread timestamps mostly increasing to reduce costly HLS seeks.
-  for (auto& b : buckets) {
-    std::sort(b.begin(), b.end(), [&](int a, int c) {
-      return probes[static_cast<size_t>(a)].tSec < probes[static_cast<size_t>(c)].tSec;
+// Stage-one features of a decoded frame, measured the way the gate's calibration samples were.
+static logo_detector::LumaStats cascadeFeatures(const cv::Mat& frame, const CascadeGate& gate) {
+  if (gate.subRect.empty()) return logo_detector::roiLumaStats(frame, gate.cornerIndex, gate.roiWidthPct);
+  const int side = static_cast<int>(std::lround(frame.cols * gate.roiWidthPct));
+  const int roiX = (gate.cornerIndex == 1 || gate.cornerIndex == 3) ? frame.cols - side : 0;
+  const int roiY = (gate.cornerIndex == 2 || gate.cornerIndex == 3) ? frame.rows - side : 0;
+  // One pixel of context around the sub-rect, so the 3x3 blur matches the training ROIs inside it.
+  const cv::Rect padded = cv::Rect(roiX + gate.subRect.x - 1, roiY + gate.subRect.y - 1,
+                                   gate.subRect.width + 2, gate.subRect.height + 2) &
+                          cv::Rect(0, 0, frame.cols, frame.rows);
+  cv::Mat gray;
+  cv::cvtColor(frame(padded), gray, cv::COLOR_BGR2GRAY);
+  cv::GaussianBlur(gray, gray, cv::Size(3, 3), 0);
+  const cv::Rect inner = cv::Rect(roiX + gate.subRect.x - padded.x, roiY + gate.subRect.y - padded.y,
+                                  gate.subRect.width, gate.subRect.height) &
+                         cv::Rect(0, 0, gray.cols, gray.rows);
+  return logo_detector::lumaStats(gray(inner));
+}
+
+// Single-frame classification shared by refine probes and live follow. With a cascade gate,
+// only frames stage one cannot decide reach the full scorer.
+static bool frameHasLogo(const cv::Mat& frame,
+                         const Args& args,
+                         const logo_detector::LogoModel& model,
+                         const TokayoModel* tokayo,
+                         const McdModel* mcd = nullptr,
+                         const CascadeGate* gate = nullptr,
+                         const KnnModel* knn = nullptr) {
+  if (gate) {
+    const int decided = gate->decide(cascadeFeatures(frame, *gate));
+    if (decided >= 0) {
+      ADS_TRACE3(classify, int64_t{-1}, decided, -1);
+      return decided == 1;
+    }
+  }
+  if (knn) {
+    const cv::Mat hist = logo_detector::extractHistogram(frame, knn->cornerIndex, knn->roiWidthPct);
+    const double dist = knn->condensed ? condensedKnnAvgDist(hist, -1, *knn->condensed, knn->k, knn->index.get())
+                                       : knn->index->avgDist(hist.ptr<float>(0), knn->k);
+    const bool hasLogo = dist <= knn->threshold;
+    ADS_TRACE3(classify, int64_t{-1}, hasLogo ? 1 : 0, static_cast<int64_t>(std::llround(dist * 1e6)));
+    return hasLogo;
+  }
+  if (mcd) {
+    cv::Mat projected;
+    mcd->pca.project(logo_detector::extractHistogram(frame, mcd->cornerIndex, mcd->roiWidthPct), projected);
+    const double dist = mahalanobisDistance2D(cv::Point2f(projected.at<float>(0, 0), projected.at<float>(0, 1)),
+                                              mcd->center, mcd->covInv);
+    const bool hasLogo = dist <= mcd->threshold;
+    ADS_TRACE3(classify, int64_t{-1}, hasLogo ? 1 : 0, static_cast<int64_t>(std::llround(dist * 1e6)));
+    return hasLogo;
+  }
+  if (!tokayo) {
+    const double dist = logo_detector::distanceToLogo(frame, model.cornerIndex, args.roiWidthPct, model.meanHist);
+    const bool hasLogo = dist <= model.threshold;
+    ADS_TRACE3(classify, int64_t{-1}, hasLogo ? 1 : 0, static_cast<int64_t>(std::llround(dist * 1e6)));
+    return hasLogo;
+  }
+  const auto rect = cv::Rect(
+    (tokayo->cornerIndex == 1 || tokayo->cornerIndex == 3) ? frame.cols - static_cast<int>(std::lround(frame.cols * tokayo->roiWidthPct)) : 0,
+    (tokayo->cornerIndex == 2 || tokayo->cornerIndex == 3) ? frame.rows - static_cast<int>(std::lround(frame.cols * tokayo->roiWidthPct)) : 0,
+    static_cast<int>(std::lround(frame.cols * tokayo->roiWidthPct)),
+    static_cast<int>(std::lround(frame.cols * tokayo->roiWidthPct)));
+  cv::Mat roi = frame(rect & cv::Rect(0, 0, frame.cols, frame.rows));
+  if (!tokayo->sparse.empty() && roi.size() == tokayo->sparse.roiSize && frame.type() == CV_8UC3) {
+    // Blurred BT.601 luma straight from BGR, only around the sampled pixels.
+    const double score = sparseMaskScore(tokayo->sparse, [&roi](int y, int x) {
+      return static_cast<double>(blurredLumaAt(roi, y, x));
     });
+    const bool hasLogo = score >= tokayo->nccThreshold;
+    ADS_TRACE3(classify, int64_t{-1}, hasLogo ? 1 : 0, static_cast<int64_t>(std::llround(score * 1e6)));
+    return hasLogo;
   }
+  cv::Mat gray;
+  cv::cvtColor(roi, gray, cv::COLOR_BGR2GRAY);
+  cv::GaussianBlur(gray, gray, cv::Size(3, 3), 0);
+  const cv::Rect subRect = tokayo->logoSubRect & cv::Rect(0, 0, gray.cols, gray.rows);
+  if (subRect.width <= 0 || subRect.height <= 0 ||
+      subRect.width != tokayo->logoTemplate.cols || subRect.height != tokayo->logoTemplate.rows) {
+    return false;
+  }
+  cv::Mat result;
+  cv::matchTemplate(gray(subRect), tokayo->logoTemplate, result, cv::TM_CCOEFF_NORMED);
+  const double ncc = result.at<float>(0, 0);
+  const bool hasLogo = ncc >= tokayo->nccThreshold;
+  ADS_TRACE3(classify, int64_t{-1}, hasLogo ? 1 : 0, static_cast<int64_t>(std::llround(ncc * 1e6)));
+  return hasLogo;
+}
 
-  std::mutex errorMu;
-  std::string firstError;
+// Black or uniform slate, judged on the whole frame's luma downscaled to 32x18: a mean/stddev
+// check costs next to nothing compared to decoding the frame.
+static bool isBlankFrame(const cv::Mat& frame) {
+  constexpr double kBlackMaxMean = 40.0;
+  constexpr double kBlackMaxStd = 10.0;
+  constexpr double kSlateMaxStd = 3.0;
+  cv::Mat small;
+  cv::Mat luma;
+  cv::resize(frame, small, cv::Size(32, 18), 0, 0, cv::INTER_AREA);
+  cv::cvtColor(small, luma, cv::COLOR_BGR2GRAY);
+  cv::Scalar mean;
+  cv::Scalar stddev;
+  cv::meanStdDev(luma, mean, stddev);
+  return (mean[0] <= kBlackMaxMean && stddev[0] <= kBlackMaxStd) || stddev[0] <= kSlateMaxStd;
+}
 
-  auto worker = [&](const std::vector<int>& idxs) {
-    try {
-      if (idxs.empty()) return;
-      cv::VideoCapture cap(source);
-      if (!cap.isOpened()) throw std::runtime_error("OpenCV could not open m3u8 in refine worker thread");
-      cap.set(cv::CAP_PROP_BUFFERSIZE, 1);
+// First black/slate run decoded between the two probes where a refine window flips.
+struct BlankRun {
+  double startSec = -1.0;     // first blank frame (-1 = no run)
+  double endSec = -1.0;       // first frame after the run (-1 = run reaches the later probe)
+  bool afterHasLogo = false;  // classification of the frame at endSec
+  bool found() const { return startSec >= 0.0; }
+};
 
-      cv::Mat frame;
-      for (int idx : idxs) {
-        const double t = probes[static_cast<size_t>(idx)].tSec;
-        cap.set(cv::CAP_PROP_POS_MSEC, t * 1000.0);
-        if (!cap.read(frame) || frame.empty()) {
-          outHasLogo[static_cast<size_t>(idx)] = 0;
-        } else if (tokayo) {
-          const auto rect = cv::Rect(
-            (tokayo->cornerIndex == 1 || tokayo->cornerIndex == 3) ? frame.cols - static_cast<int>(std::lround(frame.cols * tokayo->roiWidthPct)) : 0,
-            (tokayo->cornerIndex == 2 || tokayo->cornerIndex == 3) ? frame.rows - static_cast<int>(std::lround(frame.cols * tokayo->roiWidthPct)) : 0,
-            static_cast<int>(std::lround(frame.cols * tokayo->roiWidthPct)),
-            static_cast<int>(std::lround(frame.cols * tokayo->roiWidthPct)));
-          cv::Mat roi = frame(rect & cv::Rect(0, 0, frame.cols, frame.rows));
-          cv::Mat gray;
-          cv::cvtColor(roi, gray, cv::COLOR_BGR2GRAY);
-          cv::GaussianBlur(gray, gray, cv::Size(3, 3), 0);
-          const cv::Rect subRect = tokayo->logoSubRect & cv::Rect(0, 0, gray.cols, gray.rows);
-          if (subRect.width > 0 && subRect.height > 0 &&
-              subRect.width == tokayo->logoTemplate.cols && subRect.height == tokayo->logoTemplate.rows) {
-            cv::Mat result;
-            cv::matchTemplate(gray(subRect), tokayo->logoTemplate, result, cv::TM_CCOEFF_NORMED);
-            outHasLogo[static_cast<size_t>(idx)] = (result.at<float>(0, 0) >= tokayo->nccThreshold) ? 1 : 0;
-          } else {
-            outHasLogo[static_cast<size_t>(idx)] = 0;
-          }
-        } else {
-          const double dist = logo_detector::distanceToLogo(frame, model.cornerIndex, args.roiWidthPct, model.meanHist);
-          outHasLogo[static_cast<size_t>(idx)] = (dist <= model.threshold) ? 1 : 0;
-        }
-      }
-    } catch (const std::exception& e) {
-      std::lock_guard<std::mutex> lock(errorMu);
-      if (firstError.empty()) firstError = e.what();
-    }
-  };
+// Evaluates refine windows on a pool of VideoCaptures. Windows need the trained model, so they are
+// only submitted once every coarse sample has been classified: refine runs after the coarse pass,
+// not alongside it. The pool starts early only so one capture can be opened in the meantime.
+class RefinePool {
+ public:
+  // `sprites`, if set, receives every probe frame (--sprites-refine).
+  RefinePool(const Args& args, std::string source, sprite_sheet::Collector* sprites = nullptr)
+      : args_(args), source_(std::move(source)), sprites_(sprites) {
+    const int threadCount = computeThreadCount(args.threads);
+    pool_.reserve(static_cast<size_t>(threadCount));
+    // Only the first worker opens its capture eagerly; the rest open on their first window.
+    for (int t = 0; t < threadCount; t++) pool_.emplace_back([this, t] { run(t == 0); });
+  }
 
-  std::vector<std::thread> pool;
-  pool.reserve(static_cast<size_t>(threadCount));
-  for (int t = 0; t < threadCount; t++) pool.emplace_back(worker, std::cref(buckets[static_cast<size_t>(t)]));
-  for (auto& th : pool) th.join();
+  ~RefinePool() { close(); }
+
+  RefinePool(const RefinePool&) = delete;
+  RefinePool& operator=(const RefinePool&) = delete;
+
+  // Must be called before the first submit(); the models are copied.
+  void setModel(const logo_detector::LogoModel& model, const TokayoModel* tokayo, const McdModel* mcd = nullptr,
+                const CascadeGate* gate = nullptr, const KnnModel* knn = nullptr,
+                const SlotSchedule* schedule = nullptr) {
+    std::lock_guard<std::mutex> lock(mu_);
+    model_ = model;
+    if (tokayo) tokayo_ = *tokayo;
+    if (mcd) mcd_ = *mcd;
+    if (gate) gate_ = *gate;
+    if (knn) knn_ = *knn;
+    if (schedule) schedule_ = *schedule;
+    hasModel_ = true;
+  }
 
-  if (!firstError.empty()) {
-    progress(args, std::string("Refine: error: ") + firstError);
-    return false;
+  // Optional; tried before the capture for each probe, false falls back to a seek. Must be called
+  // before the first submit().
+  void setFrameReader(std::function<bool(double tSec, cv::Mat& frame)> readAt) {
+    std::lock_guard<std::mutex> lock(mu_);
+    readAt_ = std::move(readAt);
   }
-  return true;
-}
 
-template <typename IntervalT>
-static void refineIntervalsIterative(const Args& args,
-                                     const std::string& source,
-                                     double totalDurationSec,
-                                     const logo_detector::LogoModel& model,
-                                     std::vector<IntervalT>& ads,
-                                     const fs::path* debugDirOrNull,
-                                     const TokayoModel* tokayo = nullptr) {
-  if (ads.empty()) return;
+  size_t submit(std::vector<double> times) {
+    std::lock_guard<std::mutex> lock(mu_);
+    if (!hasModel_) throw std::runtime_error("refine pool: submit before setModel");
+    const size_t id = windows_.size();
+    windows_.push_back(Window{std::move(times), {}, {}, false});
+    queue_.push_back(id);
+    workCv_.notify_one();
+    return id;
+  }
 
-  const double refineStepSec = 5.0;
-  progress(args, "Refinando intervalos (-30s, step=" + std::to_string(refineStepSec) + "s, paralelo)");
+  // Blocks until the window is evaluated. Returns false if any worker failed.
+  // With --blank-frames, `outBlank` receives the blank run found at the window's first flip.
+  bool wait(size_t id, std::vector<char>& outHasLogo, BlankRun* outBlank = nullptr) {
+    std::unique_lock<std::mutex> lock(mu_);
+    doneCv_.wait(lock, [&] { return windows_[id].done || !error_.empty(); });
+    if (!error_.empty()) return false;
+    outHasLogo = windows_[id].hasLogo;
+    if (outBlank) *outBlank = windows_[id].blank;
+    return true;
+  }
 
-  struct PerAd {
-    std::vector<double> startTimes;
-    std::vector<double> endTimes;
-    std::vector<size_t> startProbeIdx;
-    std::vector<size_t> endProbeIdx;
-  };
-  std::vector<PerAd> per;
-  per.resize(ads.size());
+  std::string error() const {
+    std::lock_guard<std::mutex> lock(mu_);
+    return error_;
+  }
 
-  std::vector<RefineProbe> probes;
-  probes.reserve(ads.size() * 32);
+  size_t windowCount() const {
+    std::lock_guard<std::mutex> lock(mu_);
+    return windows_.size();
+  }
 
-  for (size_t idx = 0; idx < ads.size(); idx++) {
-    const double coarseStart = ads[idx].startSec;
-    const double coarseEnd = ads[idx].endSec;
-    const double startWinA = std::max(0.0, coarseStart - 30.0);
-    const double startWinB = std::min(totalDurationSec, coarseStart);
-    const double endWinA = std::max(0.0, coarseEnd - 30.0);
-    const double endWinB = std::min(totalDurationSec, coarseEnd);
+  size_t threadCount() const { return pool_.size(); }
 
-    for (double t = startWinA; t <= startWinB + 1e-9; t += refineStepSec) {
-      per[idx].startTimes.push_back(t);
-      per[idx].startProbeIdx.push_back(probes.size());
-      probes.push_back(RefineProbe{idx, true, per[idx].startTimes.size() - 1, t});
+  // Drops windows nobody waits for and joins the workers.
+  void close() {
+    {
+      std::lock_guard<std::mutex> lock(mu_);
+      closed_ = true;
+      queue_.clear();
     }
-    for (double t = endWinA; t <= endWinB + 1e-9; t += refineStepSec) {
-      per[idx].endTimes.push_back(t);
-      per[idx].endProbeIdx.push_back(probes.size());
-      probes.push_back(RefineProbe{idx, false, per[idx].endTimes.size() - 1, t});
+    workCv_.notify_all();
+    for (auto& th : pool_) {
+      if (th.joinable()) th.join();
     }
   }
 
-  progress(args, "Refine: probes=" + std::to_string(probes.size()) +
-                     ", threads=" + std::to_string(computeThreadCount(args.threads)));
+ private:
+  struct Window {
+    std::vector<double> times;  // increasing
+    std::vector<char> hasLogo;
+    BlankRun blank;
+    bool done = false;
+  };
+
+  bool classify(const cv::Mat& frame, double timeSec) const {
+    const TokayoModel* tokayo = tokayo_ ? &*tokayo_ : nullptr;
+    if (!schedule_) {
+      return frameHasLogo(frame, args_, model_, tokayo, mcd_ ? &*mcd_ : nullptr, gate_ ? &*gate_ : nullptr,
+                          knn_ ? &*knn_ : nullptr);
+    }
+    const auto epochMs = schedule_->epochOf(timeSec);
+    return frameHasLogo(frame, args_, schedule_->histFor(epochMs, model_), schedule_->tokayoFor(epochMs, tokayo),
+                        mcd_ ? &*mcd_ : nullptr, gate_ ? &*gate_ : nullptr, knn_ ? &*knn_ : nullptr);
+  }
 
-  std::vector<char> probeHas;
-  if (!evaluateHasLogoParallelProbes(source, args, model, totalDurationSec, probes, probeHas, tokayo)) {
-    progress(args, "Refine: fallo paralelismo; manteniendo intervalos sin refinar");
-    return;
+  // Decodes every frame from the probe before the first flip up to the flip itself, so only the
+  // frames around an actual transition are scanned. Frame times come from the decoder.
+  BlankRun scanBlankRun(cv::VideoCapture& cap, cv::Mat& frame,
+                        const std::vector<double>& times, const std::vector<char>& hasLogo) {
+    BlankRun run;
+    size_t flip = 0;
+    for (size_t i = 1; i < hasLogo.size(); i++) {
+      if (hasLogo[i] != hasLogo[i - 1]) {
+        flip = i;
+        break;
+      }
+    }
+    if (flip == 0) return run;
+    // Guards against a stream whose decoder never reports a position past the later probe.
+    const int maxFrames = static_cast<int>((times[flip] - times[flip - 1]) * 120.0) + 2;
+    cap.set(cv::CAP_PROP_POS_MSEC, times[flip - 1] * 1000.0);
+    for (int n = 0; n < maxFrames && cap.read(frame) && !frame.empty(); n++) {
+      const double t = cap.get(cv::CAP_PROP_POS_MSEC) / 1000.0;
+      if (t > times[flip] + 1e-3) break;
+      if (isBlankFrame(frame)) {
+        if (!run.found()) run.startSec = t;
+      } else if (run.found()) {
+        run.endSec = t;
+        run.afterHasLogo = classify(frame, t);
+        break;
+      }
+    }
+    return run;
   }
 
+  void run(bool openEagerly) {
+    std::unique_ptr<cv::VideoCapture> cap;
+    auto open = [&] {
+      flight_recorder::IoWait io;
+      cap = std::make_unique<cv::VideoCapture>(source_);
+      if (!cap->isOpened()) throw std::runtime_error("OpenCV could not open m3u8 in refine worker thread");
+      cap->set(cv::CAP_PROP_BUFFERSIZE, 1);
+    };
+    try {
+      if (openEagerly) {
+        // Best effort: a failed early open is retried when the first window arrives.
+        try {
+          open();
+        } catch (const std::exception&) {
+          cap.reset();
+        }
+      }
+      cv::Mat frame;
+      for (;;) {
+        size_t id = 0;
+        std::vector<double> times;
+        std::function<bool(double, cv::Mat&)> readAt;
+        {
+          std::unique_lock<std::mutex> lock(mu_);
+          workCv_.wait(lock, [&] { return closed_ || !queue_.empty(); });
+          if (queue_.empty()) return;
+          id = queue_.front();
+          queue_.pop_front();
+          times = windows_[id].times;
+          readAt = readAt_;
+        }
+        std::vector<char> hasLogo(times.size(), 0);
+        for (size_t i = 0; i < times.size(); i++) {
+          const int64_t probeUs = flight_recorder::nowUs();
+          bool decoded = false;
+          {
+            flight_recorder::IoWait io;
+            decoded = readAt && readAt(times[i], frame) && !frame.empty();
+            if (!decoded) {
+              if (!cap) open();
+              cap->set(cv::CAP_PROP_POS_MSEC, times[i] * 1000.0);
+              decoded = cap->read(frame) && !frame.empty();
+            }
+          }
+          if (decoded) {
+            hasLogo[i] = classify(frame, times[i]) ? 1 : 0;
+            if (sprites_) sprites_->add(times[i], frame);
+          }
+          flight_recorder::record(flight_recorder::Kind::Refine, static_cast<int64_t>(id),
+                                  static_cast<int64_t>(std::llround(times[i] * 1000.0)), flight_recorder::nowUs() - probeUs);
+          ADS_TRACE3(refine_probe, static_cast<int64_t>(id), static_cast<int64_t>(std::llround(times[i] * 1000.0)),
+                     static_cast<int64_t>(hasLogo[i]));
+        }
+        BlankRun blank;
+        if (args_.blankFrames) {
+          flight_recorder::IoWait io;
+          if (!cap) open();
+          blank = scanBlankRun(*cap, frame, times, hasLogo);
+        }
+        {
+          std::lock_guard<std::mutex> lock(mu_);
+          windows_[id].hasLogo = std::move(hasLogo);
+          windows_[id].blank = blank;
+          windows_[id].done = true;
+        }
+        doneCv_.notify_all();
+      }
+    } catch (const std::exception& e) {
+      flight_recorder::record(flight_recorder::Kind::Error, 0, 0, 0, e.what());
+      {
+        std::lock_guard<std::mutex> lock(mu_);
+        if (error_.empty()) error_ = e.what();
+      }
+      doneCv_.notify_all();
+    }
+  }
+
+  const Args& args_;
+  const std::string source_;
+  sprite_sheet::Collector* const sprites_;
+  logo_detector::LogoModel model_;
+  std::optional<TokayoModel> tokayo_;
+  std::optional<McdModel> mcd_;
+  std::optional<CascadeGate> gate_;
+  std::optional<KnnModel> knn_;
+  std::optional<SlotSchedule> schedule_;
+  bool hasModel_ = false;
+  std::function<bool(double, cv::Mat&)> readAt_;
+
+  mutable std::mutex mu_;
+  std::condition_variable workCv_;
+  std::condition_variable doneCv_;
+  std::deque<Window> windows_;
+  std::deque<size_t> queue_;
+  bool closed_ = false;
+  std::string error_;
+  std::vector<std::thread> pool_;
+};
+
+// Probe times for a boundary's refine window: [boundary - 30s, boundary], 5 s apart.
+static std::vector<double> refineWindowTimes(double boundarySec, double totalDurationSec) {
+  const double refineStepSec = 5.0;
+  std::vector<double> times;
+  const double a = std::max(0.0, boundarySec - 30.0);
+  const double b = std::min(totalDurationSec, boundarySec);
+  for (double t = a; t <= b + 1e-9; t += refineStepSec) times.push_back(t);
+  return times;
+}
+
+// Refine windows submitted for one detected AD.
+struct RefineWindows {
+  std::vector<double> startTimes;
+  std::vector<double> endTimes;
+  size_t startId = 0;
+  size_t endId = 0;
+};
+
+// Returns false when refine failed and the intervals were left coarse.
+template <typename IntervalT>
+static bool refineIntervalsIterative(const Args& args,
+                                     RefinePool& pool,
+                                     const std::vector<RefineWindows>& windows,
+                                     std::vector<IntervalT>& ads,
+                                     const fs::path* debugDirOrNull,
+                                     progress_reporter::Counters& counters) {
+  if (ads.empty()) return true;
+  counters.refineTotal.store(static_cast<int64_t>(2 * ads.size()), std::memory_order_relaxed);
+
+  progress(args, "Refinando intervalos (-30s, step=5s, ventanas=" + std::to_string(pool.windowCount()) +
+                     ", threads=" + std::to_string(pool.threadCount()) + ")");
+
   std::ofstream debugCsv;
   if (debugDirOrNull) {
     const fs::path p = (*debugDirOrNull) / "refine_intervals.csv";
     debugCsv.open(p);
     if (debugCsv.is_open()) {
-      debugCsv << "idx,coarseStart,coarseEnd,refinedStart,refinedEnd\n";
+      debugCsv << "idx,coarseStart,coarseEnd,refinedStart,refinedEnd,startOnBlank,endOnBlank\n";
     }
   }
 
@@ -319,27 +909,35 @@ static void refineIntervalsIterative(const Args& args,
     const double coarseStart = it.startSec;
     const double coarseEnd = it.endSec;
 
-    const auto& startTimes = per[idx].startTimes;
-    const auto& endTimes = per[idx].endTimes;
-    std::vector<char> startHas(startTimes.size(), 0);
-    std::vector<char> endHas(endTimes.size(), 0);
-    for (size_t i = 0; i < startHas.size(); i++) {
-      const size_t pIdx = per[idx].startProbeIdx[i];
-      if (pIdx < probeHas.size()) startHas[i] = probeHas[pIdx];
-    }
-    for (size_t i = 0; i < endHas.size(); i++) {
-      const size_t pIdx = per[idx].endProbeIdx[i];
-      if (pIdx < probeHas.size()) endHas[i] = probeHas[pIdx];
+    const auto& startTimes = windows[idx].startTimes;
+    const auto& endTimes = windows[idx].endTimes;
+    std::vector<char> startHas;
+    std::vector<char> endHas;
+    BlankRun startBlank;
+    BlankRun endBlank;
+    if (!pool.wait(windows[idx].startId, startHas, &startBlank) ||
+        !pool.wait(windows[idx].endId, endHas, &endBlank)) {
+      progress(args, "Refine: error: " + pool.error());
+      progress(args, "Refine: fallo paralelismo; manteniendo intervalos sin refinar");
+      return false;
     }
+    counters.refineDone.fetch_add(2, std::memory_order_relaxed);
 
     // Refine start: scan forward, find the first second where logo disappears.
     double refinedStart = coarseStart;
+    bool startOnBlank = false;
     if (!startHas.empty() && startHas[0] == 0) {
       refinedStart = startTimes[0];
     } else {
       for (size_t i = 1; i < startHas.size(); i++) {
         if (startHas[i - 1] != 0 && startHas[i] == 0) {
           refinedStart = startTimes[i];
+          // The break opens on the blank run when the frame after it is confirmed logo-free.
+          if (startBlank.found() && startBlank.startSec >= startTimes[i - 1] &&
+              (startBlank.endSec < 0.0 || !startBlank.afterHasLogo)) {
+            refinedStart = startBlank.startSec;
+            startOnBlank = true;
+          }
           break;
         }
       }
@@ -347,12 +945,18 @@ static void refineIntervalsIterative(const Args& args,
 
     // Refine end: scan forward, find the first second where logo appears.
     double refinedEnd = coarseEnd;
+    bool endOnBlank = false;
     {
       // We expect this window to straddle the end boundary; pick the first second where logo is present.
       // If logo is already present at endWinA, refinedEnd becomes endWinA.
       for (size_t i = 0; i < endHas.size(); i++) {
         if (endHas[i] != 0) {
           refinedEnd = endTimes[i];
+          // Programme resumes on the first frame after the blank run, if that frame shows the logo.
+          if (i > 0 && endBlank.found() && endBlank.endSec >= endTimes[i - 1] && endBlank.afterHasLogo) {
+            refinedEnd = endBlank.endSec;
+            endOnBlank = true;
+          }
           break;
         }
       }
@@ -361,10 +965,13 @@ static void refineIntervalsIterative(const Args& args,
     if (refinedEnd < refinedStart) {
       refinedStart = coarseStart;
       refinedEnd = coarseEnd;
+      startOnBlank = false;
+      endOnBlank = false;
     }
 
     if (debugCsv.is_open()) {
-      debugCsv << idx << "," << coarseStart << "," << coarseEnd << "," << refinedStart << "," << refinedEnd << "\n";
+      debugCsv << idx << "," << coarseStart << "," << coarseEnd << "," << refinedStart << "," << refinedEnd << ","
+               << startOnBlank << "," << endOnBlank << "\n";
     }
 
     if (refinedStart != coarseStart || refinedEnd != coarseEnd) {
@@ -379,7 +986,10 @@ static void refineIntervalsIterative(const Args& args,
 
     it.startSec = refinedStart;
     it.endSec = refinedEnd;
+    it.startOnBlank = startOnBlank;
+    it.endOnBlank = endOnBlank;
   }
+  return true;
 }
 
 static std::vector<cv::Point2f> pcaPoints(const logo_detector::TrainingOutput& training) {
@@ -623,6 +1233,96 @@ static double knnAvgDistToSeedsHist(const cv::Mat& hists,
   return sum / static_cast<double>(kk);
 }
 
+// Clusters the seed histograms into (up to) `m` k-means groups in Hellinger space (element-wise
+// square roots, where L2 tracks Bhattacharyya) and keeps one medoid per group: the member with
+// the smallest total distance to the others, searched among the 32 members nearest the centroid.
+static CondensedSeeds condenseSeeds(const cv::Mat& hists, const std::vector<int>& seeds, int m) {
+  std::vector<int> valid;
+  for (int s : seeds) {
+    if (s >= 0 && s < hists.rows) valid.push_back(s);
+  }
+  CondensedSeeds out;
+  if (valid.empty()) return out;
+  const int n = static_cast<int>(valid.size());
+  cv::Mat data(n, hists.cols, CV_32F);
+  for (int r = 0; r < n; r++) {
+    const float* src = hists.ptr<float>(valid[static_cast<size_t>(r)]);
+    float* dst = data.ptr<float>(r);
+    for (int c = 0; c < hists.cols; c++) dst[c] = std::sqrt(std::max(0.0f, src[c]));
+  }
+  const int clusters = std::max(1, std::min(m, n));
+  cv::Mat labels;
+  cv::Mat centers;
+  if (clusters == 1) {
+    labels = cv::Mat::zeros(n, 1, CV_32S);
+    cv::reduce(data, centers, 0, cv::REDUCE_AVG);
+  } else {
+    cv::kmeans(data, clusters, labels,
+               cv::TermCriteria(cv::TermCriteria::EPS + cv::TermCriteria::COUNT, 30, 1e-4),
+               2, cv::KMEANS_PP_CENTERS, centers);
+  }
+
+  std::vector<std::vector<int>> members(static_cast<size_t>(clusters));  // rows of `data`
+  for (int r = 0; r < n; r++) members[static_cast<size_t>(labels.at<int>(r, 0))].push_back(r);
+
+  constexpr size_t kMedoidCandidates = 32;
+  std::vector<cv::Mat> medoidRows;
+  for (int c = 0; c < clusters; c++) {
+    auto& group = members[static_cast<size_t>(c)];
+    if (group.empty()) continue;
+    std::vector<std::pair<double, int>> byCenter;
+    for (int r : group) byCenter.emplace_back(cv::norm(data.row(r), centers.row(c), cv::NORM_L2SQR), r);
+    const size_t candidates = std::min(kMedoidCandidates, byCenter.size());
+    std::partial_sort(byCenter.begin(), byCenter.begin() + static_cast<long>(candidates), byCenter.end());
+
+    int best = byCenter[0].second;
+    double bestSum = std::numeric_limits<double>::max();
+    for (size_t j = 0; j < candidates; j++) {
+      const int cand = byCenter[j].second;
+      double sum = 0.0;
+      for (int r : group) {
+        if (r == cand) continue;
+        sum += cv::compareHist(hists.row(valid[static_cast<size_t>(cand)]), hists.row(valid[static_cast<size_t>(r)]),
+                               cv::HISTCMP_BHATTACHARYYA);
+      }
+      if (sum < bestSum) {
+        bestSum = sum;
+        best = cand;
+      }
+    }
+
+    const int pos = static_cast<int>(out.medoids.size());
+    const int medoid = valid[static_cast<size_t>(best)];
+    out.medoids.push_back(medoid);
+    out.weights.push_back(static_cast<int>(group.size()));
+    out.radius.push_back(group.size() > 1 ? bestSum / static_cast<double>(group.size() - 1) : 0.0);
+    out.positionOf[medoid] = pos;
+    for (int r : group) out.clusterOf[valid[static_cast<size_t>(r)]] = pos;
+    medoidRows.push_back(hists.row(medoid));
+  }
+  cv::vconcat(medoidRows, out.hists);
+  return out;
+}
+
+// Quantile of `values` where each counts `weights[i]` times.
+static double weightedQuantile(const std::vector<double>& values, const std::vector<int>& weights, double q) {
+  std::vector<std::pair<double, int>> v;
+  long total = 0;
+  for (size_t i = 0; i < values.size(); i++) {
+    v.emplace_back(values[i], weights[i]);
+    total += weights[i];
+  }
+  if (v.empty() || total <= 0) return 0.0;
+  std::sort(v.begin(), v.end());
+  const long target = std::llround(std::max(0.0, std::min(1.0, q)) * static_cast<double>(total - 1));
+  long seen = 0;
+  for (const auto& p : v) {
+    seen += p.second;
+    if (seen > target) return p.first;
+  }
+  return v.back().first;
+}
+
 // ---------------------------------------------------------------------------
 // Tokayo mode: MCD (Minimum Covariance Determinant) + Mahalanobis
 // ---------------------------------------------------------------------------
@@ -723,6 +1423,50 @@ static McdResult computeMCD(const std::vector<cv::Point2f>& pts, double supportF
   return result;
 }
 
+// Calibrates a cascade gate on the samples in `indices`, labelled by `isLogo`: class centers are
+// per-feature medians, the scale is the pooled median absolute deviation (at least one gray
+// level), and each radius stops 10% short of the nearest sample of the other class.
+// Returns nothing when either class has fewer than 3 samples.
+static std::optional<CascadeGate> calibrateCascade(const std::vector<logo_detector::LumaStats>& stats,
+                                                   const std::vector<char>& isLogo,
+                                                   const std::vector<int>& indices) {
+  std::vector<double> logoMeans, logoStds, noLogoMeans, noLogoStds;
+  for (int i : indices) {
+    const auto& s = stats[static_cast<size_t>(i)];
+    if (isLogo[static_cast<size_t>(i)]) {
+      logoMeans.push_back(s.mean);
+      logoStds.push_back(s.stddev);
+    } else {
+      noLogoMeans.push_back(s.mean);
+      noLogoStds.push_back(s.stddev);
+    }
+  }
+  if (logoMeans.size() < 3 || noLogoMeans.size() < 3) return std::nullopt;
+
+  CascadeGate gate;
+  gate.logoCenter = {quantile(logoMeans, 0.5), quantile(logoStds, 0.5)};
+  gate.noLogoCenter = {quantile(noLogoMeans, 0.5), quantile(noLogoStds, 0.5)};
+  std::vector<double> devMean, devStd;
+  for (int i : indices) {
+    const auto& s = stats[static_cast<size_t>(i)];
+    const auto& c = isLogo[static_cast<size_t>(i)] ? gate.logoCenter : gate.noLogoCenter;
+    devMean.push_back(std::abs(s.mean - c.mean));
+    devStd.push_back(std::abs(s.stddev - c.stddev));
+  }
+  gate.scale = {std::max(1.0, 1.4826 * quantile(devMean, 0.5)), std::max(1.0, 1.4826 * quantile(devStd, 0.5))};
+
+  double nearestNoLogo = std::numeric_limits<double>::max();
+  double nearestLogo = std::numeric_limits<double>::max();
+  for (int i : indices) {
+    const auto& s = stats[static_cast<size_t>(i)];
+    if (isLogo[static_cast<size_t>(i)]) nearestLogo = std::min(nearestLogo, gate.distance(s, gate.noLogoCenter));
+    else nearestNoLogo = std::min(nearestNoLogo, gate.distance(s, gate.logoCenter));
+  }
+  gate.logoRadius = 0.9 * nearestNoLogo;
+  gate.noLogoRadius = 0.9 * nearestLogo;
+  return gate;
+}
+
 static void printHelp() {
   std::cout
       << "Usage:\n"
@@ -730,12 +1474,23 @@ static void printHelp() {
       << "               [--roi 0.15] [--k 2] [--threads 0] [--min-ad-sec 6]\n"
       << "               [--smooth 3] [--enter-mult 1.25] [--exit-mult 1.0]\n"
       << "               [--enter-n 3] [--exit-n 5]\n"
-      << "               [--outlier] [--outlier-mode dbscan|lof|knn]\n"
+      << "               [--outlier] [--outlier-mode dbscan|lof|knn|mcd]\n"
       << "               [--dbscan-eps 0] [--dbscan-minpts 5]\n"
       << "               [--lof-k 10] [--lof-th 1.6]\n"
-      << "               [--knn-k 7] [--knn-q 0.95]\n"
-      << "               [--tokayo] [--tokayo-th 0.0]\n"
-      << "               (--tl|--tr|--bl|--br) [--debug] [--quiet]\n";
+      << "               [--knn-k 7] [--knn-q 0.95] [--knn-medoids 0]\n"
+      << "               [--knn-ann [--ann-nlist 0] [--ann-nprobe 8]]\n"
+      << "               [--mcd-support 0.75] [--mcd-th 2.72]\n"
+      << "               [--tokayo] [--tokayo-th 0.0] [--tokayo-sparse 0]\n"
+      << "               [--emit-vod-m3u8 <file>] [--remux-out <file.mp4> [--smart-cut]]\n"
+      << "               [--live-follow <sec>]\n"
+      << "               [--model-registry <dir> [--channel <id>] [--registry-k 60]]\n"
+      << "               [--train-converge 0.02] [--progress-fd <n> [--progress-ms 500]]\n"
+      << "               [--result-cache <dir>] [--kf-index <dir>] [--blank-frames] [--cascade]\n"
+      << "               [--sprites <dir> [--sprite-width 160] [--sprites-refine]]\n"
+      << "               [--flight-dump <file>] [--stall-dump-sec 0] [--sample-stall-sec 30]\n"
+      << "               (--tl|--tr|--bl|--br) [--debug] [--quiet]\n"
+      << "  ads_detector --worker <queueDir> [--lease-sec 300] [--max-jobs 0] [--poll-sec 5] [--keep-polling]\n"
+      << "  ads_detector --enqueue <queueDir> <jobId> <detector args...>\n";
 }
 
 static Args parseArgs(int argc, char** argv) {
@@ -762,6 +1517,26 @@ static Args parseArgs(int argc, char** argv) {
       a.quiet = true;
       continue;
     }
+    if (arg == "--smart-cut") {
+      a.smartCut = true;
+      continue;
+    }
+    if (arg == "--blank-frames") {
+      a.blankFrames = true;
+      continue;
+    }
+    if (arg == "--cascade") {
+      a.cascade = true;
+      continue;
+    }
+    if (arg == "--knn-ann") {
+      a.knnAnn = true;
+      continue;
+    }
+    if (arg == "--sprites-refine") {
+      a.spritesRefine = true;
+      continue;
+    }
     if (arg == "--tl") {
       if (a.cornerIndex != -1) throw std::runtime_error("only one corner flag allowed");
       a.cornerIndex = 0;
@@ -800,9 +1575,31 @@ static Args parseArgs(int argc, char** argv) {
     else if (arg == "--outlier-mode") a.outlierMode = take("--outlier-mode");
     else if (arg == "--lof-k") a.lofK = std::stoi(take("--lof-k"));
     else if (arg == "--lof-th") a.lofThreshold = std::stod(take("--lof-th"));
+    else if (arg == "--mcd-support") a.mcdSupport = std::stod(take("--mcd-support"));
+    else if (arg == "--knn-medoids") a.knnMedoids = std::stoi(take("--knn-medoids"));
+    else if (arg == "--ann-nlist") a.annNlist = std::stoi(take("--ann-nlist"));
+    else if (arg == "--ann-nprobe") a.annNprobe = std::stoi(take("--ann-nprobe"));
+    else if (arg == "--mcd-th") a.mcdThreshold = std::stod(take("--mcd-th"));
     else if (arg == "--knn-k") a.knnK = std::stoi(take("--knn-k"));
     else if (arg == "--knn-q" || arg == "--knn-quantile") a.knnQuantile = std::stod(take(arg.c_str()));
     else if (arg == "--tokayo-th") a.tokayoTh = std::stod(take("--tokayo-th"));
+    else if (arg == "--tokayo-sparse") a.tokayoSparse = std::stoi(take("--tokayo-sparse"));
+    else if (arg == "--emit-vod-m3u8") a.emitVodPath = take("--emit-vod-m3u8");
+    else if (arg == "--remux-out") a.remuxOutPath = take("--remux-out");
+    else if (arg == "--live-follow") a.liveFollowSec = std::stod(take("--live-follow"));
+    else if (arg == "--train-converge") a.trainConverge = std::stod(take("--train-converge"));
+    else if (arg == "--progress-fd") a.progressFd = std::stoi(take("--progress-fd"));
+    else if (arg == "--progress-ms") a.progressIntervalMs = std::stoi(take("--progress-ms"));
+    else if (arg == "--result-cache") a.resultCacheDir = take("--result-cache");
+    else if (arg == "--kf-index") a.kfIndexDir = take("--kf-index");
+    else if (arg == "--sprites") a.spritesDir = take("--sprites");
+    else if (arg == "--sprite-width") a.spriteWidth = std::stoi(take("--sprite-width"));
+    else if (arg == "--flight-dump") a.flightDumpPath = take("--flight-dump");
+    else if (arg == "--stall-dump-sec") a.stallDumpSec = std::stod(take("--stall-dump-sec"));
+    else if (arg == "--sample-stall-sec") a.sampleStallSec = std::stod(take("--sample-stall-sec"));
+    else if (arg == "--model-registry") a.modelRegistryDir = take("--model-registry");
+    else if (arg == "--channel") a.channel = take("--channel");
+    else if (arg == "--registry-k") a.registryProbeK = std::stoi(take("--registry-k"));
     else if (arg == "--roi" || arg == "--roi-pct") {
       double v = std::stod(take(arg.c_str()));
       if (v > 1.0) v = v / 100.0;  // allow passing 10 for 10%
@@ -844,8 +1641,30 @@ static Args parseArgs(int argc, char** argv) {
   if (a.dbscanMinPts < 2) {
     throw std::runtime_error("--dbscan-minpts must be >= 2");
   }
-  if (!a.outlierMode.empty() && a.outlierMode != "dbscan" && a.outlierMode != "lof" && a.outlierMode != "knn") {
-    throw std::runtime_error("--outlier-mode must be one of: dbscan, lof, knn");
+  if (!a.outlierMode.empty() && a.outlierMode != "dbscan" && a.outlierMode != "lof" && a.outlierMode != "knn" &&
+      a.outlierMode != "mcd") {
+    throw std::runtime_error("--outlier-mode must be one of: dbscan, lof, knn, mcd");
+  }
+  if (a.mcdSupport < 0.5 || a.mcdSupport > 1.0) {
+    throw std::runtime_error("--mcd-support must be in [0.5,1]");
+  }
+  if (!(a.mcdThreshold > 0.0)) {
+    throw std::runtime_error("--mcd-th must be > 0");
+  }
+  if (a.knnAnn && !(a.outlier && a.outlierMode == "knn")) {
+    throw std::runtime_error("--knn-ann requires --outlier --outlier-mode knn");
+  }
+  if (a.knnMedoids < 0) {
+    throw std::runtime_error("--knn-medoids must be >= 0 (0 = keep every seed)");
+  }
+  if (a.knnMedoids > 0 && !(a.outlier && a.outlierMode == "knn")) {
+    throw std::runtime_error("--knn-medoids requires --outlier --outlier-mode knn");
+  }
+  if (a.annNlist < 0) {
+    throw std::runtime_error("--ann-nlist must be >= 0 (0 = auto)");
+  }
+  if (a.annNprobe < 1) {
+    throw std::runtime_error("--ann-nprobe must be >= 1");
   }
   if (a.lofK < 2) {
     throw std::runtime_error("--lof-k must be >= 2");
@@ -865,45 +1684,714 @@ static Args parseArgs(int argc, char** argv) {
   if (a.tokayoTh < 0.0 || a.tokayoTh > 1.0) {
     throw std::runtime_error("--tokayo-th must be in [0,1] (0 = auto-detect)");
   }
-  return a;
-}
+  if (a.tokayoSparse < 0 || a.tokayoSparse > 4096) {
+    throw std::runtime_error("--tokayo-sparse must be in [0,4096] (0 = template NCC)");
+  }
+  if (a.tokayoSparse > 0 && !a.tokayo) {
+    throw std::runtime_error("--tokayo-sparse requires --tokayo");
+  }
+  if (a.smartCut && a.remuxOutPath.empty()) {
+    throw std::runtime_error("--smart-cut requires --remux-out");
+  }
+  if (a.liveFollowSec < 0.0) {
+    throw std::runtime_error("--live-follow must be >= 0");
+  }
+  if (a.registryProbeK < 5) {
+    throw std::runtime_error("--registry-k must be >= 5");
+  }
+  if (a.trainConverge < 0.0 || a.trainConverge >= 1.0) {
+    throw std::runtime_error("--train-converge must be in [0,1) (0 = train on every sample)");
+  }
+  if (a.spriteWidth < 16) {
+    throw std::runtime_error("--sprite-width must be >= 16");
+  }
+  if (a.spritesRefine && a.spritesDir.empty()) {
+    throw std::runtime_error("--sprites-refine requires --sprites");
+  }
+  if (a.stallDumpSec < 0.0) {
+    throw std::runtime_error("--stall-dump-sec must be >= 0 (0 = off)");
+  }
+  if (a.sampleStallSec < 0.0) {
+    throw std::runtime_error("--sample-stall-sec must be >= 0 (0 = off)");
+  }
+  if (a.progressFd >= 0 && ::fcntl(a.progressFd, F_GETFD) == -1) {
+    throw std::runtime_error("--progress-fd " + std::to_string(a.progressFd) + " is not an open file descriptor");
+  }
+  if (a.progressIntervalMs < 50) {
+    throw std::runtime_error("--progress-ms must be >= 50");
+  }
+  return a;
+}
+
+// --- Worker mode: pull hour-block jobs from a shared lease-file queue (see job_queue.h) ---
+
+struct WorkerArgs {
+  std::string queueDir;
+  int leaseSec = 300;       // renewed every leaseSec/3 while the job runs
+  int maxJobs = 0;          // 0 = no limit
+  int pollSec = 5;          // wait between polls while other workers hold leases
+  bool keepPolling = false; // keep waiting for new jobs once the queue drains
+};
+
+static volatile std::sig_atomic_t g_workerStop = 0;
+
+static void onWorkerSignal(int) { g_workerStop = 1; }
+
+static void workerLog(const std::string& msg) {
+  std::cerr << "[" << nowStamp() << "] ads_detector worker: " << msg << "\n";
+}
+
+static std::optional<WorkerArgs> parseWorkerArgs(int argc, char** argv) {
+  if (argc < 2 || std::string(argv[1]) != "--worker") return std::nullopt;
+  WorkerArgs w;
+  for (int i = 1; i < argc; i++) {
+    const std::string arg(argv[i]);
+    auto take = [&](const char* name) -> std::string {
+      if (i + 1 >= argc) throw std::runtime_error(std::string("missing value for ") + name);
+      return std::string(argv[++i]);
+    };
+    if (arg == "--worker") w.queueDir = take("--worker");
+    else if (arg == "--lease-sec") w.leaseSec = std::stoi(take("--lease-sec"));
+    else if (arg == "--max-jobs") w.maxJobs = std::stoi(take("--max-jobs"));
+    else if (arg == "--poll-sec") w.pollSec = std::stoi(take("--poll-sec"));
+    else if (arg == "--keep-polling") w.keepPolling = true;
+    else throw std::runtime_error("unknown worker argument: " + arg);
+  }
+  if (w.leaseSec < 15) throw std::runtime_error("--lease-sec must be >= 15");
+  if (w.maxJobs < 0) throw std::runtime_error("--max-jobs must be >= 0");
+  if (w.pollSec < 1) throw std::runtime_error("--poll-sec must be >= 1");
+  return w;
+}
+
+// Runs one job as a child detector process, renewing the lease until it exits.
+// Returns the wait status, or nullopt when the lease was lost or the worker is stopping.
+static std::optional<int> runLeasedJob(const WorkerArgs& w,
+                                       const std::string& owner,
+                                       const std::string& self,
+                                       const job_queue::Job& job) {
+  std::vector<std::string> childArgs;
+  childArgs.push_back(self);
+  childArgs.insert(childArgs.end(), job.args.begin(), job.args.end());
+  childArgs.push_back("--output");
+  childArgs.push_back(job_queue::resultTmpPath(w.queueDir, job.id, owner));
+  std::vector<char*> argvChild;
+  for (auto& a : childArgs) argvChild.push_back(a.data());
+  argvChild.push_back(nullptr);
+
+  const pid_t pid = ::fork();
+  if (pid < 0) throw std::runtime_error("fork failed");
+  if (pid == 0) {
+    // The result goes to --output; the copy on stdout is not needed.
+    const int devNull = ::open("/dev/null", O_WRONLY);
+    if (devNull >= 0) ::dup2(devNull, STDOUT_FILENO);
+    ::execv(self.c_str(), argvChild.data());
+    ::_exit(127);
+  }
+
+  const auto renewEvery = std::chrono::seconds(std::max(5, w.leaseSec / 3));
+  auto nextRenew = std::chrono::steady_clock::now() + renewEvery;
+  while (true) {
+    int status = 0;
+    const pid_t r = ::waitpid(pid, &status, WNOHANG);
+    if (r == pid) return status;
+    if (r < 0 && errno != EINTR) throw std::runtime_error("waitpid failed");
+    bool abandon = g_workerStop != 0;
+    if (!abandon && std::chrono::steady_clock::now() >= nextRenew) {
+      if (!job_queue::renew(w.queueDir, job.id, owner, w.leaseSec)) {
+        workerLog("lease perdido para " + job.id + "; abortando");
+        abandon = true;
+      }
+      nextRenew = std::chrono::steady_clock::now() + renewEvery;
+    }
+    if (abandon) {
+      ::kill(pid, SIGTERM);
+      ::waitpid(pid, &status, 0);
+      return std::nullopt;
+    }
+    std::this_thread::sleep_for(std::chrono::milliseconds(250));
+  }
+}
+
+static int runWorker(const WorkerArgs& w, const char* argv0) {
+  try {
+    job_queue::init(w.queueDir);
+    std::error_code ec;
+    const fs::path selfExe = fs::read_symlink("/proc/self/exe", ec);
+    const std::string self = ec ? std::string(argv0) : selfExe.string();
+    char host[256] = {0};
+    ::gethostname(host, sizeof(host) - 1);
+    const std::string owner = std::string(host[0] ? host : "worker") + ":" + std::to_string(::getpid());
+
+    struct sigaction sa {};
+    sa.sa_handler = onWorkerSignal;
+    ::sigaction(SIGTERM, &sa, nullptr);
+    ::sigaction(SIGINT, &sa, nullptr);
+
+    workerLog("cola=" + w.queueDir + ", id=" + owner + ", lease=" + std::to_string(w.leaseSec) + "s");
+    int jobsDone = 0;
+    while (!g_workerStop && (w.maxJobs == 0 || jobsDone < w.maxJobs)) {
+      const size_t requeued = job_queue::requeueExpired(w.queueDir);
+      if (requeued > 0) workerLog("re-encolados por lease vencido: " + std::to_string(requeued));
+
+      const auto job = job_queue::claim(w.queueDir, owner, w.leaseSec);
+      if (!job) {
+        if (!w.keepPolling && job_queue::pendingCount(w.queueDir) == 0 && job_queue::leasedCount(w.queueDir) == 0) {
+          workerLog("cola vacia");
+          break;
+        }
+        // Other workers hold the rest; wait in case one of them dies and its lease expires.
+        for (int i = 0; i < w.pollSec * 4 && !g_workerStop; i++) {
+          std::this_thread::sleep_for(std::chrono::milliseconds(250));
+        }
+        continue;
+      }
+
+      workerLog("job " + job->id + " (" + std::to_string(job->args.size()) + " args)");
+      const auto t0 = std::chrono::steady_clock::now();
+      const auto status = runLeasedJob(w, owner, self, *job);
+      const int64_t elapsedMs =
+          std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - t0).count();
+      if (!status) {
+        // Stopping: hand the job back right away instead of waiting for the lease to expire.
+        if (g_workerStop) job_queue::fail(w.queueDir, job->id, owner, elapsedMs, "worker stopped", true);
+        continue;
+      }
+      if (WIFEXITED(*status) && WEXITSTATUS(*status) == 0) {
+        if (job_queue::complete(w.queueDir, job->id, owner, elapsedMs)) {
+          workerLog("job " + job->id + " ok (" + std::to_string(elapsedMs) + " ms)");
+        }
+      } else {
+        const std::string reason = WIFEXITED(*status) ? "exit code " + std::to_string(WEXITSTATUS(*status))
+                                                      : "signal " + std::to_string(WTERMSIG(*status));
+        job_queue::fail(w.queueDir, job->id, owner, elapsedMs, reason, false);
+        workerLog("job " + job->id + " fallo: " + reason);
+      }
+      jobsDone++;
+    }
+    workerLog("fin, jobs=" + std::to_string(jobsDone));
+    return 0;
+  } catch (const std::exception& e) {
+    std::cerr << "ads_detector worker error: " << e.what() << "\n";
+    return 1;
+  }
+}
+
+// ads_detector --enqueue <queueDir> <jobId> <detector args...>
+static int runEnqueue(int argc, char** argv) {
+  try {
+    if (argc < 5) throw std::runtime_error("usage: --enqueue <queueDir> <jobId> <detector args...>");
+    job_queue::init(argv[2]);
+    job_queue::enqueue(argv[2], argv[3], std::vector<std::string>(argv + 4, argv + argc));
+    return 0;
+  } catch (const std::exception& e) {
+    std::cerr << "ads_detector error: " << e.what() << "\n";
+    return 1;
+  }
+}
+
+// Runs with side outputs (debug export, VOD, remux, sprites) or live follow always run for real.
+static bool resultCacheable(const Args& a) {
+  return !a.resultCacheDir.empty() && !a.debug && a.emitVodPath.empty() && a.remuxOutPath.empty() &&
+         a.spritesDir.empty() && a.liveFollowSec <= 0.0;
+}
+
+// Everything the output JSON depends on: the playlist as parsed, every detection parameter and
+// the stored models. Threads, paths and logging options are left out.
+static std::string resultCacheCanonical(const Args& a, const std::vector<m3u8::Segment>& segments) {
+  std::ostringstream c;
+  c << std::setprecision(17);
+  c << "version=" << kResultCacheVersion << "\n";
+  c << "m3u8=" << a.m3u8 << "\n";
+  c << "params=" << a.sampleEverySec << ',' << a.roiWidthPct << ',' << a.k << ',' << a.minAdSec << ','
+    << a.smoothWindow << ',' << a.enterMult << ',' << a.exitMult << ',' << a.enterConsecutive << ','
+    << a.exitConsecutive << ',' << a.outlier << ',' << a.outlierMode << ',' << a.dbscanEps << ','
+    << a.dbscanMinPts << ',' << a.lofK << ',' << a.lofThreshold << ',' << a.knnK << ',' << a.knnQuantile << ','
+    << a.mcdSupport << ',' << a.mcdThreshold << ',' << a.knnAnn << ',' << a.annNlist << ',' << a.annNprobe << ','
+    << a.knnMedoids << ','
+    << a.tokayo << ',' << a.tokayoTh << ',' << a.tokayoSparse << ',' << a.cornerIndex << ',' << a.trainConverge << ','
+    << !a.kfIndexDir.empty() << ',' << a.blankFrames << ',' << a.cascade << ',' << a.sampleStallSec << "\n";
+  if (!a.modelRegistryDir.empty()) {
+    const std::string channel = a.channel.empty() ? model_registry::channelKey(a.m3u8) : a.channel;
+    c << "registry=" << channel << ',' << a.registryProbeK << ','
+      << model_registry::fingerprint(a.modelRegistryDir, channel) << "\n";
+  }
+  for (const auto& seg : segments) {
+    c << seg.uri << '|' << seg.durationSec << '|' << seg.programDateTime << '|' << seg.byteRangeLength << '|'
+      << seg.byteRangeOffset << '|' << seg.mapUri << '|' << seg.discontinuity << "\n";
+  }
+  return c.str();
+}
+
+// The "process" and "keyframeIndex" entries: measurements of this invocation, not of the result,
+// so a result cache hit rewrites them instead of replaying the stored run's.
+static void writeRunStats(std::ostream& json, const Args& args, int64_t elapsedMs,
+                          const std::optional<int64_t>& startupMs, int64_t firstSampleMs,
+                          const keyframe_index::Index* kfIndex) {
+  json << "  \"process\": {\n";
+  json << "    \"elapsedMs\": " << elapsedMs << ",\n";
+  json << "    \"elapsedSec\": " << static_cast<double>(elapsedMs) / 1000.0 << ",\n";
+  json << "    \"startupMs\": ";
+  if (startupMs.has_value()) json << *startupMs;
+  else json << "null";
+  json << ",\n";
+  json << "    \"firstSampleMs\": " << firstSampleMs << "\n";
+  json << "  },\n";
+  json << "  \"keyframeIndex\": ";
+  if (kfIndex) {
+    json << "{\"dir\": ";
+    json_util::writeString(json, args.kfIndexDir);
+    json << ", \"built\": " << kfIndex->built() << ", \"loaded\": " << kfIndex->loaded()
+         << ", \"directReads\": " << kfIndex->directReads() << ", \"failedReads\": " << kfIndex->failedReads() << "}";
+  } else {
+    json << "null";
+  }
+  json << ",\n";
+}
+
+static void writeOutputJson(const Args& args, const std::string& jsonStr) {
+  const fs::path outPath(args.outputPath);
+  ensureParentDirExists(outPath);
+  std::ofstream out(outPath);
+  if (!out.is_open()) throw std::runtime_error("could not open output file: " + args.outputPath);
+  progress(args, "Escribiendo salida JSON en: " + args.outputPath);
+  out << jsonStr;
+  out.close();
+}
+
+static std::string cornerName(int idx) {
+  switch (idx) {
+    case 0: return "top_left";
+    case 1: return "top_right";
+    case 2: return "bottom_left";
+    case 3: return "bottom_right";
+    default: return "top_left";
+  }
+}
+
+static fs::path executableDir() {
+  std::error_code ec;
+  const auto p = fs::read_symlink("/proc/self/exe", ec);
+  if (!ec) return p.parent_path();
+  return fs::current_path();
+}
+
+// Complement of the ad intervals over [0, totalDurationSec].
+template <typename IntervalT>
+static std::vector<m3u8::TimeRange> keptRanges(const std::vector<IntervalT>& ads, double totalDurationSec) {
+  std::vector<m3u8::TimeRange> kept;
+  double cursor = 0.0;
+  for (const auto& it : ads) {
+    if (it.startSec > cursor) kept.push_back(m3u8::TimeRange{cursor, it.startSec});
+    cursor = std::max(cursor, it.endSec);
+  }
+  if (cursor < totalDurationSec) kept.push_back(m3u8::TimeRange{cursor, totalDurationSec});
+  return kept;
+}
+
+static std::optional<int64_t> offsetToEpochMs(
+    const std::vector<m3u8::Segment>& segments,
+    const std::vector<std::optional<int64_t>>& segEpochMs,
+    double offsetSec) {
+  if (segments.empty()) return std::nullopt;
+  if (offsetSec < 0) return std::nullopt;
+  if (offsetSec > segments.back().endOffsetSec) offsetSec = segments.back().endOffsetSec;
+
+  int lo = 0, hi = static_cast<int>(segments.size()) - 1;
+  while (lo < hi) {
+    const int mid = (lo + hi) / 2;
+    if (offsetSec < segments[mid].endOffsetSec) hi = mid;
+    else lo = mid + 1;
+  }
+  const auto& seg = segments[lo];
+  if (!segEpochMs[lo].has_value()) return std::nullopt;
+  const double within = offsetSec - seg.startOffsetSec;
+  return segEpochMs[lo].value() + static_cast<int64_t>(within * 1000.0);
+}
+
+static std::optional<std::string> offsetToProgramDateTime(
+    const std::vector<m3u8::Segment>& segments,
+    const std::vector<std::optional<int64_t>>& segEpochMs,
+    double offsetSec) {
+  const auto ms = offsetToEpochMs(segments, segEpochMs, offsetSec);
+  if (!ms.has_value()) return std::nullopt;
+  return time_util::epochMsToIso8601Utc(ms.value());
+}
+
+struct LiveEvent {
+  bool adStart = true;
+  double offsetSec = 0.0;
+  std::optional<std::string> pdt;
+  double latencySec = -1.0;  // wall clock at detection minus the sample's PDT (-1 = no PDT)
+  double durationSec = 0.0;  // adEnd only
+};
+
+struct LiveStats {
+  double followedSec = 0.0;
+  bool lowLatency = false;      // playlist advertises EXT-X-PART
+  bool blockingReload = false;  // _HLS_msn/_HLS_part requests were used
+  size_t reloads = 0;
+  size_t partsSampled = 0;
+  size_t segmentsSampled = 0;
+  size_t prefetchHits = 0;
+  size_t decodeFailures = 0;
+  std::vector<LiveEvent> events;
+  std::string error;
+};
+
+static bool decodeFirstFrame(const std::string& bytes, const fs::path& tmpPath, cv::Mat& outFrame) {
+  {
+    std::ofstream f(tmpPath, std::ios::binary | std::ios::trunc);
+    if (!f.is_open()) return false;
+    f.write(bytes.data(), static_cast<std::streamsize>(bytes.size()));
+  }
+  cv::VideoCapture cap(tmpPath.string());
+  if (!cap.isOpened()) return false;
+  return cap.read(outFrame) && !outFrame.empty();
+}
+
+// One long-lived thread that fetches LL-HLS preload hints ahead of time. A newer hint replaces one
+// that has not started; one already in flight runs out in the background without blocking the
+// follow loop. A single thread also keeps the flight recorder to one ring for all hint fetches.
+class HintFetcher {
+ public:
+  using Fetch = std::function<std::string(const std::string& uri, int64_t offset, int64_t length, long timeoutSec)>;
+
+  explicit HintFetcher(Fetch fetch) : fetch_(std::move(fetch)), thread_([this] { run(); }) {}
+
+  ~HintFetcher() {
+    {
+      std::lock_guard<std::mutex> lock(mu_);
+      closed_ = true;
+      queued_.reset();
+    }
+    cv_.notify_all();
+    thread_.join();  // Waits out a held request, at most its timeout.
+  }
+
+  HintFetcher(const HintFetcher&) = delete;
+  HintFetcher& operator=(const HintFetcher&) = delete;
+
+  void request(std::string key, std::string uri, int64_t offset, int64_t length, long timeoutSec) {
+    {
+      std::lock_guard<std::mutex> lock(mu_);
+      queued_ = Request{std::move(key), std::move(uri), offset, length, timeoutSec};
+    }
+    cv_.notify_all();
+  }
+
+  // Bytes fetched for `key`, waiting if that fetch is running; nullopt when `key` was not
+  // requested, was replaced, failed, or has not started yet (it is then dropped and the caller
+  // fetches the part itself rather than queue behind an older held request).
+  std::optional<std::string> take(const std::string& key) {
+    std::unique_lock<std::mutex> lock(mu_);
+    if (queued_ && queued_->key == key) {
+      queued_.reset();
+      return std::nullopt;
+    }
+    cv_.wait(lock, [&] { return inFlightKey_ != key; });
+    if (doneKey_ != key || !done_) return std::nullopt;
+    doneKey_.clear();
+    auto bytes = std::move(done_);
+    done_.reset();
+    return bytes;
+  }
+
+ private:
+  struct Request {
+    std::string key;
+    std::string uri;
+    int64_t offset = -1;
+    int64_t length = -1;
+    long timeoutSec = 20;
+  };
+
+  void run() {
+    std::unique_lock<std::mutex> lock(mu_);
+    for (;;) {
+      cv_.wait(lock, [&] { return closed_ || queued_; });
+      if (!queued_) return;
+      Request req = std::move(*queued_);
+      queued_.reset();
+      inFlightKey_ = req.key;
+      lock.unlock();
+      std::optional<std::string> bytes;
+      try {
+        bytes = fetch_(req.uri, req.offset, req.length, req.timeoutSec);
+      } catch (const std::exception&) {
+      }
+      lock.lock();
+      inFlightKey_.clear();
+      doneKey_ = req.key;
+      done_ = std::move(bytes);
+      cv_.notify_all();
+    }
+  }
 
-static std::string cornerName(int idx) {
-  switch (idx) {
-    case 0: return "top_left";
-    case 1: return "top_right";
-    case 2: return "bottom_left";
-    case 3: return "bottom_right";
-    default: return "top_left";
+  const Fetch fetch_;
+  std::mutex mu_;
+  std::condition_variable cv_;
+  std::optional<Request> queued_;
+  std::string inFlightKey_;
+  std::string doneKey_;
+  std::optional<std::string> done_;
+  bool closed_ = false;
+  std::thread thread_;  // Last: started once the members above exist.
+};
+
+// Follows a live playlist after batch detection, classifying each new partial segment
+// (LL-HLS) or segment with the trained model. Ad starts/ends are reported as soon as the
+// enter/exit streaks are met. Offsets continue the batch timeline.
+static LiveStats followLive(const Args& args,
+                            const m3u8::Playlist& initial,
+                            const logo_detector::LogoModel& model,
+                            const TokayoModel* tokayo,
+                            const McdModel* mcd,
+                            const CascadeGate* gate,
+                            const KnnModel* knn,
+                            const SlotSchedule* schedule,
+                            bool startInAd,
+                            double adStartSec,
+                            progress_reporter::Counters& counters) {
+  LiveStats stats;
+  const bool isHttp = startsWith(args.m3u8, "http://") || startsWith(args.m3u8, "https://");
+  const auto followStart = std::chrono::steady_clock::now();
+  const auto deadline = followStart + std::chrono::milliseconds(static_cast<int64_t>(args.liveFollowSec * 1000.0));
+  const fs::path tmpPath = fs::temp_directory_path() / ("ads_detector_live_" + std::to_string(::getpid()));
+
+  // Timeline: start offset per media sequence number, seeded from the batch playlist.
+  std::map<int64_t, double> msnStart;
+  for (size_t i = 0; i < initial.segments.size(); i++) {
+    msnStart[initial.mediaSequence + static_cast<int64_t>(i)] = initial.segments[i].startOffsetSec;
   }
-}
+  msnStart[initial.nextMediaSequence()] = m3u8::totalDuration(initial.segments);
+
+  // PDT anchor (offset, epoch) from the latest segment that carried its own tag.
+  std::optional<std::pair<double, int64_t>> pdtAnchor;
+  auto updateTimeline = [&](const m3u8::Playlist& pl) {
+    for (size_t i = 0; i < pl.segments.size(); i++) {
+      const auto& seg = pl.segments[i];
+      const int64_t msn = pl.mediaSequence + static_cast<int64_t>(i);
+      // Fell behind the sliding window: continue from the furthest known offset.
+      if (!msnStart.count(msn)) msnStart[msn] = msnStart.rbegin()->second;
+      if (!msnStart.count(msn + 1)) msnStart[msn + 1] = msnStart[msn] + seg.durationSec;
+      int64_t epochMs = 0;
+      const bool ownTag = (i == 0 || pl.segments[i - 1].programDateTime != seg.programDateTime);
+      if (ownTag && !seg.programDateTime.empty() &&
+          time_util::parseIso8601LikeToEpochMs(seg.programDateTime, &epochMs)) {
+        pdtAnchor = std::make_pair(msnStart[msn], epochMs);
+      }
+    }
+    if (!msnStart.count(pl.nextMediaSequence())) msnStart[pl.nextMediaSequence()] = msnStart.rbegin()->second;
+  };
+  auto epochAt = [&](double offsetSec) -> std::optional<int64_t> {
+    if (!pdtAnchor) return std::nullopt;
+    return pdtAnchor->second + static_cast<int64_t>(std::llround((offsetSec - pdtAnchor->first) * 1000.0));
+  };
+  updateTimeline(initial);
+
+  std::unordered_map<std::string, std::string> initCache;
+  // Unarmed for the stall watchdog: preload hints are held by the server on purpose.
+  auto fetchHeld = [&](const std::string& uri, int64_t offset, int64_t length, long timeoutSec) -> std::string {
+    const std::string url = m3u8::resolveUri(args.m3u8, uri);
+    if (isHttp) return (offset >= 0) ? http::getRange(url, offset, length, timeoutSec) : http::get(url, timeoutSec);
+    const std::string all = readFile(url);
+    if (offset < 0) return all;
+    const size_t from = std::min(all.size(), static_cast<size_t>(offset));
+    return all.substr(from, length < 0 ? std::string::npos : static_cast<size_t>(length));
+  };
+  auto fetchMedia = [&](const std::string& uri, int64_t offset, int64_t length, long timeoutSec) {
+    flight_recorder::IoWait io;
+    return fetchHeld(uri, offset, length, timeoutSec);
+  };
 
-static fs::path executableDir() {
-  std::error_code ec;
-  const auto p = fs::read_symlink("/proc/self/exe", ec);
-  if (!ec) return p.parent_path();
-  return fs::current_path();
-}
+  // The preload hint is requested ahead of time; the server answers once the part exists.
+  HintFetcher hints(fetchHeld);
+  std::string hintKey;
+  auto partKey = [](const std::string& uri, int64_t offset) { return uri + "@" + std::to_string(offset); };
+
+  bool inAd = startInAd;
+  double adStart = adStartSec;
+  int noLogoStreak = 0;
+  int logoStreak = 0;
+  double startCandidate = 0.0;
+  double exitCandidate = 0.0;
+
+  auto emit = [&](bool isStart, double offsetSec, double durationSec) {
+    LiveEvent ev;
+    ev.adStart = isStart;
+    ev.offsetSec = offsetSec;
+    ev.durationSec = durationSec;
+    if (const auto epochMs = epochAt(offsetSec)) {
+      ev.pdt = time_util::epochMsToIso8601Utc(*epochMs);
+      const int64_t nowMs = std::chrono::duration_cast<std::chrono::milliseconds>(
+                                std::chrono::system_clock::now().time_since_epoch()).count();
+      ev.latencySec = static_cast<double>(nowMs - *epochMs) / 1000.0;
+    }
+    progress(args, std::string("Live: ") + (isStart ? "inicio de ad en " : "fin de ad en ") +
+                       formatSec(offsetSec) + " (" + formatHms(offsetSec) + ")" +
+                       (ev.latencySec >= 0.0 ? ", latencia=" + formatSec(ev.latencySec) : ""));
+    stats.events.push_back(std::move(ev));
+  };
 
-static std::optional<std::string> offsetToProgramDateTime(
-    const std::vector<m3u8::Segment>& segments,
-    const std::vector<std::optional<int64_t>>& segEpochMs,
-    double offsetSec) {
-  if (segments.empty()) return std::nullopt;
-  if (offsetSec < 0) return std::nullopt;
-  if (offsetSec > segments.back().endOffsetSec) offsetSec = segments.back().endOffsetSec;
+  auto classify = [&](bool logoNow, double offsetSec) {
+    if (!inAd) {
+      if (!logoNow) {
+        if (noLogoStreak == 0) startCandidate = offsetSec;
+        noLogoStreak++;
+      } else {
+        noLogoStreak = 0;
+      }
+      if (noLogoStreak >= args.enterConsecutive) {
+        inAd = true;
+        adStart = startCandidate;
+        noLogoStreak = 0;
+        logoStreak = 0;
+        emit(true, adStart, 0.0);
+      }
+    } else {
+      if (logoNow) {
+        if (logoStreak == 0) exitCandidate = offsetSec;
+        logoStreak++;
+      } else {
+        logoStreak = 0;
+      }
+      if (logoStreak >= args.exitConsecutive) {
+        inAd = false;
+        logoStreak = 0;
+        emit(false, exitCandidate, exitCandidate - adStart);
+      }
+    }
+  };
 
-  int lo = 0, hi = static_cast<int>(segments.size()) - 1;
-  while (lo < hi) {
-    const int mid = (lo + hi) / 2;
-    if (offsetSec < segments[mid].endOffsetSec) hi = mid;
-    else lo = mid + 1;
+  // Cursor: next (media sequence, part index) not yet considered.
+  int64_t cursorMsn = initial.nextMediaSequence();
+  int cursorPart = 0;
+  auto before = [&](int64_t msn, int part) {
+    return msn < cursorMsn || (msn == cursorMsn && part < cursorPart);
+  };
+
+  m3u8::Playlist latest = initial;
+  int consecutiveErrors = 0;
+  try {
+    while (std::chrono::steady_clock::now() < deadline && !latest.endList) {
+      stats.lowLatency = stats.lowLatency || latest.partTargetSec > 0.0;
+      const bool lowLatency = latest.partTargetSec > 0.0 && !latest.parts.empty();
+
+      // Sample new units: independent parts when the playlist has them, otherwise whole segments.
+      std::unordered_map<int64_t, double> partOffsetInSeg;
+      std::unordered_set<int64_t> msnWithParts;
+      for (const auto& part : latest.parts) msnWithParts.insert(part.mediaSequence);
+      std::string mapUri = latest.segments.empty() ? std::string() : latest.segments.back().mapUri;
+
+      auto sampleBytes = [&](const std::string& bytes, double offsetSec, bool isPart) {
+        std::string media = bytes;
+        if (!mapUri.empty()) {
+          auto it = initCache.find(mapUri);
+          if (it == initCache.end()) it = initCache.emplace(mapUri, fetchMedia(mapUri, -1, -1, 20)).first;
+          media = it->second + bytes;
+        }
+        cv::Mat frame;
+        if (!decodeFirstFrame(media, tmpPath, frame)) {
+          stats.decodeFailures++;
+          return;
+        }
+        (isPart ? stats.partsSampled : stats.segmentsSampled)++;
+        counters.liveSampled.fetch_add(1, std::memory_order_relaxed);
+        const auto epochMs = epochAt(offsetSec);
+        classify(frameHasLogo(frame, args, schedule ? schedule->histFor(epochMs, model) : model,
+                              schedule ? schedule->tokayoFor(epochMs, tokayo) : tokayo, mcd, gate, knn),
+                 offsetSec);
+      };
+
+      for (size_t i = 0; i < latest.segments.size(); i++) {
+        const int64_t msn = latest.mediaSequence + static_cast<int64_t>(i);
+        if (msnWithParts.count(msn) || before(msn, 0)) continue;
+        const auto& seg = latest.segments[i];
+        mapUri = seg.mapUri;
+        sampleBytes(fetchMedia(seg.uri, seg.byteRangeOffset, seg.byteRangeLength, 20), msnStart[msn], false);
+        cursorMsn = msn + 1;
+        cursorPart = 0;
+      }
+      for (const auto& part : latest.parts) {
+        const double offsetSec = msnStart[part.mediaSequence] + partOffsetInSeg[part.mediaSequence];
+        partOffsetInSeg[part.mediaSequence] += part.durationSec;
+        if (before(part.mediaSequence, part.partIndex)) continue;
+        cursorMsn = part.mediaSequence;
+        cursorPart = part.partIndex + 1;
+        if (part.gap || !(part.independent || part.partIndex == 0)) continue;
+        std::string bytes;
+        if (hintKey == partKey(part.uri, part.byteRangeOffset)) {
+          if (auto prefetched = hints.take(hintKey)) {
+            bytes = std::move(*prefetched);
+            if (part.byteRangeLength >= 0 && static_cast<int64_t>(bytes.size()) > part.byteRangeLength) {
+              bytes.resize(static_cast<size_t>(part.byteRangeLength));
+            }
+            stats.prefetchHits++;
+          }
+        }
+        if (bytes.empty()) bytes = fetchMedia(part.uri, part.byteRangeOffset, part.byteRangeLength, 20);
+        sampleBytes(bytes, offsetSec, true);
+      }
+
+      const long holdTimeoutSec = static_cast<long>(std::ceil(3.0 * std::max(1.0, latest.targetDurationSec))) + 5;
+      const auto& hint = latest.preloadHint;
+      // Only prefetch a hinted part the loop above will sample. The hint carries no INDEPENDENT
+      // attribute: a segment's first part always qualifies, later ones only when every later part
+      // advertised so far was independent.
+      const bool hintStartsSegment = cursorMsn < latest.nextMediaSequence() || cursorPart == 0;
+      bool laterPartsIndependent = false;
+      for (const auto& part : latest.parts) {
+        if (part.partIndex == 0) continue;
+        laterPartsIndependent = part.independent;
+        if (!part.independent) break;
+      }
+      const bool hintSampled = hintStartsSegment || laterPartsIndependent;
+      if (lowLatency && isHttp && hint.type == "PART" && hintSampled &&
+          hintKey != partKey(hint.uri, hint.byteRangeStart)) {
+        hintKey = partKey(hint.uri, hint.byteRangeStart);
+        hints.request(hintKey, hint.uri, hint.byteRangeStart, hint.byteRangeLength, holdTimeoutSec);
+      }
+
+      // Reload: block until the next part/segment exists when the server supports it, else poll.
+      const bool blocking = isHttp && latest.canBlockReload;
+      std::string reloadUrl = args.m3u8;
+      if (blocking) {
+        stats.blockingReload = true;
+        int64_t wantMsn = latest.nextMediaSequence();
+        int wantPart = -1;
+        if (lowLatency) {
+          wantPart = 0;
+          for (const auto& part : latest.parts) {
+            if (part.mediaSequence == wantMsn) wantPart = std::max(wantPart, part.partIndex + 1);
+          }
+        }
+        reloadUrl = m3u8::blockingReloadUrl(args.m3u8, wantMsn, wantPart);
+      } else {
+        const double waitSec = lowLatency ? latest.partTargetSec : std::max(1.0, latest.targetDurationSec / 2.0);
+        std::this_thread::sleep_for(std::chrono::milliseconds(static_cast<int64_t>(waitSec * 1000.0)));
+      }
+      try {
+        latest = m3u8::parsePlaylist(isHttp ? http::get(reloadUrl, holdTimeoutSec) : readFile(reloadUrl));
+        stats.reloads++;
+        consecutiveErrors = 0;
+        updateTimeline(latest);
+      } catch (const std::exception& e) {
+        if (++consecutiveErrors >= 5) throw;
+        progress(args, std::string("Live: error recargando playlist: ") + e.what());
+        std::this_thread::sleep_for(std::chrono::seconds(1));
+      }
+    }
+  } catch (const std::exception& e) {
+    stats.error = e.what();
+    flight_recorder::record(flight_recorder::Kind::Error, 0, 0, 0, e.what());
+    progress(args, "Live: abortado: " + stats.error);
   }
-  const auto& seg = segments[lo];
-  if (!segEpochMs[lo].has_value()) return std::nullopt;
-  const double within = offsetSec - seg.startOffsetSec;
-  const int64_t ms = segEpochMs[lo].value() + static_cast<int64_t>(within * 1000.0);
-  return time_util::epochMsToIso8601Utc(ms);
+
+  std::error_code ec;
+  fs::remove(tmpPath, ec);
+  stats.followedSec = std::chrono::duration_cast<std::chrono::milliseconds>(
+                          std::chrono::steady_clock::now() - followStart).count() / 1000.0;
+  return stats;
 }
 
 static void exportDebugLogos(const Args& args,
@@ -1221,23 +2709,112 @@ static void exportDebugPcaTokayoPlot(const fs::path& outDir,
   cv::imwrite(pngPath.string(), img);
 }
 
+// Milliseconds between exec() and now, from the process start time in /proc/self/stat (clock
+// ticks since boot, usually 10 ms). Covers the dynamic loader and static initializers that run
+// before main(). nullopt off Linux.
+static std::optional<int64_t> msSinceExec() {
+  std::ifstream in("/proc/self/stat");
+  std::string stat;
+  if (!std::getline(in, stat)) return std::nullopt;
+  // Fields after the ")" closing the command name start at field 3; starttime is field 22.
+  const size_t close = stat.rfind(')');
+  if (close == std::string::npos) return std::nullopt;
+  std::istringstream fields(stat.substr(close + 1));
+  std::string field;
+  for (int i = 3; i <= 22; i++) {
+    if (!(fields >> field)) return std::nullopt;
+  }
+  const long ticksPerSec = ::sysconf(_SC_CLK_TCK);
+  timespec boot{};
+  if (ticksPerSec <= 0 || ::clock_gettime(CLOCK_BOOTTIME, &boot) != 0) return std::nullopt;
+  const int64_t startMs = std::stoll(field) * 1000 / ticksPerSec;
+  const int64_t nowMs = static_cast<int64_t>(boot.tv_sec) * 1000 + boot.tv_nsec / 1000000;
+  return std::max<int64_t>(0, nowMs - startMs);
+}
+
 int main(int argc, char** argv) {
   const auto processStart = std::chrono::steady_clock::now();
+  const std::optional<int64_t> startupMs = msSinceExec();
+  if (argc >= 2 && std::string(argv[1]) == "--enqueue") return runEnqueue(argc, argv);
+  try {
+    if (const auto worker = parseWorkerArgs(argc, argv)) return runWorker(*worker, argv[0]);
+  } catch (const std::exception& e) {
+    std::cerr << "ads_detector error: " << e.what() << "\n";
+    return 1;
+  }
   try {
     const Args args = parseArgs(argc, argv);
+    trace::setChannel(args.channel.empty() ? model_registry::channelKey(args.m3u8) : args.channel);
+    flight_recorder::install(args.flightDumpPath.empty()
+                                 ? (fs::temp_directory_path() / ("ads_detector." + std::to_string(::getpid()) + ".flight"))
+                                       .string()
+                                 : args.flightDumpPath,
+                             args.stallDumpSec);
+
+    // Hot loops only bump these counters; one reporter thread turns them into output at a fixed rate.
+    progress_reporter::Counters progressCounters;
+    std::optional<progress_reporter::Reporter> progressReporter;
+    if (args.progressFd >= 0 || !args.quiet) {
+      int64_t lastLoggedSamples = -1;  // only touched on the reporter thread
+      progressReporter.emplace(
+          progressCounters, args.progressFd, args.progressIntervalMs,
+          [&args, lastLoggedSamples](const progress_reporter::Snapshot& snap) mutable {
+            if (args.quiet || snap.stage != progress_reporter::Stage::Sampling) return;
+            if (snap.samplesDone == lastLoggedSamples) return;
+            lastLoggedSamples = snap.samplesDone;
+            progress(args, "Training: muestras leidas = " + std::to_string(snap.samplesDone) + "/" +
+                               std::to_string(snap.samplesTotal));
+          });
+    }
 
     progress(args, "Inicio");
     progress(args, "Esquina seleccionada: " + cornerName(args.cornerIndex) +
                        " (roiWidthPct=" + std::to_string(args.roiWidthPct) + ")");
     const bool isHttp = startsWith(args.m3u8, "http://") || startsWith(args.m3u8, "https://");
     progress(args, std::string("Leyendo m3u8 (") + (isHttp ? "HTTP" : "archivo local") + ")");
-    const std::string playlistContent = isHttp ? http::get(args.m3u8) : readFile(args.m3u8);
+    std::string playlistContent;
+    {
+      flight_recorder::IoWait io;
+      playlistContent = isHttp ? http::get(args.m3u8) : readFile(args.m3u8);
+    }
     progress(args, "Parseando playlist m3u8");
-    const auto segments = m3u8::parse(playlistContent);
+    const auto playlist = m3u8::parsePlaylist(playlistContent);
+    const auto& segments = playlist.segments;
     const double totalDurationSec = m3u8::totalDuration(segments);
     if (segments.empty() || totalDurationSec <= 0.0) {
       throw std::runtime_error("could not parse segments/duration from m3u8");
     }
+    // Identical playlist + parameters + models: return the stored result without fetching any media.
+    std::string resultCacheKey;
+    if (resultCacheable(args)) {
+      resultCacheKey = result_cache::key(resultCacheCanonical(args, segments));
+      if (auto cached = result_cache::load(args.resultCacheDir, resultCacheKey)) {
+        const std::string marker = "\"resultCache\": {\"key\": \"" + resultCacheKey + "\", \"hit\": false}";
+        const size_t at = cached->find(marker);
+        if (at != std::string::npos) {
+          cached->replace(at, marker.size(),
+                          "\"resultCache\": {\"key\": \"" + resultCacheKey + "\", \"hit\": true}");
+        }
+        const size_t statsAt = cached->find("  \"process\": {\n");
+        const size_t kfAt = statsAt == std::string::npos ? statsAt : cached->find("  \"keyframeIndex\": ", statsAt);
+        const size_t statsEnd = kfAt == std::string::npos ? kfAt : cached->find(",\n", kfAt);
+        if (statsEnd != std::string::npos) {
+          std::ostringstream stats;
+          const auto ms = std::chrono::duration_cast<std::chrono::milliseconds>(
+                              std::chrono::steady_clock::now() - processStart).count();
+          writeRunStats(stats, args, static_cast<int64_t>(ms), startupMs, -1, nullptr);
+          cached->replace(statsAt, statsEnd + 2 - statsAt, stats.str());
+        }
+        progress(args, "Result cache: hit " + resultCacheKey);
+        writeOutputJson(args, *cached);
+        progressCounters.setStage(progress_reporter::Stage::Done);
+        if (progressReporter) progressReporter->stop();
+        std::cout << *cached;
+        return 0;
+      }
+      progress(args, "Result cache: miss " + resultCacheKey);
+    }
+
     progress(args,
              "Segmentos: " + std::to_string(segments.size()) +
                  ", duracion total aprox: " + std::to_string(totalDurationSec) + " sec");
@@ -1270,27 +2847,213 @@ int main(int argc, char** argv) {
         segEpochMs.emplace_back(std::nullopt);
     }
 
+    // Timeline sprites are cut from the frames decoded for detection; no second decode pass.
+    std::unique_ptr<sprite_sheet::Collector> sprites;
+    if (!args.spritesDir.empty()) sprites = std::make_unique<sprite_sheet::Collector>(args.spritesDir, args.spriteWidth);
+
+    // Keyframe sidecars: samples and refine probes move to a nearby keyframe, which is then decoded
+    // from its own byte range. The shift stays under half the tighter of the two sampling steps
+    // (refine probes are 5 s apart), so no two targets share a keyframe. Declared before the refine
+    // pool, whose workers read through it.
+    std::unique_ptr<keyframe_index::Index> kfIndex;
+    std::function<bool(double, cv::Mat&)> kfRead;
+    if (!args.kfIndexDir.empty()) {
+      kfIndex = std::make_unique<keyframe_index::Index>(args.kfIndexDir, args.m3u8, segments,
+                                                        0.5 * std::min(args.sampleEverySec, 5.0));
+      kfRead = [&kfIndex](double t, cv::Mat& frame) { return kfIndex->read(t, frame); };
+    }
+    // Refine/live stage-one outcomes; declared before the pool, whose workers update them.
+    CascadeCounters refineCascade;
+    // Refine workers start now so the first capture is open by the time refine begins.
+    RefinePool refinePool(args, args.m3u8, args.spritesRefine ? sprites.get() : nullptr);
+    if (kfRead) refinePool.setFrameReader(kfRead);
+
+    auto windowTimes = [&](double boundarySec) {
+      const auto times = refineWindowTimes(boundarySec, totalDurationSec);
+      return kfIndex ? kfIndex->snapAll(times) : times;
+    };
+
     progress(args,
              "Entrenando modelo de logo (cada " + std::to_string(args.sampleEverySec) + " sec)");
-    auto training = logo_detector::train(
+    progressCounters.setStage(progress_reporter::Stage::Sampling);
+    // Cold start to first decoded frame: process startup, playlist fetch and the first open + seek.
+    std::atomic<int64_t> firstSampleMs{-1};
+    auto training = logo_detector::collectSamples(
         args.m3u8,
         totalDurationSec,
         args.roiWidthPct,
-        args.k,
         args.cornerIndex,
         args.sampleEverySec,
         args.threads,
-        args.debug || args.tokayo,
-        [&](int current, int total) {
-          if (args.quiet) return;
-          progress(args,
-                   "Training: muestras leidas = " + std::to_string(current) + "/" + std::to_string(total));
-        });
-    progress(args,
-             "Training: umbral: " + std::to_string(training.model.threshold) +
-                 ", logoSamples: " + std::to_string(training.model.logoSampleIndices.size()) +
-                 ", totalSamples: " + std::to_string(training.sampleTimesSec.size()));
+        sampleArtifactsFor(args),
+        [&progressCounters, &firstSampleMs, processStart](int, int total) {
+          int64_t unset = -1;
+          if (firstSampleMs.load(std::memory_order_relaxed) < 0) {
+            const auto ms = std::chrono::duration_cast<std::chrono::milliseconds>(
+                                std::chrono::steady_clock::now() - processStart).count();
+            firstSampleMs.compare_exchange_strong(unset, static_cast<int64_t>(ms));
+          }
+          progressCounters.samplesTotal.store(total, std::memory_order_relaxed);
+          progressCounters.samplesDone.fetch_add(1, std::memory_order_relaxed);
+        },
+        kfIndex ? std::function<double(double)>([&kfIndex](double t) { return kfIndex->snap(t); })
+                : std::function<double(double)>(),
+        args.sampleStallSec,
+        kfRead);
+    progressCounters.setStage(progress_reporter::Stage::Training);
+    if (training.stalledReads > 0) {
+      progress(args, "Sampling: " + std::to_string(training.stalledReads) + " lectura(s) colgada(s) abandonada(s), " +
+                         std::to_string(training.reassignedSamples) + " muestras reasignadas, " +
+                         std::to_string(training.droppedSamples) + " descartadas");
+    }
+    if (kfIndex) {
+      progress(args, "Keyframe index: sidecars nuevos=" + std::to_string(kfIndex->built()) +
+                         ", reutilizados=" + std::to_string(kfIndex->loaded()) +
+                         ", lecturas directas=" + std::to_string(kfIndex->directReads()) +
+                         ", fallidas=" + std::to_string(kfIndex->failedReads()));
+    }
+    if (sprites) {
+      for (size_t i = 0; i < training.sampleThumbs.size(); i++) sprites->add(training.sampleTimesSec[i], training.sampleThumbs[i]);
+      training.sampleThumbs.clear();
+    }
+    const int sampleCount = static_cast<int>(training.sampleTimesSec.size());
+    // Tokayo's blurred gray ROIs come straight from the sampling workers.
+    const std::vector<cv::Mat>& grayRois = training.sampleGrayRois;
+    // Only histogram-based strategies need PCA/KMeans, seeds and a Bhattacharyya threshold.
+    const bool histModel = !args.tokayo;
+
+    // Warm start: a stored model of this channel/corner that fits the new samples skips fitting.
+    // DBSCAN/LOF/MCD need this run's PCA embedding, so they always fit.
+    const std::string registryChannel = args.channel.empty() ? model_registry::channelKey(args.m3u8) : args.channel;
+    const bool registryApplies = !args.modelRegistryDir.empty() && (!args.outlier || args.outlierMode == "knn");
+    size_t registryCandidates = 0;
+    model_registry::Match registryMatch;
+    std::optional<model_registry::Entry> warmModel;
+    std::vector<model_registry::Entry> registryEntries;
+    int histTrainSamples = sampleCount;  // samples the histogram model was fitted on (--train-converge)
+    // Time-of-day schedule: each sample scored against the models used at its weekday/hour.
+    std::vector<model_registry::SampleScore> scheduleScores;
+    std::unordered_map<int, int> scheduleSlotEntry;  // weekday/hour slot -> registry entry
+    std::vector<std::optional<int64_t>> sampleEpochMs;
+    for (int i = 0; i < sampleCount; i++) {
+      sampleEpochMs.push_back(offsetToEpochMs(segments, segEpochMs, training.sampleTimesSec[static_cast<size_t>(i)]));
+    }
+    if (registryApplies) {
+      // Tokayo templates come back at this run's ROI side, whatever rendition they were cut from.
+      const int tokayoRoiSide = (args.tokayo && !grayRois.empty()) ? grayRois[0].cols : 0;
+      registryEntries = model_registry::load(args.modelRegistryDir, registryChannel, args.cornerIndex,
+                                             args.roiWidthPct, tokayoRoiSide);
+      const auto& entries = registryEntries;
+      registryCandidates = entries.size();
+
+      const auto usage = model_registry::loadUsage(args.modelRegistryDir, registryChannel);
+      const bool timed = std::all_of(sampleEpochMs.begin(), sampleEpochMs.end(),
+                                     [](const std::optional<int64_t>& ms) { return ms.has_value(); });
+      if (!usage.empty() && !entries.empty() && timed) {
+        std::unordered_map<std::string, int> entryById;
+        for (size_t e = 0; e < entries.size(); e++) entryById[entries[e].id] = static_cast<int>(e);
+        std::vector<std::vector<int>> candidatesPerSample(static_cast<size_t>(sampleCount));
+        for (int i = 0; i < sampleCount; i++) {
+          const int slot = model_registry::slotOf(sampleEpochMs[static_cast<size_t>(i)].value());
+          for (const auto& id : usage.candidates(slot, 3)) {
+            const auto it = entryById.find(id);
+            if (it != entryById.end()) candidatesPerSample[static_cast<size_t>(i)].push_back(it->second);
+          }
+        }
+        auto scores = model_registry::scoreCandidates(entries, candidatesPerSample, training.sampleHists,
+                                                      args.tokayo ? &grayRois : nullptr);
+        if (model_registry::scoresFit(scores)) scheduleScores = std::move(scores);
+
+        if (!scheduleScores.empty()) {
+          // Each slot keeps the model that scored most of its samples; slots this run did not
+          // sample (live follow past the last hour) take the slot's most used model.
+          std::unordered_map<int, std::unordered_map<int, int>> slotUses;
+          for (int i = 0; i < sampleCount; i++) {
+            const auto& sc = scheduleScores[static_cast<size_t>(i)];
+            if (sc.entryIndex >= 0) slotUses[model_registry::slotOf(sampleEpochMs[static_cast<size_t>(i)].value())][sc.entryIndex]++;
+          }
+          for (const auto& kv : slotUses) {
+            scheduleSlotEntry[kv.first] =
+                std::max_element(kv.second.begin(), kv.second.end(),
+                                 [](const auto& a, const auto& b) { return a.second < b.second; })->first;
+          }
+          for (int slot = 0; slot < 7 * 24; slot++) {
+            if (scheduleSlotEntry.count(slot)) continue;
+            for (const auto& id : usage.candidates(slot, 1)) {
+              const auto it = entryById.find(id);
+              if (it != entryById.end()) scheduleSlotEntry[slot] = it->second;
+            }
+          }
+        }
+      }
+
+      if (!scheduleScores.empty()) {
+        // The model that scored most samples is the default; refine and live use each slot's own.
+        std::unordered_map<int, int> uses;
+        for (const auto& sc : scheduleScores) {
+          if (sc.entryIndex >= 0) uses[sc.entryIndex]++;
+        }
+        const auto dominant = std::max_element(uses.begin(), uses.end(),
+                                               [](const auto& a, const auto& b) { return a.second < b.second; });
+        warmModel = entries[static_cast<size_t>(dominant->first)];
+        // Samples whose slot had no usable model are scored by the default one.
+        std::vector<std::vector<int>> uncovered(static_cast<size_t>(sampleCount));
+        for (int i = 0; i < sampleCount; i++) {
+          if (scheduleScores[static_cast<size_t>(i)].entryIndex < 0) uncovered[static_cast<size_t>(i)] = {dominant->first};
+        }
+        const auto fill = model_registry::scoreCandidates(entries, uncovered, training.sampleHists,
+                                                          args.tokayo ? &grayRois : nullptr);
+        for (int i = 0; i < sampleCount; i++) {
+          if (fill[static_cast<size_t>(i)].entryIndex >= 0) scheduleScores[static_cast<size_t>(i)] = fill[static_cast<size_t>(i)];
+        }
+        progress(args, "Registry: canal=" + registryChannel + ", horario: " + std::to_string(uses.size()) +
+                           " modelo(s) por franja, principal " + warmModel->id);
+      } else {
+        registryMatch = model_registry::select(entries, training.sampleHists, args.tokayo ? &grayRois : nullptr,
+                                               args.registryProbeK);
+        if (registryMatch.entryIndex >= 0) warmModel = entries[static_cast<size_t>(registryMatch.entryIndex)];
+        progress(args, "Registry: canal=" + registryChannel + ", modelos=" + std::to_string(entries.size()) +
+                           (warmModel ? ", usando " + warmModel->id + " (logo=" +
+                                            std::to_string(registryMatch.logoFraction) + ", margen=" +
+                                            std::to_string(registryMatch.margin) + ")"
+                                      : ", ninguno ajusta; entrenando"));
+      }
+    }
 
+    if (!histModel) {
+      // Tokayo fits its own template below.
+    } else if (warmModel && !warmModel->meanHist.empty()) {
+      training.model.meanHist = warmModel->meanHist;
+      training.model.threshold = warmModel->threshold;
+      // Seeds for KNN: samples confidently inside the stored (or scheduled) model's threshold.
+      std::vector<int> seeds;
+      std::vector<int> loose;
+      for (int i = 0; i < sampleCount; i++) {
+        const double nd = !scheduleScores.empty()
+                              ? scheduleScores[static_cast<size_t>(i)].normDist
+                              : cv::compareHist(training.sampleHists.row(i), training.model.meanHist,
+                                                cv::HISTCMP_BHATTACHARYYA) / training.model.threshold;
+        if (nd <= 0.8) seeds.push_back(i);
+        if (nd <= 1.0) loose.push_back(i);
+      }
+      training.model.logoSampleIndices = (seeds.size() >= 3) ? seeds : loose;
+    } else if (!warmModel) {
+      std::vector<int> trainIdx;
+      if (args.trainConverge > 0.0) {
+        trainIdx = logo_detector::convergeTrainingSet(training, args.k, args.trainConverge);
+        histTrainSamples = static_cast<int>(trainIdx.size());
+        progress(args, "Training: modelo convergido con " + std::to_string(trainIdx.size()) + "/" +
+                           std::to_string(sampleCount) + " muestras");
+      }
+      progress(args, "Training: ajustando modelo (PCA + KMeans)");
+      logo_detector::fitModel(training, args.k, trainIdx);
+    }
+    if (histModel) {
+      progress(args,
+               "Training: umbral: " + std::to_string(training.model.threshold) +
+                   ", logoSamples: " + std::to_string(training.model.logoSampleIndices.size()) +
+                   ", totalSamples: " + std::to_string(training.sampleTimesSec.size()));
+    }
     fs::path logosOutDir;
     if (args.debug) {
       progress(args, "Debug habilitado: exportando set de logos (ROIs) a logos_output/");
@@ -1304,11 +3067,14 @@ int main(int argc, char** argv) {
       double endSec = 0;
       std::optional<std::string> startPdt;
       std::optional<std::string> endPdt;
+      bool startOnBlank = false;  // --blank-frames: boundary snapped to a black/slate frame
+      bool endOnBlank = false;
     };
     std::vector<Interval> ads;
 
     const std::string strategyName = args.tokayo ? "tokayo" :
                                      args.outlier ? ("outlier/" + args.outlierMode) : "bhattacharyya";
+    progressCounters.setStage(progress_reporter::Stage::Detecting);
     progress(args,
              "Detectando ads desde muestras (cada " + std::to_string(training.sampleEverySec) +
                  " sec, min-ad-sec=" + std::to_string(args.minAdSec) +
@@ -1320,7 +3086,6 @@ int main(int argc, char** argv) {
                  ", enterN=" + std::to_string(args.enterConsecutive) +
                  ", exitN=" + std::to_string(args.exitConsecutive) + ")");
 
-    const int sampleCount = training.sampleHists.rows;
     std::vector<char> hasLogo;
     hasLogo.resize(static_cast<size_t>(std::max(0, sampleCount)), 0);
     std::vector<double> distSmooth;
@@ -1335,109 +3100,128 @@ int main(int argc, char** argv) {
     int usedKnnK = 0;
     double usedKnnQ = 0.0;
     double usedKnnThreshold = 0.0;
+    std::unique_ptr<KnnModel> knnModelPtr;
+    double annRecall = -1.0;  // --knn-ann recall@k against exact search on a sample of queries
+    std::shared_ptr<const CondensedSeeds> condensedSeeds;  // --knn-medoids
+    double annBuildMs = 0.0;
+    CascadeCounters coarseCascade;
+    int coarseCascadeCalibrated = 0;  // samples fully scored to calibrate the coarse gate (0 = no gate)
 
     std::unique_ptr<TokayoModel> tokayoModelPtr;
+    int tokayoTrainSamples = 0;
+    std::unique_ptr<McdModel> mcdModelPtr;
+    size_t mcdSupportSize = 0;
 
     if (args.tokayo) {
       // --- Tokayo: pixel-wise median + stddev logo detection + NCC ---
 
-      // 1. Decode all ROI PNGs to grayscale + slight blur.
-      progress(args, "Tokayo: decodificando ROIs a escala de grises + blur");
-      std::vector<cv::Mat> grayRois;
-      grayRois.reserve(static_cast<size_t>(sampleCount));
-      for (int i = 0; i < sampleCount; i++) {
-        if (static_cast<size_t>(i) >= training.sampleRoiPng.size() ||
-            training.sampleRoiPng[static_cast<size_t>(i)].empty()) {
-          throw std::runtime_error("tokayo: missing ROI image for sample " + std::to_string(i));
-        }
-        cv::Mat decoded = cv::imdecode(training.sampleRoiPng[static_cast<size_t>(i)], cv::IMREAD_COLOR);
-        if (decoded.empty()) throw std::runtime_error("tokayo: could not decode ROI PNG for sample " + std::to_string(i));
-        cv::Mat gray;
-        cv::cvtColor(decoded, gray, cv::COLOR_BGR2GRAY);
-        cv::GaussianBlur(gray, gray, cv::Size(3, 3), 0);
-        grayRois.push_back(gray);
-      }
+      // 1. Gray ROIs were decoded right after sampling.
       const int roiH = grayRois[0].rows;
       const int roiW = grayRois[0].cols;
       progress(args, "Tokayo: ROI size=" + std::to_string(roiW) + "x" + std::to_string(roiH) +
                          ", samples=" + std::to_string(sampleCount));
 
-      // 2. Compute pixel-wise median across all samples.
-      progress(args, "Tokayo: calculando mediana pixel a pixel");
-      cv::Mat medianImg(roiH, roiW, CV_8UC1);
-      {
-        std::vector<uint8_t> vals(static_cast<size_t>(sampleCount));
+      cv::Mat medianImg;
+      cv::Mat stddevNorm;
+      cv::Mat logoMask;
+      cv::Rect logoSubRect;
+      cv::Mat logoTemplate;
+      SparseLogoMask sparseMask;
+      if (warmModel) {
+        // Template, sub-ROI and threshold come from the registry; steps 2-5 are skipped.
+        logoTemplate = warmModel->tokayoTemplate.clone();
+        logoSubRect = warmModel->tokayoSubRect;
+      } else {
+        // 2. Compute pixel-wise median across the training samples (all, unless --train-converge).
+        const std::vector<int> trainIdx = convergeTokayoTrainingSet(grayRois, args.trainConverge);
+        const int trainCount = static_cast<int>(trainIdx.size());
+        tokayoTrainSamples = trainCount;
+        if (trainCount < sampleCount) {
+          progress(args, "Tokayo: mediana convergida con " + std::to_string(trainCount) + "/" +
+                             std::to_string(sampleCount) + " muestras");
+        }
+        progress(args, "Tokayo: calculando mediana pixel a pixel");
+        medianImg = pixelMedian(grayRois, trainIdx);
+
+        // 3. Compute per-pixel stddev to find constant (logo) vs varying (background) pixels.
+        progress(args, "Tokayo: calculando stddev pixel a pixel");
+        cv::Mat stddevImg(roiH, roiW, CV_32FC1);
         for (int y = 0; y < roiH; y++) {
           for (int x = 0; x < roiW; x++) {
-            for (int i = 0; i < sampleCount; i++) {
-              vals[static_cast<size_t>(i)] = grayRois[static_cast<size_t>(i)].at<uint8_t>(y, x);
+            double sum = 0, sum2 = 0;
+            for (int i : trainIdx) {
+              const double v = grayRois[static_cast<size_t>(i)].at<uint8_t>(y, x);
+              sum += v;
+              sum2 += v * v;
             }
-            std::nth_element(vals.begin(), vals.begin() + sampleCount / 2, vals.end());
-            medianImg.at<uint8_t>(y, x) = vals[static_cast<size_t>(sampleCount / 2)];
+            const double mean = sum / trainCount;
+            const double var = (sum2 / trainCount) - mean * mean;
+            stddevImg.at<float>(y, x) = static_cast<float>(std::sqrt(std::max(0.0, var)));
           }
         }
-      }
 
-      // 3. Compute per-pixel stddev to find constant (logo) vs varying (background) pixels.
-      progress(args, "Tokayo: calculando stddev pixel a pixel");
-      cv::Mat stddevImg(roiH, roiW, CV_32FC1);
-      for (int y = 0; y < roiH; y++) {
-        for (int x = 0; x < roiW; x++) {
-          double sum = 0, sum2 = 0;
-          for (int i = 0; i < sampleCount; i++) {
-            const double v = grayRois[static_cast<size_t>(i)].at<uint8_t>(y, x);
-            sum += v;
-            sum2 += v * v;
-          }
-          const double mean = sum / sampleCount;
-          const double var = (sum2 / sampleCount) - mean * mean;
-          stddevImg.at<float>(y, x) = static_cast<float>(std::sqrt(std::max(0.0, var)));
-        }
-      }
+        // 4. Threshold stddev to find the logo region (low variance = constant = logo).
+        cv::normalize(stddevImg, stddevNorm, 0, 255, cv::NORM_MINMAX);
+        stddevNorm.convertTo(stddevNorm, CV_8UC1);
 
-      // 4. Threshold stddev to find the logo region (low variance = constant = logo).
-      cv::Mat stddevNorm;
-      cv::normalize(stddevImg, stddevNorm, 0, 255, cv::NORM_MINMAX);
-      stddevNorm.convertTo(stddevNorm, CV_8UC1);
+        cv::threshold(stddevNorm, logoMask, 0, 255, cv::THRESH_BINARY_INV | cv::THRESH_OTSU);
 
-      cv::Mat logoMask;
-      cv::threshold(stddevNorm, logoMask, 0, 255, cv::THRESH_BINARY_INV | cv::THRESH_OTSU);
+        cv::Mat morphKernel = cv::getStructuringElement(cv::MORPH_RECT, cv::Size(5, 5));
+        cv::morphologyEx(logoMask, logoMask, cv::MORPH_CLOSE, morphKernel);
+        cv::morphologyEx(logoMask, logoMask, cv::MORPH_OPEN, morphKernel);
 
-      cv::Mat morphKernel = cv::getStructuringElement(cv::MORPH_RECT, cv::Size(5, 5));
-      cv::morphologyEx(logoMask, logoMask, cv::MORPH_CLOSE, morphKernel);
-      cv::morphologyEx(logoMask, logoMask, cv::MORPH_OPEN, morphKernel);
+        std::vector<std::vector<cv::Point>> contours;
+        cv::findContours(logoMask, contours, cv::RETR_EXTERNAL, cv::CHAIN_APPROX_SIMPLE);
+        if (contours.empty()) throw std::runtime_error("tokayo: no logo region found in stddev analysis");
 
-      std::vector<std::vector<cv::Point>> contours;
-      cv::findContours(logoMask, contours, cv::RETR_EXTERNAL, cv::CHAIN_APPROX_SIMPLE);
-      if (contours.empty()) throw std::runtime_error("tokayo: no logo region found in stddev analysis");
+        size_t largestIdx = 0;
+        double largestArea = 0;
+        for (size_t ci = 0; ci < contours.size(); ci++) {
+          const double area = cv::contourArea(contours[ci]);
+          if (area > largestArea) { largestArea = area; largestIdx = ci; }
+        }
 
-      size_t largestIdx = 0;
-      double largestArea = 0;
-      for (size_t ci = 0; ci < contours.size(); ci++) {
-        const double area = cv::contourArea(contours[ci]);
-        if (area > largestArea) { largestArea = area; largestIdx = ci; }
+        logoSubRect = cv::boundingRect(contours[largestIdx]);
+        const int padPx = 2;
+        logoSubRect.x = std::max(0, logoSubRect.x - padPx);
+        logoSubRect.y = std::max(0, logoSubRect.y - padPx);
+        logoSubRect.width = std::min(roiW - logoSubRect.x, logoSubRect.width + 2 * padPx);
+        logoSubRect.height = std::min(roiH - logoSubRect.y, logoSubRect.height + 2 * padPx);
+
+        progress(args, "Tokayo: logo sub-ROI=" + std::to_string(logoSubRect.x) + "," +
+                           std::to_string(logoSubRect.y) + " " +
+                           std::to_string(logoSubRect.width) + "x" + std::to_string(logoSubRect.height));
+
+        // 5. Extract logo template from median image.
+        logoTemplate = medianImg(logoSubRect).clone();
+
+        if (args.tokayoSparse > 0) {
+          sparseMask = learnSparseLogoMask(medianImg, stddevImg, logoMask, args.tokayoSparse);
+          progress(args, sparseMask.empty()
+                             ? std::string("Tokayo: mascara dispersa sin contraste; usando template")
+                             : "Tokayo: mascara dispersa logo=" + std::to_string(sparseMask.logoPixels) +
+                                   ", anillo=" + std::to_string(sparseMask.offsets.size() - sparseMask.logoPixels));
+        }
+      }
+      if (args.tokayoSparse > 0 && warmModel) {
+        progress(args, "Tokayo: el registry no guarda mascara dispersa; usando template");
       }
 
-      cv::Rect logoSubRect = cv::boundingRect(contours[largestIdx]);
-      const int padPx = 2;
-      logoSubRect.x = std::max(0, logoSubRect.x - padPx);
-      logoSubRect.y = std::max(0, logoSubRect.y - padPx);
-      logoSubRect.width = std::min(roiW - logoSubRect.x, logoSubRect.width + 2 * padPx);
-      logoSubRect.height = std::min(roiH - logoSubRect.y, logoSubRect.height + 2 * padPx);
-
-      progress(args, "Tokayo: logo sub-ROI=" + std::to_string(logoSubRect.x) + "," +
-                         std::to_string(logoSubRect.y) + " " +
-                         std::to_string(logoSubRect.width) + "x" + std::to_string(logoSubRect.height));
-
-      // 5. Extract logo template from median image.
-      cv::Mat logoTemplate = medianImg(logoSubRect).clone();
-
-      // 6. NCC (normalized cross-correlation) of each sample against the template.
-      progress(args, "Tokayo: correlacion cruzada normalizada (NCC)");
+      // 6. NCC (normalized cross-correlation) of each sample against the template, or
+      //    correlation over the sparse mask.
+      progress(args, sparseMask.empty() ? "Tokayo: correlacion cruzada normalizada (NCC)"
+                                        : "Tokayo: correlacion sobre mascara dispersa");
       std::vector<double> nccScores;
       nccScores.reserve(static_cast<size_t>(sampleCount));
       for (int i = 0; i < sampleCount; i++) {
-        const cv::Mat sampleSub = grayRois[static_cast<size_t>(i)](logoSubRect);
+        const cv::Mat& gray = grayRois[static_cast<size_t>(i)];
+        if (!sparseMask.empty()) {
+          nccScores.push_back(sparseMaskScore(sparseMask, [&gray](int y, int x) {
+            return static_cast<double>(gray.at<uint8_t>(y, x));
+          }));
+          continue;
+        }
+        const cv::Mat sampleSub = gray(logoSubRect);
         cv::Mat result;
         cv::matchTemplate(sampleSub, logoTemplate, result, cv::TM_CCOEFF_NORMED);
         nccScores.push_back(static_cast<double>(result.at<float>(0, 0)));
@@ -1445,7 +3229,9 @@ int main(int argc, char** argv) {
 
       // 7. Determine NCC threshold: auto-detect via largest gap, or use manual value.
       double nccTh = args.tokayoTh;
-      if (nccTh <= 0.0) {
+      if (nccTh <= 0.0 && warmModel) {
+        nccTh = warmModel->tokayoNccThreshold;
+      } else if (nccTh <= 0.0) {
         std::vector<double> sorted = nccScores;
         std::sort(sorted.begin(), sorted.end());
         double bestGap = 0.0;
@@ -1461,6 +3247,14 @@ int main(int argc, char** argv) {
                            " (largest gap=" + std::to_string(bestGap) + ")");
       }
 
+      // With a time-of-day schedule each sample was already scored against its own slot's templates;
+      // map that onto this threshold so the rest of the pipeline is unchanged.
+      if (!scheduleScores.empty()) {
+        for (int i = 0; i < sampleCount; i++) {
+          nccScores[static_cast<size_t>(i)] = nccTh + (1.0 - scheduleScores[static_cast<size_t>(i)].normDist);
+        }
+      }
+
       // 8. Classify.
       int logoCount = 0, noLogoCount = 0;
       for (int i = 0; i < sampleCount; i++) {
@@ -1479,19 +3273,22 @@ int main(int argc, char** argv) {
       tokayoModelPtr->nccThreshold = nccTh;
       tokayoModelPtr->cornerIndex = args.cornerIndex;
       tokayoModelPtr->roiWidthPct = args.roiWidthPct;
+      tokayoModelPtr->sparse = sparseMask;
 
       if (args.debug) {
-        // Save median image, stddev, mask, and template.
-        cv::imwrite((logosOutDir / "tokayo_median.png").string(), medianImg);
-        cv::imwrite((logosOutDir / "tokayo_stddev.png").string(), stddevNorm);
-        cv::imwrite((logosOutDir / "tokayo_logo_mask.png").string(), logoMask);
+        // Save median image, stddev, mask, and template (a warm start only has the template).
         cv::imwrite((logosOutDir / "tokayo_logo_template.png").string(), logoTemplate);
-
-        // Draw the detected sub-ROI on the median.
-        cv::Mat medianAnnotated;
-        cv::cvtColor(medianImg, medianAnnotated, cv::COLOR_GRAY2BGR);
-        cv::rectangle(medianAnnotated, logoSubRect, cv::Scalar(0, 255, 0), 2);
-        cv::imwrite((logosOutDir / "tokayo_median_annotated.png").string(), medianAnnotated);
+        if (!medianImg.empty()) {
+          cv::imwrite((logosOutDir / "tokayo_median.png").string(), medianImg);
+          cv::imwrite((logosOutDir / "tokayo_stddev.png").string(), stddevNorm);
+          cv::imwrite((logosOutDir / "tokayo_logo_mask.png").string(), logoMask);
+
+          // Draw the detected sub-ROI on the median.
+          cv::Mat medianAnnotated;
+          cv::cvtColor(medianImg, medianAnnotated, cv::COLOR_GRAY2BGR);
+          cv::rectangle(medianAnnotated, logoSubRect, cv::Scalar(0, 255, 0), 2);
+          cv::imwrite((logosOutDir / "tokayo_median_annotated.png").string(), medianAnnotated);
+        }
 
         // Export logos and no-logos as separate folders.
         const fs::path noLogosDir = logosOutDir / "no-logos";
@@ -1530,7 +3327,10 @@ int main(int argc, char** argv) {
       distRaw.reserve(static_cast<size_t>(std::max(0, sampleCount)));
       for (int i = 0; i < sampleCount; i++) {
         const cv::Mat h = training.sampleHists.row(i);
-        distRaw.push_back(cv::compareHist(h, training.model.meanHist, cv::HISTCMP_BHATTACHARYYA));
+        // A time-of-day schedule scores against the slot's own model, expressed on this threshold's scale.
+        distRaw.push_back(!scheduleScores.empty()
+                              ? scheduleScores[static_cast<size_t>(i)].normDist * baseTh
+                              : cv::compareHist(h, training.model.meanHist, cv::HISTCMP_BHATTACHARYYA));
       }
 
       // Smoothing reduces false positives caused by a single noisy sample.
@@ -1605,6 +3405,46 @@ int main(int argc, char** argv) {
           }
         }
         outlierHandled = true;
+      } else if (args.outlierMode == "mcd") {
+        McdResult fit = computeMCD(pts, args.mcdSupport);
+        // The h-subset's raw scatter underestimates the spread; rescale it so the median squared
+        // distance matches the chi2(2) median (ln 4), as in the usual MCD consistency correction.
+        std::vector<double> d2;
+        d2.reserve(pts.size());
+        for (const auto& p : pts) {
+          const double d = mahalanobisDistance2D(p, fit.center, fit.covInv);
+          d2.push_back(d * d);
+        }
+        const double medianD2 = quantile(d2, 0.5);
+        if (medianD2 > 1e-12) {
+          fit.cov *= medianD2 / std::log(4.0);
+          fit.covInv = fit.cov.inv();
+          fit.det = cv::determinant(fit.cov);
+        }
+
+        mcdModelPtr = std::make_unique<McdModel>();
+        mcdModelPtr->pca = training.pcaModel;
+        mcdModelPtr->center = fit.center;
+        mcdModelPtr->covInv = fit.covInv.clone();
+        mcdModelPtr->threshold = args.mcdThreshold;
+        mcdModelPtr->cornerIndex = args.cornerIndex;
+        mcdModelPtr->roiWidthPct = args.roiWidthPct;
+        mcdSupportSize = fit.support.size();
+        progress(args, "MCD: support=" + std::to_string(fit.support.size()) + "/" + std::to_string(pts.size()) +
+                           ", th=" + std::to_string(args.mcdThreshold));
+
+        std::vector<double> dists;
+        dists.reserve(static_cast<size_t>(sampleCount));
+        for (int i = 0; i < sampleCount; i++) {
+          const double d = (i < static_cast<int>(pts.size()))
+                               ? mahalanobisDistance2D(pts[static_cast<size_t>(i)], fit.center, fit.covInv)
+                               : 0.0;
+          dists.push_back(d);
+          hasLogo[static_cast<size_t>(i)] = (d <= args.mcdThreshold) ? 1 : 0;
+        }
+
+        if (args.debug) exportDebugPcaTokayoPlot(logosOutDir, training, dists, args.mcdThreshold, fit, "pca_xy_mcd");
+        outlierHandled = true;
       } else {
         if (args.outlierMode == "knn") {
           const std::vector<int> seeds = training.model.logoSampleIndices;
@@ -1614,13 +3454,69 @@ int main(int argc, char** argv) {
             const int kk = std::max(1, std::min(args.knnK, static_cast<int>(seeds.size()) - 1));
             usedKnnK = kk;
             usedKnnQ = args.knnQuantile;
+            // --knn-medoids: score against weighted medoids instead of every seed, so the cost no
+            // longer grows with the training length.
+            if (args.knnMedoids > 0 && static_cast<int>(seeds.size()) > args.knnMedoids) {
+              condensedSeeds = std::make_shared<const CondensedSeeds>(
+                  condenseSeeds(training.sampleHists, seeds, args.knnMedoids));
+              progress(args, "KNN(logo): " + std::to_string(seeds.size()) + " semillas condensadas a " +
+                                 std::to_string(condensedSeeds->medoids.size()) + " medoides");
+            }
+            // The index holds whatever is scored against: medoids when condensed, else every seed.
+            const std::vector<int>& bank = condensedSeeds ? condensedSeeds->medoids : seeds;
+            // Condensed queries need k medoids (plus their own) at most: each stands for >= 1 seed.
+            const int searchK = condensedSeeds ? kk + 1 : kk;
+            // --knn-ann: seeds go into an IVF-flat index; every score below is then a few inverted
+            // lists' scan instead of a pass over the whole seed bank.
+            std::shared_ptr<const seed_index::IvfFlat> annIndex;
+            if (args.knnAnn) {
+              const auto buildStart = std::chrono::steady_clock::now();
+              annIndex = std::make_shared<const seed_index::IvfFlat>(training.sampleHists, bank, args.annNlist,
+                                                                     args.annNprobe);
+              annBuildMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - buildStart).count();
+              // Recall@k of the approximate neighbours against an exact scan, on up to 32 spread-out queries.
+              const std::vector<int> probeOrder = logo_detector::progressiveOrder(sampleCount);
+              const int recallQueries = std::min(sampleCount, 32);
+              size_t found = 0;
+              size_t expected = 0;
+              for (int q = 0; q < recallQueries; q++) {
+                const int i = probeOrder[static_cast<size_t>(q)];
+                const float* hist = training.sampleHists.ptr<float>(i);
+                const auto exact = annIndex->search(hist, searchK, i, annIndex->nlist());
+                const auto approx = annIndex->search(hist, searchK, i);
+                std::unordered_set<int> exactIds;
+                for (const auto& n : exact) exactIds.insert(n.id);
+                for (const auto& n : approx) found += exactIds.count(n.id);
+                expected += exact.size();
+              }
+              annRecall = expected ? static_cast<double>(found) / static_cast<double>(expected) : 1.0;
+              progress(args, "KNN(logo): indice IVF-flat nlist=" + std::to_string(annIndex->nlist()) +
+                                 ", nprobe=" + std::to_string(annIndex->nprobe()) +
+                                 ", recall@k=" + std::to_string(annRecall) +
+                                 ", build=" + std::to_string(annBuildMs) + "ms");
+            }
+            const auto knnScore = [&](int i) -> double {
+              if (condensedSeeds) {
+                return condensedKnnAvgDist(training.sampleHists.row(i), i, *condensedSeeds, kk, annIndex.get());
+              }
+              if (annIndex) return annIndex->avgDist(training.sampleHists.ptr<float>(i), kk, i);
+              return knnAvgDistToSeedsHist(training.sampleHists, i, seeds, kk);
+            };
+            // Seed-score distribution for the threshold; when condensed, each medoid's score counts
+            // for its whole cluster.
             std::vector<double> seedScores;
-            seedScores.reserve(seeds.size());
-            for (int s : seeds) {
-              if (s < 0 || s >= sampleCount) continue;
-              seedScores.push_back(knnAvgDistToSeedsHist(training.sampleHists, s, seeds, kk));
+            double th = 0.0;
+            if (condensedSeeds) {
+              for (int s : condensedSeeds->medoids) seedScores.push_back(knnScore(s));
+              th = weightedQuantile(seedScores, condensedSeeds->weights, args.knnQuantile);
+            } else {
+              seedScores.reserve(seeds.size());
+              for (int s : seeds) {
+                if (s < 0 || s >= sampleCount) continue;
+                seedScores.push_back(knnScore(s));
+              }
+              th = quantile(seedScores, args.knnQuantile);
             }
-            double th = quantile(seedScores, args.knnQuantile);
             if (!seedScores.empty()) {
               const double maxSeed = *std::max_element(seedScores.begin(), seedScores.end());
               if (th < maxSeed) th = maxSeed * 1.02;  // never reject logo seeds; small margin
@@ -1632,13 +3528,51 @@ int main(int argc, char** argv) {
                                ", threshold=" + std::to_string(th) +
                                ", seeds=" + std::to_string(seeds.size()));
 
-            std::vector<double> scores;
-            scores.reserve(static_cast<size_t>(sampleCount));
-            for (int i = 0; i < sampleCount; i++) {
-              const double s = knnAvgDistToSeedsHist(training.sampleHists, i, seeds, kk);
-              scores.push_back(s);
+            // --cascade: a progressive subset is fully scored and calibrates the prefilter; after
+            // that only samples it cannot decide (and seeds) pay the O(seeds) scorer.
+            std::vector<double> scores(static_cast<size_t>(sampleCount), -1.0);  // -1 = decided by stage one
+            std::vector<int> order(static_cast<size_t>(sampleCount));
+            std::iota(order.begin(), order.end(), 0);
+            int calibrateCount = sampleCount;
+            if (args.cascade && static_cast<int>(training.sampleLumaStats.size()) == sampleCount) {
+              order = logo_detector::progressiveOrder(sampleCount);
+              calibrateCount = std::min(sampleCount, std::max(32, sampleCount / 4));
+            }
+            const std::unordered_set<int> seedLookup(seeds.begin(), seeds.end());
+            std::optional<CascadeGate> gate;
+            for (int n = 0; n < sampleCount; n++) {
+              const int i = order[static_cast<size_t>(n)];
+              if (n == calibrateCount) {
+                const std::vector<int> calibrated(order.begin(), order.begin() + calibrateCount);
+                gate = calibrateCascade(training.sampleLumaStats, hasLogo, calibrated);
+                if (gate) {
+                  gate->counters = &coarseCascade;
+                  coarseCascadeCalibrated = calibrateCount;
+                }
+                progress(args, gate ? "Cascade: prefiltro calibrado con " + std::to_string(calibrateCount) + " muestras"
+                                    : std::string("Cascade: sin muestras suficientes por clase; KNN completo"));
+              }
+              if (gate && !seedLookup.count(i)) {
+                const int decided = gate->decide(training.sampleLumaStats[static_cast<size_t>(i)]);
+                if (decided >= 0) {
+                  hasLogo[static_cast<size_t>(i)] = static_cast<char>(decided);
+                  continue;
+                }
+              }
+              const double s = knnScore(i);
+              scores[static_cast<size_t>(i)] = s;
               hasLogo[static_cast<size_t>(i)] = (s <= th) ? 1 : 0;
             }
+            // Either makes a probe's KNN score cheap enough for refine and live follow to use it.
+            if (annIndex || condensedSeeds) {
+              knnModelPtr = std::make_unique<KnnModel>(
+                  KnnModel{annIndex, condensedSeeds, kk, th, args.cornerIndex, args.roiWidthPct});
+            }
+            if (gate) {
+              progress(args, "Cascade (gruesa): etapa 1 logo=" + std::to_string(coarseCascade.logo.load()) +
+                                 ", no-logo=" + std::to_string(coarseCascade.noLogo.load()) +
+                                 ", KNN=" + std::to_string(coarseCascade.full.load()));
+            }
 
             if (args.debug) {
               std::vector<int> labels;
@@ -1651,14 +3585,15 @@ int main(int argc, char** argv) {
               if (csv.is_open()) {
                 csv << "k,quantile,threshold,seedCount\n";
                 csv << kk << "," << args.knnQuantile << "," << th << "," << seeds.size() << "\n";
-                csv << "\nindex,timeSec,score,isLogo,isSeed\n";
+                csv << "\nindex,timeSec,score,isLogo,isSeed,stage\n";
                 std::unordered_set<int> seedSet(seeds.begin(), seeds.end());
                 for (int i = 0; i < sampleCount; i++) {
                   const int isSeed = seedSet.count(i) ? 1 : 0;
                   csv << i << "," << training.sampleTimesSec[static_cast<size_t>(i)] << ","
                       << scores[static_cast<size_t>(i)] << ","
                       << (hasLogo[static_cast<size_t>(i)] ? 1 : 0) << ","
-                      << isSeed << "\n";
+                      << isSeed << ","
+                      << (scores[static_cast<size_t>(i)] < 0.0 ? 1 : 2) << "\n";
                 }
               }
             }
@@ -1759,6 +3694,132 @@ int main(int argc, char** argv) {
       }
     }
 
+    // Store freshly fitted models so later runs of this channel can warm start.
+    std::string registrySavedPath;
+    std::string registryModelId = warmModel ? warmModel->id : std::string();
+    if (registryApplies && !warmModel) {
+      model_registry::Entry entry;
+      entry.cornerIndex = args.cornerIndex;
+      entry.roiWidthPct = args.roiWidthPct;
+      entry.meanHist = training.model.meanHist;
+      entry.threshold = training.model.threshold;
+      entry.seedCount = static_cast<int>(training.model.logoSampleIndices.size());
+      if (tokayoModelPtr) {
+        entry.tokayoTemplate = tokayoModelPtr->logoTemplate;
+        entry.tokayoSubRect = tokayoModelPtr->logoSubRect;
+        entry.tokayoNccThreshold = tokayoModelPtr->nccThreshold;
+        entry.tokayoRoiSide = grayRois.empty() ? 0 : grayRois[0].cols;
+      }
+      try {
+        registrySavedPath = model_registry::save(args.modelRegistryDir, registryChannel, entry);
+        progress(args, "Registry: modelo guardado en " + registrySavedPath);
+      } catch (const std::exception& e) {
+        progress(args, std::string("Registry: no se pudo guardar el modelo: ") + e.what());
+      }
+      if (!registrySavedPath.empty()) registryModelId = entry.id;
+    }
+
+    // Record which model covered each weekday/hour slot of this run, feeding the time-of-day index.
+    size_t registrySlots = 0;
+    if (registryApplies && !registryModelId.empty()) {
+      std::map<int, std::unordered_map<std::string, int>> slotUses;
+      for (int i = 0; i < sampleCount; i++) {
+        const auto& ms = sampleEpochMs[static_cast<size_t>(i)];
+        if (!ms.has_value()) continue;
+        const int slot = model_registry::slotOf(ms.value());
+        if (scheduleScores.empty()) {
+          slotUses[slot][registryModelId]++;
+          continue;
+        }
+        const auto& sc = scheduleScores[static_cast<size_t>(i)];
+        if (sc.entryIndex >= 0 && sc.normDist <= 1.0) slotUses[slot][registryEntries[static_cast<size_t>(sc.entryIndex)].id]++;
+      }
+      std::vector<std::pair<std::string, int>> idSlots;
+      for (const auto& kv : slotUses) {
+        const auto best = std::max_element(kv.second.begin(), kv.second.end(),
+                                           [](const auto& a, const auto& b) { return a.second < b.second; });
+        idSlots.emplace_back(best->first, kv.first);
+      }
+      model_registry::recordUsage(args.modelRegistryDir, registryChannel, idSlots);
+      registrySlots = idSlots.size();
+    }
+
+    // Both boundary windows of an AD are submitted once it passes --min-ad-sec.
+    // --cascade for refine and live follow: calibrated on every sample, labelled by the same full
+    // scorer the probes fall back to.
+    std::optional<CascadeGate> refineGate;
+    if (args.cascade) {
+      std::vector<logo_detector::LumaStats> stats = training.sampleLumaStats;
+      cv::Rect subRect;
+      if (tokayoModelPtr && !grayRois.empty()) {
+        subRect = tokayoModelPtr->logoSubRect & cv::Rect(0, 0, grayRois[0].cols, grayRois[0].rows);
+        stats.clear();
+        if (!subRect.empty()) {
+          for (const auto& g : grayRois) stats.push_back(logo_detector::lumaStats(g(subRect)));
+        }
+      }
+      const bool binary = tokayoModelPtr || mcdModelPtr || knnModelPtr;
+      if (static_cast<int>(stats.size()) == sampleCount && (binary || !training.model.meanHist.empty())) {
+        std::vector<char> labels(static_cast<size_t>(sampleCount), 0);
+        for (int i = 0; i < sampleCount; i++) {
+          labels[static_cast<size_t>(i)] =
+              binary ? hasLogo[static_cast<size_t>(i)]
+                     : (cv::compareHist(training.sampleHists.row(i), training.model.meanHist, cv::HISTCMP_BHATTACHARYYA) <=
+                        training.model.threshold);
+        }
+        std::vector<int> all(static_cast<size_t>(sampleCount));
+        std::iota(all.begin(), all.end(), 0);
+        refineGate = calibrateCascade(stats, labels, all);
+      }
+      if (refineGate) {
+        refineGate->subRect = subRect;
+        refineGate->cornerIndex = args.cornerIndex;
+        refineGate->roiWidthPct = args.roiWidthPct;
+        refineGate->counters = &refineCascade;
+        progress(args, "Cascade (refine): radios logo=" + std::to_string(refineGate->logoRadius) +
+                           ", no-logo=" + std::to_string(refineGate->noLogoRadius));
+      } else {
+        progress(args, "Cascade (refine): sin muestras suficientes por clase; sin prefiltro");
+      }
+    }
+    // Refine and live follow score each probe with its slot's scheduled model.
+    std::optional<SlotSchedule> slotSchedule;
+    if (!scheduleScores.empty()) {
+      slotSchedule.emplace();
+      for (const auto& kv : scheduleSlotEntry) {
+        const auto& entry = registryEntries[static_cast<size_t>(kv.second)];
+        if (entry.id == warmModel->id) continue;
+        if (tokayoModelPtr) {
+          if (entry.tokayoTemplate.empty()) continue;
+          TokayoModel m = *tokayoModelPtr;
+          m.logoTemplate = entry.tokayoTemplate;
+          m.logoSubRect = entry.tokayoSubRect;
+          m.nccThreshold = entry.tokayoNccThreshold;
+          m.sparse = SparseLogoMask();
+          slotSchedule->tokayo.emplace(kv.first, std::move(m));
+        } else if (histModel && !entry.meanHist.empty()) {
+          logo_detector::LogoModel m = training.model;
+          m.meanHist = entry.meanHist;
+          m.threshold = entry.threshold;
+          slotSchedule->hist.emplace(kv.first, std::move(m));
+        }
+      }
+      slotSchedule->epochOf = [segments, segEpochMs](double offsetSec) {
+        return offsetToEpochMs(segments, segEpochMs, offsetSec);
+      };
+    }
+    refinePool.setModel(training.model, tokayoModelPtr.get(), mcdModelPtr.get(), refineGate ? &*refineGate : nullptr,
+                            knnModelPtr.get(), slotSchedule ? &*slotSchedule : nullptr);
+    std::vector<RefineWindows> refineWindows;
+    auto submitWindows = [&](double startSec, double endSec) {
+      RefineWindows w;
+      w.startTimes = windowTimes(startSec);
+      w.startId = refinePool.submit(w.startTimes);
+      w.endTimes = windowTimes(endSec);
+      w.endId = refinePool.submit(w.endTimes);
+      return w;
+    };
+
     bool inAd = false;
     double adStart = 0.0;
     int noLogoStreak = 0;
@@ -1774,6 +3835,10 @@ int main(int argc, char** argv) {
                                                  : ((i < static_cast<int>(distSmooth.size())) ? (distSmooth[static_cast<size_t>(i)] >= enterTh) : false);
       const bool strongLogo = useBinaryHasLogo ? (logoNow)
                                                : ((i < static_cast<int>(distSmooth.size())) ? (distSmooth[static_cast<size_t>(i)] <= exitTh) : true);
+      ADS_TRACE3(classify, static_cast<int64_t>(i), logoNow ? 1 : 0,
+                 (!useBinaryHasLogo && i < static_cast<int>(distSmooth.size()))
+                     ? static_cast<int64_t>(std::llround(distSmooth[static_cast<size_t>(i)] * 1e6))
+                     : int64_t{-1});
 
       if (!inAd) {
         if (strongNoLogo) {
@@ -1810,6 +3875,8 @@ int main(int argc, char** argv) {
             it.startPdt = offsetToProgramDateTime(segments, segEpochMs, adStart);
             it.endPdt = offsetToProgramDateTime(segments, segEpochMs, adEnd);
             ads.push_back(std::move(it));
+            refineWindows.push_back(submitWindows(adStart, adEnd));
+            progressCounters.adsFound.fetch_add(1, std::memory_order_relaxed);
             progress(args,
                      "Ad detectado: " + formatSec(adStart) + " (" + formatHms(adStart) + ") -> " +
                          formatSec(adEnd) + " (" + formatHms(adEnd) + ")");
@@ -1828,6 +3895,8 @@ int main(int argc, char** argv) {
         it.startPdt = offsetToProgramDateTime(segments, segEpochMs, adStart);
         it.endPdt = offsetToProgramDateTime(segments, segEpochMs, adEnd);
         ads.push_back(std::move(it));
+        refineWindows.push_back(submitWindows(adStart, adEnd));
+        progressCounters.adsFound.fetch_add(1, std::memory_order_relaxed);
         progress(args,
                  "Ad detectado: " + formatSec(adStart) + " (" + formatHms(adStart) + ") -> " +
                      formatSec(adEnd) + " (" + formatHms(adEnd) + ")");
@@ -1835,20 +3904,82 @@ int main(int argc, char** argv) {
     }
 
     // Second pass: refine boundaries around each detected AD interval.
-    refineIntervalsIterative(args, args.m3u8, totalDurationSec, training.model, ads,
-                             args.debug ? &logosOutDir : nullptr,
-                             tokayoModelPtr.get());
+    progressCounters.setStage(progress_reporter::Stage::Refining);
+    const bool refined = refineIntervalsIterative(args, refinePool, refineWindows, ads,
+                                                  args.debug ? &logosOutDir : nullptr, progressCounters);
+    refinePool.close();
+    if (refineGate) {
+      progress(args, "Cascade (refine): etapa 1 logo=" + std::to_string(refineCascade.logo.load()) +
+                         ", no-logo=" + std::to_string(refineCascade.noLogo.load()) +
+                         ", completo=" + std::to_string(refineCascade.full.load()));
+    }
+    std::optional<sprite_sheet::Summary> spriteSummary;
+    if (sprites) {
+      spriteSummary = sprites->write(totalDurationSec);
+      progress(args, "Sprites: " + std::to_string(spriteSummary->tiles) + " tiles en " +
+                         std::to_string(spriteSummary->sheets) + " hojas -> " + args.spritesDir);
+    }
     for (auto& it : ads) {
       it.startPdt = offsetToProgramDateTime(segments, segEpochMs, it.startSec);
       it.endPdt = offsetToProgramDateTime(segments, segEpochMs, it.endSec);
     }
 
-    const fs::path outPath(args.outputPath);
-    ensureParentDirExists(outPath);
+    progressCounters.setStage(progress_reporter::Stage::Output);
+    // Zero-transcode VOD: same segments, ads dropped, discontinuities at each cut.
+    std::optional<m3u8::VodPlaylist> vod;
+    if (!args.emitVodPath.empty()) {
+      std::vector<m3u8::TimeRange> removed;
+      removed.reserve(ads.size());
+      for (const auto& it : ads) removed.push_back(m3u8::TimeRange{it.startSec, it.endSec});
+      vod = m3u8::buildVod(segments, removed, args.m3u8);
+      const fs::path vodPath(args.emitVodPath);
+      ensureParentDirExists(vodPath);
+      std::ofstream vodOut(vodPath);
+      if (!vodOut.is_open()) throw std::runtime_error("could not open VOD playlist file: " + args.emitVodPath);
+      vodOut << vod->content;
+      progress(args, "VOD m3u8 escrito en: " + args.emitVodPath +
+                         " (segmentos: " + std::to_string(vod->keptSegments) +
+                         ", removidos: " + std::to_string(vod->removedSegments) + ")");
+    }
+
+    // Stream-copy remux of the kept content; cuts snap to the nearest keyframe.
+    std::optional<remux::Stats> remuxStats;
+    if (!args.remuxOutPath.empty()) {
+      const auto kept = keptRanges(ads, totalDurationSec);
+      progress(args, std::string("Remux (") + (args.smartCut ? "smart-cut" : "stream copy") +
+                         "): rangos=" + std::to_string(kept.size()) + " -> " + args.remuxOutPath);
+      ensureParentDirExists(fs::path(args.remuxOutPath));
+      remux::Options remuxOpts;
+      remuxOpts.smartCut = args.smartCut;
+      remuxStats = remux::writeMp4(segments, kept, args.m3u8, args.remuxOutPath, remuxOpts);
+      progress(args, "Remux: segmentos leidos=" + std::to_string(remuxStats->segmentsRead) +
+                         ", paquetes=" + std::to_string(remuxStats->packetsWritten) +
+                         ", GOPs re-encodeados=" + std::to_string(remuxStats->gopsReencoded) +
+                         ", duracion=" + formatSec(remuxStats->outputDurationSec));
+    }
+
+    // Live follow: keep classifying new parts/segments as they are published.
+    std::optional<LiveStats> live;
+    if (args.liveFollowSec > 0.0) {
+      const bool openAtEnd = !ads.empty() && ads.back().endSec >= totalDurationSec;
+      progress(args, "Live: siguiendo playlist por " + formatSec(args.liveFollowSec) +
+                         (playlist.partTargetSec > 0.0 ? " (LL-HLS, part-target=" + formatSec(playlist.partTargetSec) + ")"
+                                                       : "") +
+                         (playlist.canBlockReload ? ", blocking reload" : ""));
+      progressCounters.setStage(progress_reporter::Stage::Live);
+      live = followLive(args, playlist, training.model, tokayoModelPtr.get(), mcdModelPtr.get(),
+                        refineGate ? &*refineGate : nullptr, knnModelPtr.get(), slotSchedule ? &*slotSchedule : nullptr,
+                        openAtEnd,
+                        openAtEnd ? ads.back().startSec : 0.0, progressCounters);
+      progress(args, "Live: recargas=" + std::to_string(live->reloads) +
+                         ", partes=" + std::to_string(live->partsSampled) +
+                         ", segmentos=" + std::to_string(live->segmentsSampled) +
+                         ", eventos=" + std::to_string(live->events.size()));
+    }
+
     const auto processEnd = std::chrono::steady_clock::now();
     const auto elapsedMs =
         std::chrono::duration_cast<std::chrono::milliseconds>(processEnd - processStart).count();
-    const double elapsedSec = static_cast<double>(elapsedMs) / 1000.0;
 
     std::ostringstream json;
     json << "{\n";
@@ -1856,26 +3987,73 @@ int main(int argc, char** argv) {
     json_util::writeString(json, args.m3u8);
     json << ",\n";
     json << "  \"totalDurationSec\": " << totalDurationSec << ",\n";
-    json << "  \"process\": {\n";
-    json << "    \"elapsedMs\": " << elapsedMs << ",\n";
-    json << "    \"elapsedSec\": " << elapsedSec << "\n";
-    json << "  },\n";
+    writeRunStats(json, args, static_cast<int64_t>(elapsedMs), startupMs, firstSampleMs.load(), kfIndex.get());
+    json << "  \"sprites\": ";
+    if (spriteSummary.has_value()) {
+      json << "{\"dir\": ";
+      json_util::writeString(json, args.spritesDir);
+      json << ", \"tiles\": " << spriteSummary->tiles << ", \"sheets\": " << spriteSummary->sheets
+           << ", \"tileWidth\": " << spriteSummary->tileWidth << ", \"tileHeight\": " << spriteSummary->tileHeight
+           << ", \"vtt\": ";
+      json_util::writeString(json, spriteSummary->vttPath);
+      json << ", \"index\": ";
+      json_util::writeString(json, spriteSummary->jsonPath);
+      json << "}";
+    } else {
+      json << "null";
+    }
+    json << ",\n";
+    json << "  \"resultCache\": ";
+    if (!resultCacheKey.empty()) json << "{\"key\": \"" << resultCacheKey << "\", \"hit\": false}";
+    else json << "null";
+    json << ",\n";
     json << "  \"training\": {\n";
     json << "    \"sampleEverySec\": " << training.sampleEverySec << ",\n";
     json << "    \"sampleCount\": " << training.sampleTimesSec.size() << ",\n";
+    json << "    \"trainConverge\": " << args.trainConverge << ",\n";
+    json << "    \"trainSamples\": " << (args.tokayo && tokayoTrainSamples > 0 ? tokayoTrainSamples : histTrainSamples)
+         << ",\n";
+    json << "    \"samplingStalls\": {\"stalled\": " << training.stalledReads
+         << ", \"reassigned\": " << training.reassignedSamples << ", \"dropped\": " << training.droppedSamples << "},\n";
     json << "    \"roiWidthPct\": " << args.roiWidthPct << ",\n";
     json << "    \"k\": " << args.k << ",\n";
     json << "    \"logoCorner\": ";
     json_util::writeString(json, cornerName(training.model.cornerIndex));
     json << ",\n";
-    json << "    \"logoThresholdBhattacharyya\": " << training.model.threshold << ",\n";
+    json << "    \"logoThresholdBhattacharyya\": ";
+    if (training.model.meanHist.empty()) json << "null";
+    else json << training.model.threshold;
+    json << ",\n";
     json << "    \"detection\": {\n";
     json << "      \"strategy\": ";
     json_util::writeString(json, args.tokayo ? "tokayo" : (args.outlier ? "outlier" : "bhattacharyya"));
     json << ",\n";
+    json << "      \"cascade\": ";
+    if (!args.cascade) {
+      json << "null";
+    } else {
+      const auto writeStages = [&json](const CascadeCounters& c) {
+        json << "{\"stage1Logo\": " << c.logo.load() << ", \"stage1NoLogo\": " << c.noLogo.load()
+             << ", \"fullScorer\": " << c.full.load() << "}";
+      };
+      json << "{\"coarseCalibrationSamples\": " << coarseCascadeCalibrated << ", \"coarse\": ";
+      if (coarseCascadeCalibrated > 0) writeStages(coarseCascade);
+      else json << "null";
+      json << ", \"refine\": ";
+      if (refineGate) writeStages(refineCascade);
+      else json << "null";
+      json << "}";
+    }
+    json << ",\n";
     if (args.tokayo) {
       json << "      \"tokayo\": {\n";
-      json << "        \"method\": \"pixel-median + NCC\",\n";
+      const bool sparse = tokayoModelPtr && !tokayoModelPtr->sparse.empty();
+      json << "        \"method\": " << (sparse ? "\"pixel-median + sparse mask\"" : "\"pixel-median + NCC\"") << ",\n";
+      if (sparse) {
+        json << "        \"sparseMask\": {\"logoPixels\": " << tokayoModelPtr->sparse.logoPixels
+             << ", \"ringPixels\": " << (tokayoModelPtr->sparse.offsets.size() - tokayoModelPtr->sparse.logoPixels)
+             << "},\n";
+      }
       if (tokayoModelPtr) {
         json << "        \"nccThreshold\": " << tokayoModelPtr->nccThreshold << ",\n";
         json << "        \"logoSubRect\": {"
@@ -1909,7 +4087,35 @@ int main(int argc, char** argv) {
         json << "      \"knn\": {\n";
         json << "        \"k\": " << usedKnnK << ",\n";
         json << "        \"quantile\": " << usedKnnQ << ",\n";
-        json << "        \"threshold\": " << usedKnnThreshold << "\n";
+        json << "        \"threshold\": " << usedKnnThreshold << ",\n";
+        json << "        \"medoids\": ";
+        if (condensedSeeds) {
+          json << "{\"count\": " << condensedSeeds->medoids.size() << ", \"seeds\": "
+               << condensedSeeds->clusterOf.size() << "}";
+        } else {
+          json << "null";
+        }
+        json << ",\n";
+        json << "        \"ann\": ";
+        if (knnModelPtr && knnModelPtr->index) {
+          json << "{\"index\": \"ivf-flat\", \"seeds\": " << knnModelPtr->index->size()
+               << ", \"nlist\": " << knnModelPtr->index->nlist() << ", \"nprobe\": " << knnModelPtr->index->nprobe()
+               << ", \"recallAtK\": " << annRecall << ", \"buildMs\": " << annBuildMs << "}";
+        } else {
+          json << "null";
+        }
+        json << "\n";
+        json << "      },\n";
+      } else if (args.outlierMode == "mcd") {
+        json << "      \"mcd\": {\n";
+        json << "        \"supportFraction\": " << args.mcdSupport << ",\n";
+        json << "        \"supportSize\": " << mcdSupportSize << ",\n";
+        if (mcdModelPtr) {
+          json << "        \"center\": [" << mcdModelPtr->center.x << ", " << mcdModelPtr->center.y << "],\n";
+        } else {
+          json << "        \"center\": null,\n";
+        }
+        json << "        \"threshold\": " << args.mcdThreshold << "\n";
         json << "      },\n";
       }
       json << "      \"enterConsecutive\": " << args.enterConsecutive << ",\n";
@@ -1925,6 +4131,32 @@ int main(int argc, char** argv) {
     }
     json << "    }\n";
     json << "  },\n";
+    json << "  \"registry\": ";
+    if (registryApplies) {
+      json << "{\n";
+      json << "    \"channel\": ";
+      json_util::writeString(json, registryChannel);
+      json << ",\n";
+      json << "    \"candidates\": " << registryCandidates << ",\n";
+      json << "    \"warmStart\": " << (warmModel ? "true" : "false") << ",\n";
+      json << "    \"mode\": \""
+           << (!scheduleScores.empty() ? "schedule" : (warmModel ? "single" : "trained"))
+           << "\",\n";
+      json << "    \"slots\": " << registrySlots << ",\n";
+      json << "    \"model\": ";
+      if (warmModel) json_util::writeString(json, warmModel->id);
+      else json << "null";
+      json << ",\n";
+      json << "    \"logoFraction\": " << registryMatch.logoFraction << ",\n";
+      json << "    \"margin\": " << registryMatch.margin << ",\n";
+      json << "    \"saved\": ";
+      if (!registrySavedPath.empty()) json_util::writeString(json, registrySavedPath);
+      else json << "null";
+      json << "\n";
+      json << "  },\n";
+    } else {
+      json << "null,\n";
+    }
     json << "  \"ads\": [\n";
     for (size_t i = 0; i < ads.size(); i++) {
       const auto& it = ads[i];
@@ -1944,10 +4176,78 @@ int main(int argc, char** argv) {
       json << "      \"endProgramDateTime\": ";
       if (it.endPdt.has_value()) json_util::writeString(json, it.endPdt.value());
       else json << "null";
-      json << "\n";
+      json << ",\n";
+      json << "      \"startOnBlank\": " << (it.startOnBlank ? "true" : "false") << ",\n";
+      json << "      \"endOnBlank\": " << (it.endOnBlank ? "true" : "false") << "\n";
       json << "    }" << (i + 1 < ads.size() ? "," : "") << "\n";
     }
     json << "  ],\n";
+    json << "  \"vod\": ";
+    if (vod.has_value()) {
+      json << "{\n";
+      json << "    \"playlist\": ";
+      json_util::writeString(json, args.emitVodPath);
+      json << ",\n";
+      json << "    \"keptSegments\": " << vod->keptSegments << ",\n";
+      json << "    \"removedSegments\": " << vod->removedSegments << ",\n";
+      json << "    \"durationSec\": " << vod->keptDurationSec << "\n";
+      json << "  },\n";
+    } else {
+      json << "null,\n";
+    }
+    json << "  \"remux\": ";
+    if (remuxStats.has_value()) {
+      json << "{\n";
+      json << "    \"output\": ";
+      json_util::writeString(json, args.remuxOutPath);
+      json << ",\n";
+      json << "    \"mode\": ";
+      json_util::writeString(json, args.smartCut ? "smart-cut" : "stream-copy");
+      json << ",\n";
+      json << "    \"ranges\": " << remuxStats->rangesWritten << ",\n";
+      json << "    \"segmentsRead\": " << remuxStats->segmentsRead << ",\n";
+      json << "    \"packets\": " << remuxStats->packetsWritten << ",\n";
+      json << "    \"gopsReencoded\": " << remuxStats->gopsReencoded << ",\n";
+      json << "    \"framesReencoded\": " << remuxStats->framesReencoded << ",\n";
+      json << "    \"durationSec\": " << remuxStats->outputDurationSec << "\n";
+      json << "  },\n";
+    } else {
+      json << "null,\n";
+    }
+    json << "  \"live\": ";
+    if (live.has_value()) {
+      json << "{\n";
+      json << "    \"followedSec\": " << live->followedSec << ",\n";
+      json << "    \"lowLatency\": " << (live->lowLatency ? "true" : "false") << ",\n";
+      json << "    \"blockingReload\": " << (live->blockingReload ? "true" : "false") << ",\n";
+      json << "    \"reloads\": " << live->reloads << ",\n";
+      json << "    \"partsSampled\": " << live->partsSampled << ",\n";
+      json << "    \"segmentsSampled\": " << live->segmentsSampled << ",\n";
+      json << "    \"prefetchHits\": " << live->prefetchHits << ",\n";
+      json << "    \"decodeFailures\": " << live->decodeFailures << ",\n";
+      json << "    \"error\": ";
+      if (!live->error.empty()) json_util::writeString(json, live->error);
+      else json << "null";
+      json << ",\n";
+      json << "    \"events\": [\n";
+      for (size_t i = 0; i < live->events.size(); i++) {
+        const auto& ev = live->events[i];
+        json << "      {\"type\": ";
+        json_util::writeString(json, ev.adStart ? "adStart" : "adEnd");
+        json << ", \"offsetSec\": " << ev.offsetSec << ", \"programDateTime\": ";
+        if (ev.pdt.has_value()) json_util::writeString(json, ev.pdt.value());
+        else json << "null";
+        json << ", \"latencySec\": ";
+        if (ev.latencySec >= 0.0) json << ev.latencySec;
+        else json << "null";
+        if (!ev.adStart) json << ", \"durationSec\": " << ev.durationSec;
+        json << "}" << (i + 1 < live->events.size() ? "," : "") << "\n";
+      }
+      json << "    ]\n";
+      json << "  },\n";
+    } else {
+      json << "null,\n";
+    }
     json << "  \"debug\": {\n";
     json << "    \"enabled\": " << (args.debug ? "true" : "false") << ",\n";
     json << "    \"logosOutputDir\": ";
@@ -1960,11 +4260,20 @@ int main(int argc, char** argv) {
 
     const std::string jsonStr = json.str();
 
-    std::ofstream out(outPath);
-    if (!out.is_open()) throw std::runtime_error("could not open output file: " + args.outputPath);
-    progress(args, "Escribiendo salida JSON en: " + args.outputPath);
-    out << jsonStr;
-    out.close();
+    writeOutputJson(args, jsonStr);
+    // Only results a rerun would reproduce are stored: no samples dropped by the stall watchdog, no
+    // refine fallback, and no model saved to the registry by this run (that changes the registry
+    // fingerprint, so the next identical request warm-starts from it and gets its own key).
+    if (!resultCacheKey.empty()) {
+      if (training.droppedSamples == 0 && refined && registrySavedPath.empty()) {
+        result_cache::store(args.resultCacheDir, resultCacheKey, jsonStr);
+      } else {
+        progress(args, "Result cache: resultado no guardado (muestras descartadas, refine sin terminar o modelo nuevo)");
+      }
+    }
+
+    progressCounters.setStage(progress_reporter::Stage::Done);
+    if (progressReporter) progressReporter->stop();
 
     // Always print JSON to stdout, even with --quiet.
     std::cout << jsonStr;
@@ -1972,6 +4281,10 @@ int main(int argc, char** argv) {
     return 0;
   } catch (const std::exception& e) {
     std::cerr << "ads_detector error: " << e.what() << "\n";
+    flight_recorder::record(flight_recorder::Kind::Error, 0, 0, 0, e.what());
+    if (flight_recorder::dump("error")) {
+      std::cerr << "ads_detector: flight recorder -> " << flight_recorder::dumpPath() << "\n";
+    }
     return 1;
   }
 }
@@ -0,0 +1,385 @@
+#include "model_registry.h"
+
+#include "time_util.h"
+
+#include <opencv2/imgproc.hpp>
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <ctime>
+#include <filesystem>
+#include <fstream>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+namespace fs = std::filesystem;
+
+namespace {
+
+constexpr double kMinLogoFraction = 0.40;     // Most programming carries the bug
+constexpr double kMaxAmbiguousFraction = 0.10;
+constexpr double kHistBandRel = 0.20;         // Bhattacharyya: |d - th| < 20% of th is ambiguous
+constexpr double kNccBand = 0.10;             // Tokayo: |ncc - th| < 0.1 is ambiguous
+
+std::string sanitize(const std::string& s) {
+  std::string out;
+  out.reserve(s.size());
+  for (const char c : s) {
+    const bool keep = (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || (c >= '0' && c <= '9') || c == '-' ||
+                      c == '.';
+    out += keep ? c : '_';
+  }
+  return out.empty() ? "default" : out;
+}
+
+std::vector<int> probeIndices(int sampleCount, int probeCount) {
+  std::vector<int> idx;
+  if (sampleCount <= 0) return idx;
+  const int n = std::max(1, std::min(sampleCount, probeCount));
+  idx.reserve(static_cast<size_t>(n));
+  for (int i = 0; i < n; i++) {
+    idx.push_back(static_cast<int>((static_cast<int64_t>(i) * sampleCount) / n));
+  }
+  return idx;
+}
+
+struct Decision {
+  bool logo = false;
+  bool ambiguous = false;
+  double margin = 0.0;
+};
+
+model_registry::Match summarize(int entryIndex, const std::vector<Decision>& decisions) {
+  model_registry::Match m;
+  m.entryIndex = entryIndex;
+  m.probed = decisions.size();
+  if (decisions.empty()) return m;
+  double logo = 0.0;
+  double ambiguous = 0.0;
+  double margin = 0.0;
+  for (const auto& d : decisions) {
+    logo += d.logo ? 1.0 : 0.0;
+    ambiguous += d.ambiguous ? 1.0 : 0.0;
+    margin += d.margin;
+  }
+  const double n = static_cast<double>(decisions.size());
+  m.logoFraction = logo / n;
+  m.ambiguousFraction = ambiguous / n;
+  m.margin = margin / n;
+  return m;
+}
+
+bool fits(const model_registry::Match& m) {
+  return m.probed > 0 && m.logoFraction >= kMinLogoFraction && m.ambiguousFraction <= kMaxAmbiguousFraction;
+}
+
+// Scales the template and its sub-rect from the ROI side they were cut at to `roiSide`.
+// The template is dropped if the scaled rect falls outside the ROI.
+void resampleTokayo(model_registry::Entry& e, int roiSide) {
+  if (e.tokayoTemplate.empty() || e.tokayoRoiSide <= 0 || e.tokayoRoiSide == roiSide) return;
+  const double s = static_cast<double>(roiSide) / e.tokayoRoiSide;
+  const cv::Rect scaled(static_cast<int>(std::lround(e.tokayoSubRect.x * s)),
+                        static_cast<int>(std::lround(e.tokayoSubRect.y * s)),
+                        std::max(1, static_cast<int>(std::lround(e.tokayoSubRect.width * s))),
+                        std::max(1, static_cast<int>(std::lround(e.tokayoSubRect.height * s))));
+  const cv::Rect sub = scaled & cv::Rect(0, 0, roiSide, roiSide);
+  if (sub.width < 4 || sub.height < 4) {
+    e.tokayoTemplate.release();
+    return;
+  }
+  cv::Mat resized;
+  cv::resize(e.tokayoTemplate, resized, sub.size(), 0, 0, s < 1.0 ? cv::INTER_AREA : cv::INTER_LINEAR);
+  e.tokayoTemplate = resized;
+  e.tokayoSubRect = sub;
+  e.tokayoRoiSide = roiSide;
+}
+
+}  // namespace
+
+namespace model_registry {
+
+int slotOf(int64_t epochMs) {
+  const std::time_t tt = static_cast<std::time_t>(epochMs / 1000);
+  std::tm tm{};
+  gmtime_r(&tt, &tm);
+  return tm.tm_wday * 24 + tm.tm_hour;
+}
+
+std::vector<std::string> UsageIndex::candidates(int slot, size_t maxCount) const {
+  std::unordered_map<std::string, double> score;
+  const int day = slot / 24;
+  const int hour = slot % 24;
+  for (int dh = -1; dh <= 1; dh++) {
+    const int h = (hour + dh + 24) % 24;
+    const int d = (day + (hour + dh < 0 ? 6 : (hour + dh > 23 ? 1 : 0))) % 7;
+    const auto it = counts.find(d * 24 + h);
+    if (it == counts.end()) continue;
+    for (const auto& kv : it->second) score[kv.first] += (dh == 0 ? 1.0 : 0.5) * kv.second;
+  }
+  std::vector<std::pair<std::string, double>> ranked(score.begin(), score.end());
+  std::sort(ranked.begin(), ranked.end(), [](const auto& a, const auto& b) {
+    return a.second != b.second ? a.second > b.second : a.first < b.first;
+  });
+  std::vector<std::string> out;
+  for (size_t i = 0; i < ranked.size() && out.size() < maxCount; i++) out.push_back(ranked[i].first);
+  return out;
+}
+
+UsageIndex loadUsage(const std::string& dir, const std::string& channel) {
+  UsageIndex index;
+  std::ifstream in(fs::path(dir) / sanitize(channel) / "usage.log");
+  std::string line;
+  while (std::getline(in, line)) {
+    std::istringstream fields(line);
+    std::string id;
+    int slot = -1;
+    if (!(fields >> id >> slot) || slot < 0 || slot >= 7 * 24) continue;
+    index.counts[slot][id]++;
+  }
+  return index;
+}
+
+void recordUsage(const std::string& dir,
+                 const std::string& channel,
+                 const std::vector<std::pair<std::string, int>>& idSlots) {
+  if (idSlots.empty()) return;
+  const fs::path channelDir = fs::path(dir) / sanitize(channel);
+  std::error_code ec;
+  fs::create_directories(channelDir, ec);
+  // One short line per record, written in a single append, so concurrent runs interleave cleanly.
+  std::ostringstream lines;
+  for (const auto& rec : idSlots) lines << rec.first << " " << rec.second << "\n";
+  std::ofstream out(channelDir / "usage.log", std::ios::app);
+  out << lines.str();
+}
+
+std::string channelKey(const std::string& playlistUrl) {
+  std::string s = playlistUrl.substr(0, playlistUrl.find('?'));
+  const size_t scheme = s.find("://");
+  if (scheme != std::string::npos) s = s.substr(scheme + 3);
+  const size_t slash = s.rfind('/');
+  if (slash != std::string::npos) s = s.substr(0, slash);
+  return sanitize(s);
+}
+
+std::string fingerprint(const std::string& dir, const std::string& channel) {
+  std::vector<std::string> ids;
+  std::error_code ec;
+  for (const auto& de : fs::directory_iterator(fs::path(dir) / sanitize(channel), ec)) {
+    if (de.path().extension() == ".yml") ids.push_back(de.path().stem().string());
+  }
+  std::sort(ids.begin(), ids.end());
+  std::string out;
+  for (const auto& id : ids) out += (out.empty() ? "" : ",") + id;
+  return out;
+}
+
+std::vector<Entry> load(const std::string& dir,
+                        const std::string& channel,
+                        int cornerIndex,
+                        double roiWidthPct,
+                        int tokayoRoiSide) {
+  std::vector<Entry> entries;
+  const fs::path channelDir = fs::path(dir) / sanitize(channel);
+  std::error_code ec;
+  if (!fs::is_directory(channelDir, ec)) return entries;
+
+  std::vector<fs::path> files;
+  for (const auto& de : fs::directory_iterator(channelDir, ec)) {
+    if (de.path().extension() == ".yml") files.push_back(de.path());
+  }
+  std::sort(files.begin(), files.end());
+
+  for (const auto& p : files) {
+    try {
+      cv::FileStorage fsIn(p.string(), cv::FileStorage::READ);
+      if (!fsIn.isOpened()) continue;
+      Entry e;
+      e.id = p.stem().string();
+      fsIn["cornerIndex"] >> e.cornerIndex;
+      fsIn["roiWidthPct"] >> e.roiWidthPct;
+      if (e.cornerIndex != cornerIndex || std::abs(e.roiWidthPct - roiWidthPct) > 1e-6) continue;
+      fsIn["meanHist"] >> e.meanHist;
+      fsIn["threshold"] >> e.threshold;
+      fsIn["seedCount"] >> e.seedCount;
+      fsIn["createdAt"] >> e.createdAt;
+      if (!fsIn["tokayoTemplate"].empty()) {
+        fsIn["tokayoTemplate"] >> e.tokayoTemplate;
+        fsIn["tokayoSubRectX"] >> e.tokayoSubRect.x;
+        fsIn["tokayoSubRectY"] >> e.tokayoSubRect.y;
+        fsIn["tokayoSubRectW"] >> e.tokayoSubRect.width;
+        fsIn["tokayoSubRectH"] >> e.tokayoSubRect.height;
+        fsIn["tokayoNccThreshold"] >> e.tokayoNccThreshold;
+        fsIn["tokayoRoiSide"] >> e.tokayoRoiSide;
+        if (tokayoRoiSide > 0) resampleTokayo(e, tokayoRoiSide);
+      }
+      if (e.meanHist.empty() && e.tokayoTemplate.empty()) continue;
+      entries.push_back(std::move(e));
+    } catch (const std::exception&) {
+      continue;
+    }
+  }
+  return entries;
+}
+
+std::string save(const std::string& dir, const std::string& channel, Entry& entry) {
+  const fs::path channelDir = fs::path(dir) / sanitize(channel);
+  std::error_code ec;
+  fs::create_directories(channelDir, ec);
+  if (ec) throw std::runtime_error("could not create model registry dir: " + channelDir.string());
+
+  const int64_t nowMs = std::chrono::duration_cast<std::chrono::milliseconds>(
+                            std::chrono::system_clock::now().time_since_epoch()).count();
+  entry.id = "corner" + std::to_string(entry.cornerIndex) + "_" + std::to_string(nowMs);
+  entry.createdAt = time_util::epochMsToIso8601Utc(nowMs);
+
+  // Write next to the final name and rename, so concurrent runs never load a partial file.
+  const fs::path finalPath = channelDir / (entry.id + ".yml");
+  const fs::path tmpPath = channelDir / (entry.id + ".yml.tmp");
+  {
+    cv::FileStorage out(tmpPath.string(), cv::FileStorage::WRITE | cv::FileStorage::FORMAT_YAML);
+    if (!out.isOpened()) throw std::runtime_error("could not write model registry entry: " + tmpPath.string());
+    out << "cornerIndex" << entry.cornerIndex;
+    out << "roiWidthPct" << entry.roiWidthPct;
+    out << "createdAt" << entry.createdAt;
+    out << "seedCount" << entry.seedCount;
+    out << "threshold" << entry.threshold;
+    out << "meanHist" << entry.meanHist;
+    if (!entry.tokayoTemplate.empty()) {
+      out << "tokayoTemplate" << entry.tokayoTemplate;
+      out << "tokayoSubRectX" << entry.tokayoSubRect.x;
+      out << "tokayoSubRectY" << entry.tokayoSubRect.y;
+      out << "tokayoSubRectW" << entry.tokayoSubRect.width;
+      out << "tokayoSubRectH" << entry.tokayoSubRect.height;
+      out << "tokayoNccThreshold" << entry.tokayoNccThreshold;
+      out << "tokayoRoiSide" << entry.tokayoRoiSide;
+    }
+    out.release();
+  }
+  fs::rename(tmpPath, finalPath, ec);
+  if (ec) throw std::runtime_error("could not store model registry entry: " + finalPath.string());
+  return finalPath.string();
+}
+
+std::vector<SampleScore> scoreCandidates(const std::vector<Entry>& entries,
+                                         const std::vector<std::vector<int>>& candidatesPerSample,
+                                         const cv::Mat& sampleHists,
+                                         const std::vector<cv::Mat>* grayRois) {
+  std::vector<SampleScore> scores(candidatesPerSample.size());
+  for (size_t i = 0; i < candidatesPerSample.size(); i++) {
+    for (int e : candidatesPerSample[i]) {
+      const auto& entry = entries[static_cast<size_t>(e)];
+      double nd = 0.0;
+      bool ambiguous = false;
+      if (grayRois) {
+        const cv::Mat& gray = (*grayRois)[i];
+        const cv::Rect sub = entry.tokayoSubRect & cv::Rect(0, 0, gray.cols, gray.rows);
+        if (entry.tokayoTemplate.empty() || gray.cols != entry.tokayoRoiSide ||
+            sub.width != entry.tokayoTemplate.cols || sub.height != entry.tokayoTemplate.rows) {
+          continue;
+        }
+        cv::Mat result;
+        cv::matchTemplate(gray(sub), entry.tokayoTemplate, result, cv::TM_CCOEFF_NORMED);
+        const double delta = result.at<float>(0, 0) - entry.tokayoNccThreshold;
+        nd = 1.0 - delta;
+        ambiguous = std::abs(delta) < kNccBand;
+      } else {
+        if (entry.meanHist.empty() || entry.meanHist.cols != sampleHists.cols) continue;
+        const double th = std::max(1e-6, entry.threshold);
+        nd = cv::compareHist(sampleHists.row(static_cast<int>(i)), entry.meanHist, cv::HISTCMP_BHATTACHARYYA) / th;
+        ambiguous = std::abs(nd - 1.0) < kHistBandRel;
+      }
+      if (scores[i].entryIndex < 0 || nd < scores[i].normDist) scores[i] = SampleScore{e, nd, ambiguous};
+    }
+  }
+  return scores;
+}
+
+bool scoresFit(const std::vector<SampleScore>& scores) {
+  std::vector<Decision> decisions;
+  decisions.reserve(scores.size());
+  for (const auto& sc : scores) {
+    if (sc.entryIndex < 0) continue;  // no model for this slot: unscored, not a misfit
+    decisions.push_back(Decision{sc.normDist <= 1.0, sc.ambiguous, std::abs(sc.normDist - 1.0)});
+  }
+  return !decisions.empty() && fits(summarize(0, decisions));
+}
+
+Match select(const std::vector<Entry>& entries,
+             const cv::Mat& sampleHists,
+             const std::vector<cv::Mat>* grayRois,
+             int probeCount) {
+  Match best;
+  if (entries.empty()) return best;
+
+  if (grayRois) {
+    // Tokayo: NCC of the probed ROIs against each stored template of the same ROI size.
+    const auto probes = probeIndices(static_cast<int>(grayRois->size()), probeCount);
+    for (size_t e = 0; e < entries.size(); e++) {
+      const auto& entry = entries[e];
+      if (entry.tokayoTemplate.empty()) continue;
+      std::vector<Decision> decisions;
+      decisions.reserve(probes.size());
+      for (int i : probes) {
+        const cv::Mat& gray = (*grayRois)[static_cast<size_t>(i)];
+        if (gray.cols != entry.tokayoRoiSide) break;
+        const cv::Rect sub = entry.tokayoSubRect & cv::Rect(0, 0, gray.cols, gray.rows);
+        if (sub.width != entry.tokayoTemplate.cols || sub.height != entry.tokayoTemplate.rows) break;
+        cv::Mat result;
+        cv::matchTemplate(gray(sub), entry.tokayoTemplate, result, cv::TM_CCOEFF_NORMED);
+        const double ncc = result.at<float>(0, 0);
+        const double delta = ncc - entry.tokayoNccThreshold;
+        decisions.push_back(Decision{delta >= 0.0, std::abs(delta) < kNccBand, std::abs(delta)});
+      }
+      if (decisions.size() != probes.size()) continue;
+      const Match m = summarize(static_cast<int>(e), decisions);
+      if (fits(m) && (best.entryIndex < 0 || m.margin > best.margin)) best = m;
+    }
+    return best;
+  }
+
+  // Bhattacharyya for normalized histograms is sqrt(1 - sum(sqrt(p * q))): with square-rooted
+  // rows the whole probe x model matrix is one GEMM.
+  const auto probes = probeIndices(sampleHists.rows, probeCount);
+  std::vector<int> histEntries;
+  cv::Mat models;
+  for (size_t e = 0; e < entries.size(); e++) {
+    if (entries[e].meanHist.empty() || entries[e].meanHist.cols != sampleHists.cols) continue;
+    cv::Mat h;
+    entries[e].meanHist.convertTo(h, CV_32F);
+    const double sum = cv::sum(h)[0];
+    if (sum > 0) h /= sum;
+    models.push_back(h);
+    histEntries.push_back(static_cast<int>(e));
+  }
+  if (histEntries.empty() || probes.empty()) return best;
+
+  cv::Mat probeHists;
+  for (int i : probes) probeHists.push_back(sampleHists.row(i));
+  cv::Mat sqrtProbes;
+  cv::Mat sqrtModels;
+  cv::sqrt(probeHists, sqrtProbes);
+  cv::sqrt(models, sqrtModels);
+  cv::Mat coeff;  // probes x models
+  cv::gemm(sqrtProbes, sqrtModels, 1.0, cv::Mat(), 0.0, coeff, cv::GEMM_2_T);
+
+  for (size_t m = 0; m < histEntries.size(); m++) {
+    const auto& entry = entries[static_cast<size_t>(histEntries[m])];
+    const double th = std::max(1e-6, entry.threshold);
+    std::vector<Decision> decisions;
+    decisions.reserve(probes.size());
+    for (int r = 0; r < coeff.rows; r++) {
+      const double d = std::sqrt(std::max(0.0, 1.0 - static_cast<double>(coeff.at<float>(r, static_cast<int>(m)))));
+      const double rel = (d - th) / th;
+      decisions.push_back(Decision{d <= th, std::abs(rel) < kHistBandRel, std::abs(rel)});
+    }
+    const Match match = summarize(histEntries[m], decisions);
+    if (fits(match) && (best.entryIndex < 0 || match.margin > best.margin)) best = match;
+  }
+  return best;
+}
+
+}  // namespace model_registry
@@ -0,0 +1,103 @@
+#pragma once
+
+#include <opencv2/core.hpp>
+
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+namespace model_registry {
+
+// A previously trained model, stored per channel and corner.
+struct Entry {
+  std::string id;                 // File stem inside the channel directory
+  int cornerIndex = 0;            // 0 TL, 1 TR, 2 BL, 3 BR
+  double roiWidthPct = 0.15;
+  cv::Mat meanHist;               // 1x512 CV_32F (Bhattacharyya model)
+  double threshold = 0.35;        // Bhattacharyya distance threshold
+  int seedCount = 0;              // Logo seeds the model was fitted on (informational)
+  // Tokayo template (empty when the model was trained without --tokayo).
+  cv::Mat tokayoTemplate;         // CV_8UC1
+  cv::Rect tokayoSubRect;
+  double tokayoNccThreshold = 0.0;
+  int tokayoRoiSide = 0;          // Gray ROI side the template and sub-rect are expressed in
+  std::string createdAt;          // ISO-8601 UTC
+};
+
+struct Match {
+  int entryIndex = -1;            // -1 = no model fits
+  double logoFraction = 0.0;      // Probed samples classified as logo
+  double ambiguousFraction = 0.0; // Probed samples within the uncertainty band
+  double margin = 0.0;            // Mean relative distance to the threshold
+  size_t probed = 0;
+};
+
+// How often each model was used per weekday/hour slot (UTC), learned from past runs.
+// Channels that switch bugs by programme (news, sports, ...) get a different model per slot.
+struct UsageIndex {
+  std::unordered_map<int, std::unordered_map<std::string, int>> counts;  // slot -> model id -> runs
+
+  // Up to maxCount model ids most used at this slot; neighbouring hours count half.
+  std::vector<std::string> candidates(int slot, size_t maxCount) const;
+  bool empty() const { return counts.empty(); }
+};
+
+// Per-sample score against the best of its candidate models.
+struct SampleScore {
+  int entryIndex = -1;     // -1 = no candidate for this sample
+  double normDist = 1.0;   // <= 1 means logo; 1 is the model's own threshold
+  bool ambiguous = false;  // within the model's uncertainty band
+};
+
+// Weekday * 24 + hour (UTC) of an epoch in milliseconds.
+int slotOf(int64_t epochMs);
+
+// Registry directory key for a playlist: host + path without file name or query.
+std::string channelKey(const std::string& playlistUrl);
+
+// Loads the entries of `channel` stored for this corner and ROI size. Unreadable files are skipped.
+// With `tokayoRoiSide` > 0, Tokayo templates cut on another rendition are resampled to that ROI
+// side, so a model trained on 1080p scores 360p samples.
+std::vector<Entry> load(const std::string& dir,
+                        const std::string& channel,
+                        int cornerIndex,
+                        double roiWidthPct,
+                        int tokayoRoiSide = 0);
+
+// Writes `entry` (assigning id and createdAt) and returns the file path. Throws on I/O failure.
+std::string save(const std::string& dir, const std::string& channel, Entry& entry);
+
+// Sorted entry ids stored for `channel`, joined by ','. Changes whenever a model is added or removed.
+std::string fingerprint(const std::string& dir, const std::string& channel);
+
+UsageIndex loadUsage(const std::string& dir, const std::string& channel);
+
+// Appends one usage record per (model id, slot) pair. Best effort: I/O errors are ignored.
+void recordUsage(const std::string& dir,
+                 const std::string& channel,
+                 const std::vector<std::pair<std::string, int>>& idSlots);
+
+// Scores every sample against only the candidate entries listed for it (typically the 2-3
+// models active at the sample's time of day). Same inputs as select().
+std::vector<SampleScore> scoreCandidates(const std::vector<Entry>& entries,
+                                         const std::vector<std::vector<int>>& candidatesPerSample,
+                                         const cv::Mat& sampleHists,
+                                         const std::vector<cv::Mat>* grayRois);
+
+// Same acceptance rule as select(), applied to per-sample scores. Samples without a candidate are
+// left out; false when none was scored.
+bool scoresFit(const std::vector<SampleScore>& scores);
+
+// Scores up to `probeCount` samples (evenly spread) against every entry in one batched pass.
+// Bhattacharyya entries use `sampleHists` (N x 512); with `grayRois` non-null only Tokayo
+// entries of matching ROI size are scored. A model matches when most probed samples fall
+// clearly on either side of its threshold and enough of them show the logo; the match with
+// the largest margin wins.
+Match select(const std::vector<Entry>& entries,
+             const cv::Mat& sampleHists,
+             const std::vector<cv::Mat>* grayRois,
+             int probeCount);
+
+}  // namespace model_registry
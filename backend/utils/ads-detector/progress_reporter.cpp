@@ -0,0 +1,94 @@
+#include "progress_reporter.h"
+
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cinttypes>
+#include <cstdio>
+
+namespace progress_reporter {
+
+const char* stageName(Stage stage) {
+  switch (stage) {
+    case Stage::Starting: return "starting";
+    case Stage::Sampling: return "sampling";
+    case Stage::Training: return "training";
+    case Stage::Detecting: return "detecting";
+    case Stage::Refining: return "refining";
+    case Stage::Output: return "output";
+    case Stage::Live: return "live";
+    case Stage::Done: return "done";
+  }
+  return "unknown";
+}
+
+std::string toJsonLine(const Snapshot& snap) {
+  char buf[256];
+  const int n = std::snprintf(buf, sizeof(buf),
+                              "{\"elapsedMs\":%" PRId64 ",\"stage\":\"%s\",\"samples\":[%" PRId64 ",%" PRId64
+                              "],\"refine\":[%" PRId64 ",%" PRId64 "],\"ads\":%" PRId64 ",\"live\":%" PRId64 "}\n",
+                              snap.elapsedMs, stageName(snap.stage), snap.samplesDone, snap.samplesTotal,
+                              snap.refineDone, snap.refineTotal, snap.adsFound, snap.liveSampled);
+  return std::string(buf, static_cast<size_t>(std::clamp(n, 0, static_cast<int>(sizeof(buf)) - 1)));
+}
+
+Reporter::Reporter(const Counters& counters, int fd, int intervalMs, std::function<void(const Snapshot&)> onTick)
+    : counters_(counters),
+      fd_(fd),
+      interval_(std::max(10, intervalMs)),
+      onTick_(std::move(onTick)),
+      start_(std::chrono::steady_clock::now()),
+      thread_([this] { run(); }) {}
+
+Reporter::~Reporter() { stop(); }
+
+void Reporter::stop() {
+  {
+    std::lock_guard<std::mutex> lock(mu_);
+    if (stopping_) return;
+    stopping_ = true;
+  }
+  cv_.notify_all();
+  if (thread_.joinable()) thread_.join();
+}
+
+Snapshot Reporter::take() const {
+  Snapshot snap;
+  snap.stage = static_cast<Stage>(counters_.stage.load(std::memory_order_relaxed));
+  snap.elapsedMs =
+      std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start_).count();
+  snap.samplesDone = counters_.samplesDone.load(std::memory_order_relaxed);
+  snap.samplesTotal = counters_.samplesTotal.load(std::memory_order_relaxed);
+  snap.refineDone = counters_.refineDone.load(std::memory_order_relaxed);
+  snap.refineTotal = counters_.refineTotal.load(std::memory_order_relaxed);
+  snap.adsFound = counters_.adsFound.load(std::memory_order_relaxed);
+  snap.liveSampled = counters_.liveSampled.load(std::memory_order_relaxed);
+  return snap;
+}
+
+void Reporter::emit(const Snapshot& snap) {
+  if (fd_ >= 0) {
+    const std::string line = toJsonLine(snap);
+    size_t off = 0;
+    while (off < line.size()) {
+      const ssize_t w = ::write(fd_, line.data() + off, line.size() - off);
+      if (w < 0 && errno == EINTR) continue;
+      if (w <= 0) break;  // Reader went away; progress is best effort.
+      off += static_cast<size_t>(w);
+    }
+  }
+  if (onTick_) onTick_(snap);
+}
+
+void Reporter::run() {
+  std::unique_lock<std::mutex> lock(mu_);
+  while (!stopping_) {
+    cv_.wait_for(lock, interval_, [this] { return stopping_; });
+    lock.unlock();
+    emit(take());
+    lock.lock();
+  }
+}
+
+}  // namespace progress_reporter
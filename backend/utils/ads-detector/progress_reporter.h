@@ -0,0 +1,73 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <thread>
+
+namespace progress_reporter {
+
+enum class Stage : int { Starting, Sampling, Training, Detecting, Refining, Output, Live, Done };
+
+const char* stageName(Stage stage);
+
+// Written from hot loops with relaxed atomics only; no formatting or I/O happens there.
+struct Counters {
+  std::atomic<int> stage{0};
+  std::atomic<int64_t> samplesDone{0};
+  std::atomic<int64_t> samplesTotal{0};
+  std::atomic<int64_t> refineDone{0};
+  std::atomic<int64_t> refineTotal{0};
+  std::atomic<int64_t> adsFound{0};
+  std::atomic<int64_t> liveSampled{0};
+
+  void setStage(Stage s) { stage.store(static_cast<int>(s), std::memory_order_relaxed); }
+};
+
+struct Snapshot {
+  Stage stage = Stage::Starting;
+  int64_t elapsedMs = 0;
+  int64_t samplesDone = 0;
+  int64_t samplesTotal = 0;
+  int64_t refineDone = 0;
+  int64_t refineTotal = 0;
+  int64_t adsFound = 0;
+  int64_t liveSampled = 0;
+};
+
+// One JSON object per line, e.g. {"elapsedMs":1200,"stage":"sampling","samples":[40,120],...}
+std::string toJsonLine(const Snapshot& snap);
+
+// Snapshots `counters` every `intervalMs` on its own thread. With fd >= 0 each snapshot is written
+// there as a JSON line; `onTick` (optional) also receives it on the reporter thread.
+class Reporter {
+ public:
+  Reporter(const Counters& counters, int fd, int intervalMs, std::function<void(const Snapshot&)> onTick = {});
+  ~Reporter();
+  Reporter(const Reporter&) = delete;
+  Reporter& operator=(const Reporter&) = delete;
+
+  // Stops the thread after one final snapshot. Idempotent.
+  void stop();
+
+ private:
+  Snapshot take() const;
+  void emit(const Snapshot& snap);
+  void run();
+
+  const Counters& counters_;
+  int fd_;
+  std::chrono::milliseconds interval_;
+  std::function<void(const Snapshot&)> onTick_;
+  std::chrono::steady_clock::time_point start_;
+  std::mutex mu_;
+  std::condition_variable cv_;
+  bool stopping_ = false;
+  std::thread thread_;
+};
+
+}  // namespace progress_reporter
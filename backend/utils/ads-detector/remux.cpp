@@ -0,0 +1,465 @@
+#include "remux.h"
+
+extern "C" {
+#include <libavcodec/avcodec.h>
+#include <libavformat/avformat.h>
+}
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <limits>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+namespace {
+
+// Boundaries closer than this to a keyframe are treated as already keyframe-aligned.
+constexpr double kCutEpsSec = 0.001;
+
+std::string avError(int code) {
+  char buf[AV_ERROR_MAX_STRING_SIZE] = {0};
+  av_strerror(code, buf, sizeof(buf));
+  return std::string(buf);
+}
+
+struct PacketDeleter {
+  void operator()(AVPacket* p) const { av_packet_free(&p); }
+};
+using PacketPtr = std::unique_ptr<AVPacket, PacketDeleter>;
+
+struct CodecContextDeleter {
+  void operator()(AVCodecContext* c) const { avcodec_free_context(&c); }
+};
+using CodecContextPtr = std::unique_ptr<AVCodecContext, CodecContextDeleter>;
+
+struct FrameDeleter {
+  void operator()(AVFrame* f) const { av_frame_free(&f); }
+};
+using FramePtr = std::unique_ptr<AVFrame, FrameDeleter>;
+
+struct InputDeleter {
+  void operator()(AVFormatContext* c) const { avformat_close_input(&c); }
+};
+using InputPtr = std::unique_ptr<AVFormatContext, InputDeleter>;
+
+enum Kind { kVideo = 0, kAudio = 1 };
+
+struct Buffered {
+  PacketPtr pkt;
+  Kind kind = kVideo;
+  double tlSec = 0.0;  // playlist timeline position of pkt->pts
+  AVRational tb{1, 90000};
+};
+
+InputPtr openSegment(const std::string& url, const m3u8::Segment& seg) {
+  if (!seg.mapUri.empty()) {
+    throw std::runtime_error("remux: fMP4 segments (EXT-X-MAP) are not supported yet");
+  }
+  AVDictionary* opts = nullptr;
+  if (seg.byteRangeLength >= 0) {
+    av_dict_set_int(&opts, "offset", seg.byteRangeOffset, 0);
+    av_dict_set_int(&opts, "end_offset", seg.byteRangeOffset + seg.byteRangeLength, 0);
+  }
+  AVFormatContext* ctx = nullptr;
+  const int rc = avformat_open_input(&ctx, url.c_str(), nullptr, &opts);
+  av_dict_free(&opts);
+  if (rc < 0) throw std::runtime_error("remux: could not open segment " + url + ": " + avError(rc));
+  return InputPtr(ctx);
+}
+
+int firstStreamOfType(const AVFormatContext* in, AVMediaType type) {
+  for (unsigned i = 0; i < in->nb_streams; i++) {
+    if (in->streams[i]->codecpar->codec_type == type) return static_cast<int>(i);
+  }
+  return -1;
+}
+
+// Decodes one buffered GOP and re-encodes the frames that fall inside [fromTl, toTl).
+// The encoder runs without a global header, so parameter sets travel in-band and the
+// re-encoded GOP decodes on its own between stream-copied GOPs (HLS TS video repeats
+// its SPS/PPS at every IDR).
+class GopReencoder {
+ public:
+  explicit GopReencoder(const AVStream* videoIn) : frameRate_(videoIn->avg_frame_rate) {
+    par_ = avcodec_parameters_alloc();
+    if (!par_ || avcodec_parameters_copy(par_, videoIn->codecpar) < 0) {
+      avcodec_parameters_free(&par_);
+      throw std::runtime_error("remux: could not copy video codec parameters");
+    }
+  }
+
+  ~GopReencoder() { avcodec_parameters_free(&par_); }
+
+  GopReencoder(const GopReencoder&) = delete;
+  GopReencoder& operator=(const GopReencoder&) = delete;
+
+  // Returns the encoded packets (time base 1/90000, tlSec = playlist timeline position).
+  std::vector<Buffered> run(const std::vector<Buffered>& gop, double fromTl, double toTl, int64_t* framesOut) {
+    std::vector<Buffered> encoded;
+
+    const AVCodec* dec = avcodec_find_decoder(par_->codec_id);
+    if (!dec) throw std::runtime_error("remux: no decoder for smart-cut video stream");
+    CodecContextPtr dctx(avcodec_alloc_context3(dec));
+    if (!dctx || avcodec_parameters_to_context(dctx.get(), par_) < 0 || avcodec_open2(dctx.get(), dec, nullptr) < 0) {
+      throw std::runtime_error("remux: could not open smart-cut decoder");
+    }
+
+    std::unordered_map<int64_t, double> ptsToTl;
+    std::vector<std::pair<double, FramePtr>> frames;
+    FramePtr decoded(av_frame_alloc());
+    auto drain = [&]() {
+      while (avcodec_receive_frame(dctx.get(), decoded.get()) >= 0) {
+        const auto it = ptsToTl.find(decoded->best_effort_timestamp);
+        if (it != ptsToTl.end() && it->second >= fromTl - kCutEpsSec && it->second < toTl - kCutEpsSec) {
+          frames.emplace_back(it->second, FramePtr(av_frame_clone(decoded.get())));
+        }
+        av_frame_unref(decoded.get());
+      }
+    };
+    for (const auto& b : gop) {
+      if (b.kind != kVideo) continue;
+      if (b.pkt->pts != AV_NOPTS_VALUE) ptsToTl[b.pkt->pts] = b.tlSec;
+      if (avcodec_send_packet(dctx.get(), b.pkt.get()) < 0) continue;
+      drain();
+    }
+    avcodec_send_packet(dctx.get(), nullptr);
+    drain();
+    if (frames.empty()) return encoded;
+    std::sort(frames.begin(), frames.end(), [](const auto& a, const auto& b) { return a.first < b.first; });
+
+    const AVCodec* enc = avcodec_find_encoder(par_->codec_id);
+    if (!enc) throw std::runtime_error("remux: no encoder available for smart-cut video codec");
+    CodecContextPtr ectx(avcodec_alloc_context3(enc));
+    if (!ectx) throw std::runtime_error("remux: could not allocate smart-cut encoder");
+    ectx->width = dctx->width;
+    ectx->height = dctx->height;
+    ectx->pix_fmt = dctx->pix_fmt;
+    ectx->sample_aspect_ratio = dctx->sample_aspect_ratio;
+    ectx->time_base = AVRational{1, 90000};
+    if (frameRate_.num > 0 && frameRate_.den > 0) ectx->framerate = frameRate_;
+    ectx->gop_size = static_cast<int>(frames.size()) + 1;  // one keyframe, at the cut
+    ectx->max_b_frames = 0;
+    if (par_->bit_rate > 0) ectx->bit_rate = par_->bit_rate;
+    const int rc = avcodec_open2(ectx.get(), enc, nullptr);
+    if (rc < 0) throw std::runtime_error("remux: could not open smart-cut encoder: " + avError(rc));
+
+    PacketPtr pkt(av_packet_alloc());
+    auto receive = [&]() {
+      while (avcodec_receive_packet(ectx.get(), pkt.get()) >= 0) {
+        Buffered b;
+        b.kind = kVideo;
+        b.tb = ectx->time_base;
+        b.tlSec = static_cast<double>(pkt->pts) * av_q2d(ectx->time_base);
+        b.pkt = PacketPtr(av_packet_clone(pkt.get()));
+        encoded.push_back(std::move(b));
+        av_packet_unref(pkt.get());
+      }
+    };
+    for (size_t i = 0; i < frames.size(); i++) {
+      AVFrame* f = frames[i].second.get();
+      f->pts = static_cast<int64_t>(std::llround(frames[i].first / av_q2d(ectx->time_base)));
+      f->pict_type = (i == 0) ? AV_PICTURE_TYPE_I : AV_PICTURE_TYPE_NONE;
+      if (avcodec_send_frame(ectx.get(), f) < 0) continue;
+      receive();
+    }
+    avcodec_send_frame(ectx.get(), nullptr);
+    receive();
+    if (framesOut) *framesOut += static_cast<int64_t>(frames.size());
+    return encoded;
+  }
+
+ private:
+  AVCodecParameters* par_ = nullptr;
+  AVRational frameRate_{0, 1};
+};
+
+// Sample entry for video whose parameter sets may change in-band. Smart-cut GOPs carry their own
+// SPS/PPS, which avc1/hvc1 do not allow (the decoder keeps the avcC/hvcC ones), so they are written
+// as avc3/hev1. 0 lets the muxer pick for other codecs.
+uint32_t inBandParameterSetTag(AVCodecID codecId) {
+  switch (codecId) {
+    case AV_CODEC_ID_H264: return MKTAG('a', 'v', 'c', '3');
+    case AV_CODEC_ID_HEVC: return MKTAG('h', 'e', 'v', '1');
+    default: return 0;
+  }
+}
+
+class Mp4Output {
+ public:
+  // `inBandParameterSets`: some video packets carry their own parameter sets (smart-cut).
+  Mp4Output(const std::string& path, AVFormatContext* firstInput, bool inBandParameterSets) {
+    int rc = avformat_alloc_output_context2(&oc_, nullptr, "mp4", path.c_str());
+    if (rc < 0 || !oc_) throw std::runtime_error("remux: could not create MP4 muxer: " + avError(rc));
+
+    const int inIdx[2] = {firstStreamOfType(firstInput, AVMEDIA_TYPE_VIDEO),
+                          firstStreamOfType(firstInput, AVMEDIA_TYPE_AUDIO)};
+    if (inIdx[kVideo] < 0) throw std::runtime_error("remux: no video stream in first segment");
+    for (int k = 0; k < 2; k++) {
+      if (inIdx[k] < 0) continue;
+      const AVStream* is = firstInput->streams[inIdx[k]];
+      AVStream* os = avformat_new_stream(oc_, nullptr);
+      if (!os) throw std::runtime_error("remux: could not allocate output stream");
+      rc = avcodec_parameters_copy(os->codecpar, is->codecpar);
+      if (rc < 0) throw std::runtime_error("remux: could not copy codec parameters: " + avError(rc));
+      os->codecpar->codec_tag =
+          (k == kVideo && inBandParameterSets) ? inBandParameterSetTag(is->codecpar->codec_id) : 0;
+      os->time_base = (k == kVideo) ? AVRational{1, 90000}
+                                    : AVRational{1, std::max(1, is->codecpar->sample_rate)};
+      outIdx_[k] = os->index;
+    }
+
+    if (!(oc_->oformat->flags & AVFMT_NOFILE)) {
+      rc = avio_open(&oc_->pb, path.c_str(), AVIO_FLAG_WRITE);
+      if (rc < 0) throw std::runtime_error("remux: could not open output " + path + ": " + avError(rc));
+    }
+    AVDictionary* opts = nullptr;
+    av_dict_set(&opts, "movflags", "frag_keyframe+empty_moov+default_base_moof", 0);
+    rc = avformat_write_header(oc_, &opts);
+    av_dict_free(&opts);
+    if (rc < 0) throw std::runtime_error("remux: could not write MP4 header: " + avError(rc));
+    headerWritten_ = true;
+  }
+
+  ~Mp4Output() {
+    if (!oc_) return;
+    if (headerWritten_ && !finished_) av_write_trailer(oc_);
+    if (!(oc_->oformat->flags & AVFMT_NOFILE)) avio_closep(&oc_->pb);
+    avformat_free_context(oc_);
+  }
+
+  Mp4Output(const Mp4Output&) = delete;
+  Mp4Output& operator=(const Mp4Output&) = delete;
+
+  bool hasStream(Kind k) const { return outIdx_[k] >= 0; }
+
+  // Rewrites the packet timestamps so its pts lands at `outSec` on the output timeline.
+  void write(Buffered& b, double outSec) {
+    if (outIdx_[b.kind] < 0) return;
+    AVStream* os = oc_->streams[outIdx_[b.kind]];
+    AVPacket* p = b.pkt.get();
+    int64_t pts = static_cast<int64_t>(std::llround(outSec / av_q2d(os->time_base)));
+    const int64_t reorder = (p->pts != AV_NOPTS_VALUE && p->dts != AV_NOPTS_VALUE)
+                                ? av_rescale_q(p->pts - p->dts, b.tb, os->time_base)
+                                : 0;
+    int64_t dts = pts - reorder;
+    int64_t& last = lastDts_[b.kind];
+    if (last != std::numeric_limits<int64_t>::min() && dts <= last) dts = last + 1;
+    if (pts < dts) pts = dts;
+    last = dts;
+
+    p->pts = pts;
+    p->dts = dts;
+    p->duration = av_rescale_q(p->duration, b.tb, os->time_base);
+    p->stream_index = os->index;
+    p->pos = -1;
+    const int rc = av_interleaved_write_frame(oc_, p);
+    if (rc < 0) throw std::runtime_error("remux: write failed: " + avError(rc));
+    packets_++;
+  }
+
+  void finish() {
+    if (finished_) return;
+    const int rc = av_write_trailer(oc_);
+    finished_ = true;
+    if (rc < 0) throw std::runtime_error("remux: could not write MP4 trailer: " + avError(rc));
+  }
+
+  int64_t packets() const { return packets_; }
+
+ private:
+  AVFormatContext* oc_ = nullptr;
+  int outIdx_[2] = {-1, -1};
+  int64_t lastDts_[2] = {std::numeric_limits<int64_t>::min(), std::numeric_limits<int64_t>::min()};
+  int64_t packets_ = 0;
+  bool headerWritten_ = false;
+  bool finished_ = false;
+};
+
+}  // namespace
+
+namespace remux {
+
+Stats writeMp4(const std::vector<m3u8::Segment>& segments,
+               const std::vector<m3u8::TimeRange>& keep,
+               const std::string& playlistUrl,
+               const std::string& outPath,
+               const Options& options) {
+  Stats stats;
+  std::unique_ptr<Mp4Output> out;
+  std::unique_ptr<GopReencoder> reencoder;
+  double cursorSec = 0.0;
+
+  for (const auto& range : keep) {
+    if (range.endSec <= range.startSec) continue;
+
+    // Packets since the last video keyframe. Writes lag one GOP behind the reader so
+    // each boundary can still snap to whichever keyframe is nearer.
+    std::vector<Buffered> pending;
+    bool started = false;
+    bool done = false;
+    bool haveKf = false;
+    double lastKfTl = 0.0;
+    double rangeStartTl = 0.0;
+    double rangeEndTl = 0.0;
+    double lastTl = 0.0;
+
+    auto flush = [&](double minTl, double maxTl) {
+      for (auto& b : pending) {
+        if (b.kind == kAudio && (b.tlSec < minTl || b.tlSec >= maxTl)) continue;
+        out->write(b, cursorSec + (b.tlSec - rangeStartTl));
+      }
+      pending.clear();
+    };
+
+    // Smart-cut: only [fromTl, toTl) of the buffered GOP survives; its video is re-encoded.
+    auto flushReencoded = [&](double fromTl, double toTl) {
+      auto encoded = reencoder->run(pending, fromTl, toTl, &stats.framesReencoded);
+      stats.gopsReencoded++;
+      for (auto& b : encoded) out->write(b, cursorSec + (b.tlSec - rangeStartTl));
+      // The GOP's original video packets were replaced by `encoded`; only its audio is kept.
+      for (auto& b : pending) {
+        if (b.kind != kAudio || b.tlSec < fromTl || b.tlSec >= toTl) continue;
+        out->write(b, cursorSec + (b.tlSec - rangeStartTl));
+      }
+      pending.clear();
+    };
+
+    size_t si = 0;
+    while (si < segments.size() && segments[si].endOffsetSec <= range.startSec) si++;
+
+    for (; si < segments.size() && !done; si++) {
+      const auto& seg = segments[si];
+      InputPtr in = openSegment(m3u8::resolveUri(playlistUrl, seg.uri), seg);
+      if (!out) {
+        const int rc = avformat_find_stream_info(in.get(), nullptr);
+        if (rc < 0) throw std::runtime_error("remux: could not probe first segment: " + avError(rc));
+        out = std::make_unique<Mp4Output>(outPath, in.get(), options.smartCut);
+        if (options.smartCut) {
+          reencoder = std::make_unique<GopReencoder>(in->streams[firstStreamOfType(in.get(), AVMEDIA_TYPE_VIDEO)]);
+        }
+      }
+      stats.segmentsRead++;
+
+      // MPEG-TS may announce streams lazily, so map them by type as packets arrive.
+      int inIdx[2] = {-1, -1};
+      bool haveOrigin = false;
+      double originSec = 0.0;
+      PacketPtr pkt(av_packet_alloc());
+
+      while (!done && av_read_frame(in.get(), pkt.get()) >= 0) {
+        const AVStream* st = in->streams[pkt->stream_index];
+        const AVMediaType type = st->codecpar->codec_type;
+        Kind kind = kVideo;
+        if (type == AVMEDIA_TYPE_VIDEO) {
+          if (inIdx[kVideo] < 0) inIdx[kVideo] = pkt->stream_index;
+          kind = kVideo;
+        } else if (type == AVMEDIA_TYPE_AUDIO) {
+          if (inIdx[kAudio] < 0) inIdx[kAudio] = pkt->stream_index;
+          kind = kAudio;
+        }
+        const int64_t ts = (pkt->pts != AV_NOPTS_VALUE) ? pkt->pts : pkt->dts;
+        if ((type != AVMEDIA_TYPE_VIDEO && type != AVMEDIA_TYPE_AUDIO) || pkt->stream_index != inIdx[kind] ||
+            ts == AV_NOPTS_VALUE || !out->hasStream(kind)) {
+          av_packet_unref(pkt.get());
+          continue;
+        }
+
+        // Segment-local timestamps are anchored on the playlist timeline (EXTINF offsets),
+        // the same clock the detector reports ad offsets on.
+        const double tb = av_q2d(st->time_base);
+        if (!haveOrigin) {
+          originSec = static_cast<double>(pkt->dts != AV_NOPTS_VALUE ? pkt->dts : ts) * tb;
+          haveOrigin = true;
+        }
+        const double tl = seg.startOffsetSec + static_cast<double>(ts) * tb - originSec;
+        const bool isKey = (kind == kVideo) && (pkt->flags & AV_PKT_FLAG_KEY);
+
+        if (isKey) {
+          if (!started && tl >= range.startSec) {
+            started = true;
+            const bool aligned = !haveKf || pending.empty() || (tl - range.startSec) <= kCutEpsSec;
+            if (reencoder && !aligned) {
+              rangeStartTl = range.startSec;
+              flushReencoded(range.startSec, std::min(tl, range.endSec));
+            } else if (!reencoder && !aligned && (range.startSec - lastKfTl) < (tl - range.startSec)) {
+              rangeStartTl = lastKfTl;
+            } else {
+              pending.clear();
+              rangeStartTl = tl;
+            }
+          } else if (!started) {
+            pending.clear();
+          }
+
+          if (started && tl > rangeStartTl) {
+            if (tl >= range.endSec) {
+              const bool aligned = pending.empty() || (tl - range.endSec) <= kCutEpsSec;
+              if (reencoder && !aligned) {
+                flushReencoded(lastKfTl, range.endSec);
+                rangeEndTl = range.endSec;
+              } else if (reencoder) {
+                flush(rangeStartTl, tl);
+                rangeEndTl = std::min(tl, range.endSec);
+              } else if (haveKf && (range.endSec - lastKfTl) < (tl - range.endSec)) {
+                pending.clear();
+                rangeEndTl = lastKfTl;
+              } else {
+                flush(rangeStartTl, tl);
+                rangeEndTl = tl;
+              }
+              done = true;
+              av_packet_unref(pkt.get());
+              break;
+            }
+            flush(rangeStartTl, std::numeric_limits<double>::infinity());
+          }
+          lastKfTl = tl;
+          haveKf = true;
+        }
+
+        // Nothing before the first keyframe is decodable on its own.
+        if (!haveKf) {
+          av_packet_unref(pkt.get());
+          continue;
+        }
+        Buffered b;
+        b.pkt = PacketPtr(av_packet_clone(pkt.get()));
+        b.kind = kind;
+        b.tlSec = tl;
+        b.tb = st->time_base;
+        lastTl = std::max(lastTl, tl + static_cast<double>(pkt->duration) * tb);
+        pending.push_back(std::move(b));
+        av_packet_unref(pkt.get());
+      }
+    }
+
+    // Ran out of segments before the end boundary: keep everything that was read.
+    if (!done) {
+      if (!started && haveKf) {
+        started = true;
+        rangeStartTl = lastKfTl;
+      }
+      if (started) {
+        flush(rangeStartTl, std::numeric_limits<double>::infinity());
+        rangeEndTl = lastTl;
+      }
+    }
+    if (started) {
+      cursorSec += std::max(0.0, rangeEndTl - rangeStartTl);
+      stats.rangesWritten++;
+    }
+  }
+
+  if (!out) throw std::runtime_error("remux: no content to write");
+  out->finish();
+  stats.packetsWritten = out->packets();
+  stats.outputDurationSec = cursorSec;
+  return stats;
+}
+
+}  // namespace remux
@@ -0,0 +1,36 @@
+#pragma once
+
+#include "m3u8.h"
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace remux {
+
+struct Options {
+  // Frame-accurate cuts: re-encode only the GOP containing each boundary and
+  // stream-copy everything in between. Off = snap to the nearest keyframe.
+  bool smartCut = false;
+};
+
+struct Stats {
+  size_t rangesWritten = 0;
+  size_t segmentsRead = 0;
+  int64_t packetsWritten = 0;
+  double outputDurationSec = 0.0;
+  size_t gopsReencoded = 0;
+  int64_t framesReencoded = 0;
+};
+
+// Stream-copies the `keep` ranges (playlist timeline, seconds) into one fragmented MP4
+// with continuous timestamps. Without smart-cut no decode/encode happens: every range
+// starts and ends on the video keyframe nearest to the requested boundary.
+// Throws std::runtime_error on failure.
+Stats writeMp4(const std::vector<m3u8::Segment>& segments,
+               const std::vector<m3u8::TimeRange>& keep,
+               const std::string& playlistUrl,
+               const std::string& outPath,
+               const Options& options = {});
+
+}  // namespace remux
@@ -0,0 +1,55 @@
+#include "result_cache.h"
+
+#include <unistd.h>
+
+#include <cstdint>
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <sstream>
+
+namespace fs = std::filesystem;
+
+namespace result_cache {
+
+std::string key(const std::string& canonical) {
+  uint64_t h = 14695981039346656037ULL;
+  for (const unsigned char c : canonical) {
+    h ^= c;
+    h *= 1099511628211ULL;
+  }
+  char buf[17];
+  std::snprintf(buf, sizeof(buf), "%016llx", static_cast<unsigned long long>(h));
+  return buf;
+}
+
+std::optional<std::string> load(const std::string& dir, const std::string& key) {
+  std::ifstream in(fs::path(dir) / (key + ".json"), std::ios::binary);
+  if (!in.is_open()) return std::nullopt;
+  std::ostringstream ss;
+  ss << in.rdbuf();
+  if (ss.str().empty()) return std::nullopt;
+  return ss.str();
+}
+
+void store(const std::string& dir, const std::string& key, const std::string& json) {
+  std::error_code ec;
+  fs::create_directories(dir, ec);
+  if (ec) return;
+  const fs::path finalPath = fs::path(dir) / (key + ".json");
+  const fs::path tmpPath = fs::path(dir) / (key + ".json.tmp" + std::to_string(::getpid()));
+  {
+    std::ofstream out(tmpPath, std::ios::binary | std::ios::trunc);
+    if (!out.is_open()) return;
+    out << json;
+    if (!out) {
+      out.close();
+      fs::remove(tmpPath, ec);
+      return;
+    }
+  }
+  fs::rename(tmpPath, finalPath, ec);
+  if (ec) fs::remove(tmpPath, ec);
+}
+
+}  // namespace result_cache
@@ -0,0 +1,18 @@
+#pragma once
+
+#include <optional>
+#include <string>
+
+// Whole-result memoization: the detector JSON stored under a hash of everything that determines it.
+namespace result_cache {
+
+// FNV-1a 64 of `canonical`, as 16 hex digits.
+std::string key(const std::string& canonical);
+
+// Stored JSON for `key`, or nullopt on a miss.
+std::optional<std::string> load(const std::string& dir, const std::string& key);
+
+// Stores `json` under `key` (tmp + rename). Best effort: I/O errors are ignored.
+void store(const std::string& dir, const std::string& key, const std::string& json);
+
+}  // namespace result_cache
@@ -0,0 +1,109 @@
+#include "seed_index.h"
+
+#include <algorithm>
+#include <cmath>
+#include <stdexcept>
+#include <utility>
+
+namespace seed_index {
+namespace {
+
+float squaredL2(const float* a, const float* b, int dims) {
+  float acc = 0.0f;
+  for (int d = 0; d < dims; d++) {
+    const float diff = a[d] - b[d];
+    acc += diff * diff;
+  }
+  return acc;
+}
+
+// ||sqrt(p) - sqrt(q)||^2 = 2 - 2 * BC and OpenCV's Bhattacharyya distance is sqrt(1 - BC) for
+// sum-normalized histograms.
+double bhattacharyyaFromL2(float squared) {
+  return std::sqrt(std::min(1.0, std::max(0.0, 0.5 * static_cast<double>(squared))));
+}
+
+void sqrtInto(const float* hist, int dims, float* out) {
+  for (int d = 0; d < dims; d++) out[d] = std::sqrt(std::max(0.0f, hist[d]));
+}
+
+}  // namespace
+
+IvfFlat::IvfFlat(const cv::Mat& hists, const std::vector<int>& rows, int nlist, int nprobe) {
+  if (hists.empty() || hists.type() != CV_32F) throw std::runtime_error("seed index: histograms must be CV_32F");
+  dims_ = hists.cols;
+
+  std::vector<int> ids;
+  ids.reserve(rows.size());
+  for (int r : rows) {
+    if (r >= 0 && r < hists.rows) ids.push_back(r);
+  }
+  if (ids.empty()) throw std::runtime_error("seed index: no rows to index");
+  size_ = ids.size();
+
+  cv::Mat data(static_cast<int>(ids.size()), dims_, CV_32F);
+  for (int i = 0; i < data.rows; i++) sqrtInto(hists.ptr<float>(ids[static_cast<size_t>(i)]), dims_, data.ptr<float>(i));
+
+  if (nlist <= 0) nlist = static_cast<int>(std::lround(std::sqrt(static_cast<double>(ids.size()))));
+  // k-means needs a few vectors per list to be worth it; tiny banks get one exact list.
+  nlist = std::max(1, std::min(nlist, static_cast<int>(ids.size()) / 4));
+
+  cv::Mat labels;
+  if (nlist == 1) {
+    labels = cv::Mat::zeros(data.rows, 1, CV_32S);
+    cv::reduce(data, centroids_, 0, cv::REDUCE_AVG);
+  } else {
+    cv::kmeans(data, nlist, labels,
+               cv::TermCriteria(cv::TermCriteria::EPS + cv::TermCriteria::COUNT, 20, 1e-4),
+               1, cv::KMEANS_PP_CENTERS, centroids_);
+  }
+
+  lists_.resize(static_cast<size_t>(nlist));
+  for (int i = 0; i < data.rows; i++) {
+    List& list = lists_[static_cast<size_t>(labels.at<int>(i, 0))];
+    list.ids.push_back(ids[static_cast<size_t>(i)]);
+    list.vecs.insert(list.vecs.end(), data.ptr<float>(i), data.ptr<float>(i) + dims_);
+  }
+  nprobe_ = std::max(1, std::min(nprobe, nlist));
+}
+
+std::vector<Neighbor> IvfFlat::search(const float* hist, int k, int excludeId, int nprobe) const {
+  std::vector<Neighbor> out;
+  if (k <= 0) return out;
+  std::vector<float> query(static_cast<size_t>(dims_));
+  sqrtInto(hist, dims_, query.data());
+
+  const int listCount = nlist();
+  const int probes = std::max(1, std::min(nprobe > 0 ? nprobe : nprobe_, listCount));
+  std::vector<std::pair<float, int>> order;
+  order.reserve(static_cast<size_t>(listCount));
+  for (int l = 0; l < listCount; l++) order.emplace_back(squaredL2(query.data(), centroids_.ptr<float>(l), dims_), l);
+  if (probes < listCount) {
+    std::partial_sort(order.begin(), order.begin() + probes, order.end());
+  }
+
+  std::vector<std::pair<float, int>> candidates;
+  for (int p = 0; p < probes; p++) {
+    const List& list = lists_[static_cast<size_t>(order[static_cast<size_t>(p)].second)];
+    for (size_t j = 0; j < list.ids.size(); j++) {
+      if (list.ids[j] == excludeId) continue;
+      candidates.emplace_back(squaredL2(query.data(), list.vecs.data() + j * static_cast<size_t>(dims_), dims_),
+                              list.ids[j]);
+    }
+  }
+  const size_t kk = std::min(candidates.size(), static_cast<size_t>(k));
+  std::partial_sort(candidates.begin(), candidates.begin() + static_cast<long>(kk), candidates.end());
+  out.reserve(kk);
+  for (size_t j = 0; j < kk; j++) out.push_back(Neighbor{candidates[j].second, bhattacharyyaFromL2(candidates[j].first)});
+  return out;
+}
+
+double IvfFlat::avgDist(const float* hist, int k, int excludeId, int nprobe) const {
+  const auto neighbors = search(hist, k, excludeId, nprobe);
+  if (neighbors.empty()) return 0.0;
+  double sum = 0.0;
+  for (const auto& n : neighbors) sum += n.dist;
+  return sum / static_cast<double>(neighbors.size());
+}
+
+}  // namespace seed_index
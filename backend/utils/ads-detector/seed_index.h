@@ -0,0 +1,51 @@
+#pragma once
+
+#include <opencv2/core.hpp>
+
+#include <vector>
+
+// Approximate k-NN over logo seed histograms (--knn-ann).
+namespace seed_index {
+
+struct Neighbor {
+  int id = -1;        // row of the histogram matrix the index was built from
+  double dist = 0.0;  // Bhattacharyya distance
+};
+
+// Inverted-file index (IVF-flat) of normalized histograms stored as their element-wise square
+// roots. In that (Hellinger) space the squared L2 distance is 2 - 2 * Bhattacharyya coefficient,
+// so every candidate scanned gets its exact Bhattacharyya distance; only the choice of which
+// inverted lists to scan is approximate. Immutable after construction; queries are thread-safe.
+class IvfFlat {
+ public:
+  // Indexes `rows` of `hists` (CV_32F, one sum-normalized histogram per row). The vectors are
+  // split into `nlist` k-means lists (0 = round(sqrt(n)); 1 = exact scan) and each query scans the
+  // `nprobe` lists whose centroids are nearest. Throws on empty or mismatched input.
+  IvfFlat(const cv::Mat& hists, const std::vector<int>& rows, int nlist, int nprobe);
+
+  // The k nearest indexed vectors to `hist` (ascending distance), skipping `excludeId`.
+  // `nprobe` <= 0 uses the index's own; nprobe >= nlist() is an exact search.
+  std::vector<Neighbor> search(const float* hist, int k, int excludeId = -1, int nprobe = 0) const;
+
+  // Mean distance of search()'s neighbors (0 if there are none).
+  double avgDist(const float* hist, int k, int excludeId = -1, int nprobe = 0) const;
+
+  size_t size() const { return size_; }
+  int dims() const { return dims_; }
+  int nlist() const { return static_cast<int>(lists_.size()); }
+  int nprobe() const { return nprobe_; }
+
+ private:
+  struct List {
+    std::vector<int> ids;
+    std::vector<float> vecs;  // ids.size() x dims_, contiguous
+  };
+
+  int dims_ = 0;
+  int nprobe_ = 1;
+  size_t size_ = 0;
+  cv::Mat centroids_;  // nlist x dims_, CV_32F (Hellinger space)
+  std::vector<List> lists_;
+};
+
+}  // namespace seed_index
@@ -0,0 +1,143 @@
+#include "sprite_sheet.h"
+
+#include "json_util.h"
+
+#include <opencv2/imgcodecs.hpp>
+#include <opencv2/imgproc.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <stdexcept>
+#include <utility>
+
+namespace fs = std::filesystem;
+
+namespace sprite_sheet {
+namespace {
+
+constexpr double kMinTileGapSec = 0.05;
+constexpr int kJpegQuality = 75;
+
+// WebVTT timestamp: HH:MM:SS.mmm
+std::string vttTime(double sec) {
+  const long long ms = std::llround(std::max(0.0, sec) * 1000.0);
+  char buf[32];
+  std::snprintf(buf, sizeof(buf), "%02lld:%02lld:%02lld.%03lld",
+                ms / 3600000, (ms / 60000) % 60, (ms / 1000) % 60, ms % 1000);
+  return buf;
+}
+
+std::string sheetName(size_t index) {
+  char buf[32];
+  std::snprintf(buf, sizeof(buf), "sprite_%03zu.jpg", index);
+  return buf;
+}
+
+}  // namespace
+
+Collector::Collector(std::string dir, int tileWidth, int columns, int rows)
+    : dir_(std::move(dir)), tileWidth_(tileWidth), columns_(columns), rows_(rows) {
+  if (tileWidth_ < 16) throw std::runtime_error("sprite tile width must be >= 16");
+  if (columns_ < 1 || rows_ < 1) throw std::runtime_error("sprite grid must be at least 1x1");
+}
+
+void Collector::add(double tSec, const cv::Mat& bgrFrame) {
+  if (bgrFrame.empty()) return;
+  int tileHeight = 0;
+  {
+    std::lock_guard<std::mutex> lock(mu_);
+    if (tileHeight_ == 0) {
+      // Even height keeps every tile the same size whatever the source resolution.
+      const int h = static_cast<int>(std::lround(static_cast<double>(tileWidth_) * bgrFrame.rows / bgrFrame.cols));
+      tileHeight_ = std::max(2, h & ~1);
+    }
+    tileHeight = tileHeight_;
+  }
+  cv::Mat thumb;
+  if (bgrFrame.cols == tileWidth_ && bgrFrame.rows == tileHeight) {
+    thumb = bgrFrame.clone();
+  } else {
+    cv::resize(bgrFrame, thumb, cv::Size(tileWidth_, tileHeight), 0, 0, cv::INTER_AREA);
+  }
+  std::lock_guard<std::mutex> lock(mu_);
+  tiles_.push_back(Tile{tSec, std::move(thumb)});
+}
+
+Summary Collector::write(double totalDurationSec) {
+  std::lock_guard<std::mutex> lock(mu_);
+  std::sort(tiles_.begin(), tiles_.end(), [](const Tile& a, const Tile& b) { return a.tSec < b.tSec; });
+  std::vector<Tile> tiles;
+  tiles.reserve(tiles_.size());
+  for (auto& t : tiles_) {
+    if (!tiles.empty() && t.tSec - tiles.back().tSec < kMinTileGapSec) continue;
+    tiles.push_back(std::move(t));
+  }
+  tiles_.clear();
+
+  Summary summary;
+  summary.tiles = tiles.size();
+  summary.tileWidth = tileWidth_;
+  summary.tileHeight = tileHeight_;
+  if (tiles.empty()) return summary;
+
+  std::error_code ec;
+  fs::create_directories(dir_, ec);
+  if (ec) throw std::runtime_error("cannot create sprites dir " + dir_ + ": " + ec.message());
+
+  const size_t perSheet = static_cast<size_t>(columns_) * static_cast<size_t>(rows_);
+  const std::vector<int> jpegParams = {cv::IMWRITE_JPEG_QUALITY, kJpegQuality};
+  summary.sheets = (tiles.size() + perSheet - 1) / perSheet;
+  for (size_t s = 0; s < summary.sheets; s++) {
+    const size_t first = s * perSheet;
+    const size_t count = std::min(perSheet, tiles.size() - first);
+    // The last sheet only has as many rows as it needs.
+    const int usedRows = static_cast<int>((count + static_cast<size_t>(columns_) - 1) / static_cast<size_t>(columns_));
+    const int usedCols = static_cast<int>(std::min(count, static_cast<size_t>(columns_)));
+    cv::Mat sheet(usedRows * tileHeight_, usedCols * tileWidth_, CV_8UC3, cv::Scalar(0, 0, 0));
+    for (size_t i = 0; i < count; i++) {
+      const int col = static_cast<int>(i % static_cast<size_t>(columns_));
+      const int row = static_cast<int>(i / static_cast<size_t>(columns_));
+      tiles[first + i].image.copyTo(sheet(cv::Rect(col * tileWidth_, row * tileHeight_, tileWidth_, tileHeight_)));
+    }
+    const std::string path = (fs::path(dir_) / sheetName(s)).string();
+    if (!cv::imwrite(path, sheet, jpegParams)) throw std::runtime_error("cannot write sprite sheet " + path);
+  }
+
+  summary.vttPath = (fs::path(dir_) / "sprites.vtt").string();
+  summary.jsonPath = (fs::path(dir_) / "sprites.json").string();
+  std::ofstream vtt(summary.vttPath, std::ios::trunc);
+  std::ofstream json(summary.jsonPath, std::ios::trunc);
+  if (!vtt.is_open() || !json.is_open()) throw std::runtime_error("cannot write sprite index in " + dir_);
+
+  vtt << "WEBVTT\n";
+  json << "{\n";
+  json << "  \"tileWidth\": " << tileWidth_ << ",\n";
+  json << "  \"tileHeight\": " << tileHeight_ << ",\n";
+  json << "  \"columns\": " << columns_ << ",\n";
+  json << "  \"rows\": " << rows_ << ",\n";
+  json << "  \"tiles\": [\n";
+  for (size_t i = 0; i < tiles.size(); i++) {
+    const std::string sheet = sheetName(i / perSheet);
+    const size_t slot = i % perSheet;
+    const int x = static_cast<int>(slot % static_cast<size_t>(columns_)) * tileWidth_;
+    const int y = static_cast<int>(slot / static_cast<size_t>(columns_)) * tileHeight_;
+    const double start = tiles[i].tSec;
+    const double end = (i + 1 < tiles.size()) ? tiles[i + 1].tSec : std::max(start + kMinTileGapSec, totalDurationSec);
+
+    vtt << "\n" << vttTime(start) << " --> " << vttTime(end) << "\n";
+    vtt << sheet << "#xywh=" << x << "," << y << "," << tileWidth_ << "," << tileHeight_ << "\n";
+
+    json << "    {\"t\": " << start << ", \"sheet\": ";
+    json_util::writeString(json, sheet);
+    json << ", \"x\": " << x << ", \"y\": " << y << "}" << (i + 1 < tiles.size() ? "," : "") << "\n";
+  }
+  json << "  ]\n";
+  json << "}\n";
+  if (!vtt.good() || !json.good()) throw std::runtime_error("cannot write sprite index in " + dir_);
+  return summary;
+}
+
+}  // namespace sprite_sheet
@@ -0,0 +1,52 @@
+#pragma once
+
+#include <opencv2/core.hpp>
+
+#include <mutex>
+#include <string>
+#include <vector>
+
+// Timeline preview thumbnails built from frames the detector already decoded.
+namespace sprite_sheet {
+
+struct Summary {
+  size_t tiles = 0;
+  size_t sheets = 0;
+  int tileWidth = 0;
+  int tileHeight = 0;
+  std::string vttPath;
+  std::string jsonPath;
+};
+
+// Collects thumbnails from any thread and writes them as tiled JPEG sheets
+// (`sprite_NNN.jpg`, columns x rows tiles each) plus a WebVTT (`sprites.vtt`, `#xywh=` cues)
+// and a JSON index (`sprites.json`). Tiles are ordered by time; frames closer than 50 ms to an
+// earlier tile are dropped. Thread-safe.
+class Collector {
+ public:
+  Collector(std::string dir, int tileWidth, int columns = 10, int rows = 10);
+
+  // Downscales `bgrFrame` to the tile size (fixed by the first frame's aspect ratio).
+  // Frames already at the tile size are stored as-is.
+  void add(double tSec, const cv::Mat& bgrFrame);
+
+  // Writes sheets and indexes; each cue lasts until the next tile, the last one until
+  // `totalDurationSec`. Throws on I/O failure.
+  Summary write(double totalDurationSec);
+
+ private:
+  struct Tile {
+    double tSec = 0.0;
+    cv::Mat image;
+  };
+
+  std::string dir_;
+  int tileWidth_ = 160;
+  int columns_ = 10;
+  int rows_ = 10;
+  std::mutex mu_;
+  int tileHeight_ = 0;  // 0 until the first frame
+  std::vector<Tile> tiles_;
+};
+
+}  // namespace sprite_sheet
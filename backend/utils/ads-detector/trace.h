@@ -0,0 +1,49 @@
+#pragma once
+
+#include <string>
+
+// USDT static probes (provider "ads_detector") on the detector's hot paths. Each probe site is a
+// single nop until a tracer attaches, plus whatever its arguments cost: they are values the site
+// already has, so timestamps and thread ids are left to the tracer (bpftrace's nsecs and tid), e.g.:
+//   bpftrace -e 'usdt:./bin/ads_detector:ads_detector:sample_end { @[str(arg0), arg2] = count(); }'
+// Every probe carries arg0 = channel followed by its own arguments. Built without <sys/sdt.h> (or
+// with -DADS_DETECTOR_NO_USDT) the macros expand to nothing; -DADS_DETECTOR_REQUIRE_USDT turns a
+// missing header into a build error instead.
+#if defined(__has_include) && !defined(ADS_DETECTOR_NO_USDT)
+#if __has_include(<sys/sdt.h>)
+#include <sys/sdt.h>
+#define ADS_DETECTOR_HAVE_USDT 1
+#endif
+#endif
+#if defined(ADS_DETECTOR_REQUIRE_USDT) && !defined(ADS_DETECTOR_HAVE_USDT)
+#error "ADS_DETECTOR_REQUIRE_USDT is set but <sys/sdt.h> was not found"
+#endif
+
+namespace trace {
+
+// Channel label attached to every probe. Set once, before worker threads start.
+inline const char*& channelRef() {
+  static const char* channel = "";
+  return channel;
+}
+
+inline void setChannel(const std::string& channel) {
+  static std::string storage;
+  storage = channel;
+  channelRef() = storage.c_str();
+}
+
+}  // namespace trace
+
+#if defined(ADS_DETECTOR_HAVE_USDT)
+#define ADS_TRACE0(name) DTRACE_PROBE1(ads_detector, name, trace::channelRef())
+#define ADS_TRACE1(name, a) DTRACE_PROBE2(ads_detector, name, trace::channelRef(), a)
+#define ADS_TRACE2(name, a, b) DTRACE_PROBE3(ads_detector, name, trace::channelRef(), a, b)
+#define ADS_TRACE3(name, a, b, c) DTRACE_PROBE4(ads_detector, name, trace::channelRef(), a, b, c)
+#else
+// sizeof keeps the arguments "used" without evaluating them.
+#define ADS_TRACE0(name) do {} while (0)
+#define ADS_TRACE1(name, a) do { (void)sizeof(a); } while (0)
+#define ADS_TRACE2(name, a, b) do { (void)sizeof(a); (void)sizeof(b); } while (0)
+#define ADS_TRACE3(name, a, b, c) do { (void)sizeof(a); (void)sizeof(b); (void)sizeof(c); } while (0)
+#endif
@@ -9,6 +9,42 @@ mkdir -p "$OUT_DIR"
 
 CXX="${CXX:-g++}"
 CXXFLAGS="${CXXFLAGS:--O2 -std=c++17}"
+LDFLAGS="${LDFLAGS:-}"
+
+# BUILD_PROFILE=minimal links only the OpenCV modules the detector uses (core, imgproc,
+# imgcodecs, videoio), statically when the .a archives are installed, with LTO and
+# --as-needed. Every invocation then skips loading and initializing dnn/ml/highgui/...:
+#   BUILD_PROFILE=minimal bash build_ads_detector.sh
+BUILD_PROFILE="${BUILD_PROFILE:-default}"
+if [[ "$BUILD_PROFILE" != "default" && "$BUILD_PROFILE" != "minimal" ]]; then
+  echo "Error: unknown BUILD_PROFILE: $BUILD_PROFILE (default|minimal)" >&2
+  exit 1
+fi
+if [[ "$BUILD_PROFILE" == "minimal" ]]; then
+  CXXFLAGS="$CXXFLAGS -flto -ffunction-sections -fdata-sections"
+  LDFLAGS="$LDFLAGS -flto -Wl,-O1 -Wl,--gc-sections -Wl,--as-needed"
+fi
+
+# minimal_libs <libdir> <pkgs> <drop-regex> <lib...>
+# Links <lib...> from <libdir> statically when every archive exists, otherwise dynamically.
+# The static path adds the private deps pkg-config lists for <pkgs>, minus those matching
+# <drop-regex> (the other modules of the same package).
+minimal_libs() {
+  local libdir="$1" pkgs="$2" drop="$3"
+  shift 3
+  local names="" all_static=1 l
+  for l in "$@"; do
+    names+="-l$l "
+    [[ -f "$libdir/lib$l.a" ]] || all_static=0
+  done
+  if [[ $all_static -eq 1 ]]; then
+    local deps
+    deps="$(pkg-config --static --libs $pkgs | tr ' ' '\n' | grep -v -E -- "$drop" | tr '\n' ' ')"
+    echo "-L$libdir -Wl,-Bstatic $names-Wl,-Bdynamic $deps"
+  else
+    echo "-L$libdir $names"
+  fi
+}
 
 if ! command -v "$CXX" >/dev/null 2>&1; then
   echo "Error: compiler not found: $CXX" >&2
@@ -54,18 +90,68 @@ EOF
   fi
 
   OPENCV_CFLAGS="$(pkg-config --cflags "$OPENCV_PKG")"
-  OPENCV_LIBS="$(pkg-config --libs "$OPENCV_PKG")"
+  if [[ "$BUILD_PROFILE" == "minimal" ]]; then
+    OPENCV_LIBS="$(minimal_libs "$(pkg-config --variable=libdir "$OPENCV_PKG")" "$OPENCV_PKG" '^-lopencv_' \
+      opencv_videoio opencv_imgcodecs opencv_imgproc opencv_core)"
+  else
+    OPENCV_LIBS="$(pkg-config --libs "$OPENCV_PKG")"
+  fi
+fi
+
+# FFmpeg libraries for the stream-copy remux stage (--remux-out):
+#   FFMPEG_CFLAGS="..." FFMPEG_LIBS="..." bash build_ads_detector.sh
+FFMPEG_CFLAGS="${FFMPEG_CFLAGS:-}"
+FFMPEG_LIBS="${FFMPEG_LIBS:-}"
+
+if [[ -z "$FFMPEG_CFLAGS" || -z "$FFMPEG_LIBS" ]]; then
+  FFMPEG_PKGS="libavformat libavcodec libavutil"
+  if ! pkg-config --exists $FFMPEG_PKGS; then
+    cat >&2 <<'EOF'
+Error: FFmpeg pkg-config files not found (libavformat/libavcodec/libavutil).
+
+Install FFmpeg dev packages (Ubuntu/Debian):
+  sudo apt update
+  sudo apt install -y libavformat-dev libavcodec-dev libavutil-dev
+EOF
+    exit 1
+  fi
+
+  FFMPEG_CFLAGS="$(pkg-config --cflags $FFMPEG_PKGS)"
+  if [[ "$BUILD_PROFILE" == "minimal" ]]; then
+    FFMPEG_LIBS="$(minimal_libs "$(pkg-config --variable=libdir libavformat)" "$FFMPEG_PKGS" '^-l(avformat|avcodec|avutil)$' \
+      avformat avcodec avutil)"
+  else
+    FFMPEG_LIBS="$(pkg-config --libs $FFMPEG_PKGS)"
+  fi
+fi
+
+# Static libstdc++/libgcc only next to a static OpenCV: a dynamic libopencv_* brings the shared
+# runtime along, and two copies of it in one process break ODR and exception unwinding.
+if [[ "$BUILD_PROFILE" == "minimal" && "$OPENCV_LIBS" == *-Wl,-Bstatic* ]]; then
+  LDFLAGS="$LDFLAGS -static-libstdc++ -static-libgcc"
 fi
 
 "$CXX" $CXXFLAGS \
   -o "$OUT_DIR/ads_detector" \
   "$SRC_DIR/main.cpp" \
+  "$SRC_DIR/flight_recorder.cpp" \
   "$SRC_DIR/http.cpp" \
+  "$SRC_DIR/job_queue.cpp" \
+  "$SRC_DIR/keyframe_index.cpp" \
   "$SRC_DIR/m3u8.cpp" \
   "$SRC_DIR/logo_detector.cpp" \
+  "$SRC_DIR/model_registry.cpp" \
+  "$SRC_DIR/progress_reporter.cpp" \
+  "$SRC_DIR/remux.cpp" \
+  "$SRC_DIR/result_cache.cpp" \
+  "$SRC_DIR/seed_index.cpp" \
+  "$SRC_DIR/sprite_sheet.cpp" \
   $OPENCV_CFLAGS \
+  $FFMPEG_CFLAGS \
+  $LDFLAGS \
   $OPENCV_LIBS \
+  $FFMPEG_LIBS \
   -lcurl
 
-echo "Built: $OUT_DIR/ads_detector"
+echo "Built ($BUILD_PROFILE): $OUT_DIR/ads_detector"
 